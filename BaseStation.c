@@ -3,11 +3,21 @@
 #include "pico/cyw43_arch.h"
 
 #include "display.h"
+#include "view.h"
+#include "toast.h"
+#include "localserver.h"
 #include "keypad.h"
 #include "userinterface.h"
 #include "wifi.h"
 #include "server_interface.h"
 #include "buzzer.h"
+#include "boot.h"
+#include "kvstore.h"
+#include "console.h"
+#include "profiler.h"
+#include "trace.h"
+#include "record.h"
+#include "netstats.h"
 
 #include "pico/time.h"
 
@@ -47,44 +57,165 @@ struct DisplayPinConfig display_config = {
 
 int main()
 {
-    absolute_time_t timestamp = make_timeout_time_ms(60000);
+    // First request as soon as WiFi is connected
+    absolute_time_t timestamp = get_absolute_time();
 
 
     stdio_init_all();
-    sleep_ms(5000);
+
+#if BASESTATION_STDIO_WAIT_MS
+    // Give the USB serial console time to connect before printing
+    sleep_ms(BASESTATION_STDIO_WAIT_MS);
+#endif
+    boot_mark(BOOT_STDIO);
+
+    // Start the log before any input can arrive
+    RECORD_START();
+
+#if BASESTATION_PROFILE
+    prof_init();
+#endif
 
 
     init_buzzer(26);
 
     printf("Initializing display\n");
     init_display(display_config);
+    view_init();
+    boot_mark(BOOT_DISPLAY);
 
     printf("Initializing keypad\n");
     init_keypad(keypad_config, key_matrix);
+    boot_mark(BOOT_KEYPAD);
+
+    // Build the settings index and restore last reading and buzzer limits
+    kv_init(&kv_flash_pico);
+    bool cache_restored = boot_cache_restore() == 0;
+    boot_mark(BOOT_CACHE);
 
     printf("Initializing UI\n");
-    enum InterfaceState ui_state = init_ui();
+    enum InterfaceState ui_state;
+
+    // Show the cached reading right away while WiFi comes up
+    if(cache_restored){
+        ui_state = data_page(NO_INPUT);
+    }
+    else{
+        ui_state = init_ui();
+    }
+    view_flush();
+    boot_mark(BOOT_FIRST_SCREEN);
 
     // Enable the WiFi chip and driver
     init_wifi();
+    boot_mark(BOOT_WIFI);
+
+    // Count traffic on the WiFi interface
+    net_stats_init();
+
+    // Serve readings to clients on the LAN
+    local_server_init();
+
+    // Rejoin the last network without scanning
+    wifi_start_auto_connect();
+
+    boot_print_timing();
+
+    // Scan results shown on the WiFi page
+    uint32_t scan_generation = wifi_scan_generation();
+
+    uint32_t requests_sent = 0;
+
+    // Next redraw of the diagnostics page
+    absolute_time_t diagnostics_refresh = get_absolute_time();
 
     while (true) {
-        // If more than 60 seconds have passed since last request send 
+        enum wifi_event event = wifi_poll();
+
+        if(event != WIFI_EVENT_NONE){
+            RECORD_WIFI(event);
+            ui_wifi_event(event);
+        }
+
+        if(event == WIFI_EVENT_CONNECTED){
+            boot_mark(BOOT_WIFI_CONNECTED);
+
+            // Resolve server addresses and request data right away
+            server_warm_dns();
+            timestamp = get_absolute_time();
+            wifi_power_schedule_request(timestamp);
+        }
+
+        // Once the poll interval has passed since the last request send
         // a new request to the server
-        if(timestamp < get_absolute_time()){
+        if(wifi_is_connected() && timestamp < get_absolute_time()){
             // Make request to server for last data
             request_last_data();
 
 
-            timestamp = make_timeout_time_ms(10000);
+            timestamp = make_timeout_time_ms(server_next_poll_ms());
+
+            // Wake the radio just before the next request
+            wifi_power_schedule_request(timestamp);
+
+            // Report radio power modes every 10 minutes
+            if(++requests_sent % 60 == 0){
+                wifi_power_print_stats();
+            }
+        }
+
+        // Advance requests in flight: timeouts, retries and completion
+        server_poll();
+        wifi_power_set_requests_pending(server_requests_pending());
+
+        // Serialise new readings for the local server
+        local_server_poll();
+
+        // Keep server addresses fresh so requests never wait on DNS
+        server_refresh_dns();
+
+        // Persist changed limits and readings
+        boot_cache_update();
+
+        // Show scan results while the scan is still running
+        if(ui_state == UI_SETTINGS_WIFI && wifi_scan_generation() != scan_generation){
+            scan_generation = wifi_scan_generation();
+            ui_state = wifi_settings_page(INPUT_REFRESH);
+        }
+
+        // Keep statistics on the diagnostics page current
+        if(ui_state == UI_DIAGNOSTICS && diagnostics_refresh < get_absolute_time()){
+            diagnostics_refresh = make_timeout_time_ms(1000);
+            ui_state = diagnostics_page(INPUT_REFRESH);
         }
 
+        // Run commands from the USB serial console
+        console_poll();
+
+        // Expire notifications and draw what changed on the pages,
+        // at most once per frame
+        toast_poll();
+        view_render();
+
         // Poll keypad
-        char key = poll_keypad();
+        char key;
+        PROF_ZONE(PROF_POLL_KEYPAD, key = poll_keypad());
+
+        if(key != NO_INPUT){
+            TRACE_INSTANT(TRACE_KEY, key);
+            RECORD_KEY(key);
+        }
+
+        enum InterfaceState previous_state = ui_state;
+
+        // New readings are checked against the alarm rules on every page,
+        // and alarms waiting for their hold-off are raised between readings
+        bool updated = new_data();
+        ui_update_alarms();
 
         // If no key is pressed but there is new data and current page is data update page
-        if(new_data() && ui_state == UI_DATA){
-            ui_state = data_page(key);
+        if(updated && ui_state == UI_DATA){
+            PROF_ZONE(PROF_UI_DATA, ui_state = data_page(key));
         }
         // If no key is pressed, continue loop
         else if(key == NO_INPUT){
@@ -93,25 +224,32 @@ int main()
         // Else call appropriate function
         else {
             if(ui_state == UI_WELCOME){
-                ui_state = welcome_page(key);
+                PROF_ZONE(PROF_UI_WELCOME, ui_state = welcome_page(key));
             }
             else if(ui_state == UI_DATA){
-                ui_state = data_page(key);
+                PROF_ZONE(PROF_UI_DATA, ui_state = data_page(key));
             }
             else if(ui_state == UI_SETTINGS){
-                ui_state = settings_page(key);
+                PROF_ZONE(PROF_UI_SETTINGS, ui_state = settings_page(key));
             }
             else if(ui_state == UI_SETTING_BUZZER){
-                ui_state = buzzer_settings_page(key);
+                PROF_ZONE(PROF_UI_SETTINGS_BUZZER, ui_state = buzzer_settings_page(key));
             }
             else if(ui_state == UI_SETTINGS_WIFI){
-                ui_state = wifi_settings_page(key);
+                PROF_ZONE(PROF_UI_SETTINGS_WIFI, ui_state = wifi_settings_page(key));
 
             }
+            else if(ui_state == UI_DIAGNOSTICS){
+                ui_state = diagnostics_page(key);
+            }
             else{
                 ui_state = UI_WELCOME;
             }
         }
 
+        if(ui_state != previous_state){
+            TRACE_INSTANT(TRACE_PAGE, ui_state);
+        }
+
     }
 }
@@ -0,0 +1,240 @@
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "alarm.h"
+
+typedef struct{
+    bool active;
+    bool pending;
+
+    // Rule changed and must be evaluated on the next reading
+    bool recheck;
+
+    // Time the condition first held while pending
+    uint32_t since_ms;
+} AlarmRuleState;
+
+typedef struct{
+    bool has_sample;
+    uint32_t time_ms;
+
+    float value[METRICS];
+
+    // Change per minute between the two last readings
+    float rate[METRICS];
+
+    AlarmRuleState rule[ALARM_MAX_RULES];
+
+    enum alarm_severity severity;
+} AlarmStation;
+
+static struct AlarmState{
+    AlarmRule rules[ALARM_MAX_RULES];
+
+    // Rules are evaluated up to the highest used slot
+    uint8_t n_rules;
+
+    AlarmStation stations[MAX_STATIONS];
+} state;
+
+// Returns true if the rule condition holds. While active the
+// condition is relaxed by the hysteresis
+static bool _rule_condition_(const AlarmRule *rule, float value, float rate, bool active)
+{
+    float h = active ? rule->hysteresis : 0;
+
+    switch(rule->op){
+    case ALARM_ABOVE:
+        return value > rule->threshold - h;
+    case ALARM_BELOW:
+        return value < rule->threshold + h;
+    case ALARM_BAND:
+        return value < rule->threshold + h || value > rule->threshold_high - h;
+    case ALARM_RATE:
+        return fabsf(rate) > rule->threshold - h;
+    }
+
+    return false;
+}
+
+static void _update_n_rules_()
+{
+    state.n_rules = 0;
+
+    for(int i = 0; i < ALARM_MAX_RULES; i++){
+        if(state.rules[i].severity != ALARM_NONE){
+            state.n_rules = i + 1;
+        }
+    }
+}
+
+static enum alarm_severity _station_severity_(const AlarmStation *s)
+{
+    enum alarm_severity severity = ALARM_NONE;
+
+    for(int i = 0; i < state.n_rules; i++){
+        if(s->rule[i].active && state.rules[i].severity > severity){
+            severity = state.rules[i].severity;
+        }
+    }
+
+    return severity;
+}
+
+static void _reset_rule_state_(uint8_t slot)
+{
+    for(int i = 0; i < MAX_STATIONS; i++){
+        memset(&state.stations[i].rule[slot], 0, sizeof(AlarmRuleState));
+        state.stations[i].rule[slot].recheck = true;
+        state.stations[i].severity = _station_severity_(&state.stations[i]);
+    }
+}
+
+int alarm_set_rule(uint8_t slot, const AlarmRule *rule)
+{
+    if(slot >= ALARM_MAX_RULES || rule->metric >= METRICS || rule->op > ALARM_RATE ||
+       rule->severity > ALARM_CRITICAL || rule->hysteresis < 0){
+        return -1;
+    }
+
+    state.rules[slot] = *rule;
+    _update_n_rules_();
+    _reset_rule_state_(slot);
+
+    return 0;
+}
+
+void alarm_clear_rule(uint8_t slot)
+{
+    if(slot >= ALARM_MAX_RULES){
+        return;
+    }
+
+    memset(&state.rules[slot], 0, sizeof(AlarmRule));
+    _update_n_rules_();
+    _reset_rule_state_(slot);
+}
+
+enum alarm_severity alarm_update(uint8_t station, const WeatherStationData *data, uint32_t now_ms)
+{
+    if(station >= MAX_STATIONS){
+        return ALARM_NONE;
+    }
+
+    AlarmStation *s = &state.stations[station];
+
+    // Find metrics that changed since the last reading
+    uint32_t changed = 0;
+    uint32_t dt_ms = now_ms - s->time_ms;
+
+    for(int m = 0; m < METRICS; m++){
+        float value = metric_value(data, m);
+        float rate = 0;
+
+        if(s->has_sample && dt_ms > 0){
+            rate = (value - s->value[m]) * 60000.0f / dt_ms;
+        }
+
+        if(!s->has_sample || value != s->value[m] || rate != s->rate[m]){
+            changed |= (1 << m);
+        }
+
+        s->value[m] = value;
+        s->rate[m] = rate;
+    }
+
+    s->has_sample = true;
+    s->time_ms = now_ms;
+
+    // Evaluate rules for changed metrics and rules waiting for hold-off
+    for(int i = 0; i < state.n_rules; i++){
+        const AlarmRule *rule = &state.rules[i];
+        AlarmRuleState *rs = &s->rule[i];
+
+        if(rule->severity == ALARM_NONE){
+            continue;
+        }
+
+        if((changed & (1 << rule->metric)) || rs->pending || rs->recheck){
+            rs->recheck = false;
+
+            bool condition = _rule_condition_(rule, s->value[rule->metric], s->rate[rule->metric], rs->active);
+
+            if(!condition){
+                rs->active = false;
+                rs->pending = false;
+            }
+            else if(!rs->active){
+                if(!rs->pending){
+                    rs->pending = true;
+                    rs->since_ms = now_ms;
+                }
+
+                if(now_ms - rs->since_ms >= rule->holdoff_ms){
+                    rs->pending = false;
+                    rs->active = true;
+                }
+            }
+        }
+    }
+
+    s->severity = _station_severity_(s);
+
+    return s->severity;
+}
+
+enum alarm_severity alarm_tick(uint32_t now_ms)
+{
+    for(int i = 0; i < MAX_STATIONS; i++){
+        AlarmStation *s = &state.stations[i];
+
+        if(!s->has_sample){
+            continue;
+        }
+
+        // Start over with the next reading, without a rate across the gap
+        if(now_ms - s->time_ms >= ALARM_STALE_MS){
+            memset(s->rule, 0, sizeof(s->rule));
+            s->has_sample = false;
+            s->severity = ALARM_NONE;
+            continue;
+        }
+
+        // The condition held at the last reading and is taken to hold since
+        for(int r = 0; r < state.n_rules; r++){
+            AlarmRuleState *rs = &s->rule[r];
+
+            if(rs->pending && now_ms - rs->since_ms >= state.rules[r].holdoff_ms){
+                rs->pending = false;
+                rs->active = true;
+            }
+        }
+
+        s->severity = _station_severity_(s);
+    }
+
+    return alarm_severity();
+}
+
+enum alarm_severity alarm_severity()
+{
+    enum alarm_severity severity = ALARM_NONE;
+
+    for(int i = 0; i < MAX_STATIONS; i++){
+        if(state.stations[i].severity > severity){
+            severity = state.stations[i].severity;
+        }
+    }
+
+    return severity;
+}
+
+bool alarm_rule_active(uint8_t station, uint8_t slot)
+{
+    if(station >= MAX_STATIONS || slot >= ALARM_MAX_RULES){
+        return false;
+    }
+
+    return state.stations[station].rule[slot].active;
+}
@@ -0,0 +1,106 @@
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "server_interface.h"
+#include "metrics.h"
+
+/*
+Table driven alarm engine.
+
+Each rule watches one metric of a station reading. A rule is raised when
+its condition has held for the hold-off time and cleared only when the
+value has moved back past the threshold by the hysteresis, so a reading
+hovering at a limit does not toggle the alarm on every poll.
+
+Rules are evaluated per station in one pass over the rule table. Only
+rules whose metric changed since the last reading, and rules waiting for
+their hold-off to expire, are evaluated.
+
+Hold-off runs on the clock: alarm_tick raises a rule once its hold-off
+has passed even if no new reading arrived. A station that sends no reading
+for ALARM_STALE_MS drops its alarms, as its last values no longer say
+anything about the weather.
+
+The engine does not depend on the Pico SDK. Time is passed in by the caller.
+*/
+
+// Max number of rules in the table
+#define ALARM_MAX_RULES 16
+
+// Alarms of a station are cleared when its last reading is this old
+#define ALARM_STALE_MS (10 * 60 * 1000)
+
+enum alarm_op{
+    // value > threshold, cleared below threshold - hysteresis
+    ALARM_ABOVE = 0,
+    // value < threshold, cleared above threshold + hysteresis
+    ALARM_BELOW,
+    // value outside [threshold, threshold_high], cleared when
+    // inside [threshold + hysteresis, threshold_high - hysteresis]
+    ALARM_BAND,
+    // |change| per minute > threshold, cleared below threshold - hysteresis
+    ALARM_RATE
+};
+
+enum alarm_severity{
+    ALARM_NONE = 0,
+    ALARM_INFO,
+    ALARM_WARNING,
+    ALARM_CRITICAL
+};
+
+typedef struct{
+    uint8_t metric;     // enum weather_metric
+    uint8_t op;         // enum alarm_op
+    uint8_t severity;   // enum alarm_severity. ALARM_NONE disables the rule
+    float threshold;
+    float threshold_high; // Upper limit of ALARM_BAND
+    float hysteresis;
+    uint32_t holdoff_ms;
+} AlarmRule;
+
+/**
+ * @brief Set rule in slot. State of the rule is reset for all stations
+ *
+ * @return 0 on success, -1 if the slot or rule is invalid
+ */
+int alarm_set_rule(uint8_t slot, const AlarmRule *rule);
+
+/**
+ * @brief Disable rule in slot and clear its state
+ */
+void alarm_clear_rule(uint8_t slot);
+
+/**
+ * @brief Evaluate rules against a new reading from station
+ *
+ * @param now_ms Time of reading in milliseconds. Must not decrease
+ *
+ * @return Returns highest severity of the active rules for station
+ */
+enum alarm_severity alarm_update(uint8_t station, const WeatherStationData *data, uint32_t now_ms);
+
+/**
+ * @brief Advance hold-off and stale timers without a new reading.
+ * Call regularly, readings or not
+ *
+ * @param now_ms Current time in milliseconds, on the clock of alarm_update
+ *
+ * @return Returns highest severity of the active rules for all stations
+ */
+enum alarm_severity alarm_tick(uint32_t now_ms);
+
+/**
+ * @brief Highest severity of the active rules for all stations
+ */
+enum alarm_severity alarm_severity();
+
+/**
+ * @brief Returns true if rule in slot is raised for station
+ */
+bool alarm_rule_active(uint8_t station, uint8_t slot);
+
+#endif //ALARM_H
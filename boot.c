@@ -0,0 +1,123 @@
+#include "boot.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "server_interface.h"
+#include "userinterface.h"
+#include "kvstore.h"
+
+// Keys in the key-value store
+#define BOOT_KEY_READING "reading"
+#define BOOT_KEY_LIMITS "buzz_limits"
+
+// Minimum time between writes of new readings
+#define BOOT_CACHE_DATA_INTERVAL_MS (5 * 60 * 1000)
+
+// Buzzer limits by metric. set has a bit for each limit that is set
+typedef struct{
+    float value[METRICS];
+    uint32_t set;
+} BuzzerLimits;
+
+_Static_assert(METRICS <= 32, "BuzzerLimits.set has one bit per metric");
+
+static const char* boot_phase_names[BOOT_PHASES] = {
+    "stdio",
+    "display",
+    "keypad",
+    "cache",
+    "first_screen",
+    "wifi",
+    "wifi_connected",
+    "first_response"
+};
+
+static struct BootState{
+    uint64_t phase_us[BOOT_PHASES];
+
+    absolute_time_t next_data_write;
+    bool data_written;
+} state;
+
+bool boot_mark(enum boot_phase phase)
+{
+    if(state.phase_us[phase] != 0){
+        return false;
+    }
+
+    state.phase_us[phase] = time_us_64();
+    return true;
+}
+
+void boot_print_timing()
+{
+    for(int i = 0; i < BOOT_PHASES; i++){
+        if(state.phase_us[i] != 0){
+            printf("boot: %s %lu\n", boot_phase_names[i], (unsigned long)(state.phase_us[i] / 1000));
+        }
+    }
+}
+
+int boot_cache_restore()
+{
+    state.next_data_write = make_timeout_time_ms(BOOT_CACHE_DATA_INTERVAL_MS);
+
+    BuzzerLimits limits;
+    int size = kv_get(BOOT_KEY_LIMITS, &limits, sizeof(limits));
+
+    if(size == sizeof(BuzzerLimits)){
+        for(int i = 0; i < METRICS; i++){
+            if(limits.set & (1u << i)){
+                set_buzzer_limit(i, limits.value[i]);
+            }
+        }
+    }
+
+    WeatherStationData data;
+    if(kv_get(BOOT_KEY_READING, &data, sizeof(data)) != sizeof(data)){
+        printf("No cached reading found\n");
+        return -1;
+    }
+
+    restore_station_data(0, data);
+
+    printf("Cached reading restored\n");
+
+    return 0;
+}
+
+void boot_cache_update()
+{
+    // Buzzer limits are written as soon as they change.
+    // The store skips the write if nothing changed
+    BuzzerLimits limits = {0};
+
+    for(int i = 0; i < METRICS; i++){
+        if(is_buzzer_limit_set(i)){
+            limits.value[i] = get_buzzer_limit(i);
+            limits.set |= (1u << i);
+        }
+    }
+
+    kv_set(BOOT_KEY_LIMITS, &limits, sizeof(limits));
+
+    // Readings are written at most once per interval, except for
+    // the first reading after boot
+    if(state.data_written && get_absolute_time() < state.next_data_write){
+        return;
+    }
+
+    if(get_station_data_age_ms(0) < 0){
+        return;
+    }
+
+    WeatherStationData data = peek_station_data(0);
+    kv_set(BOOT_KEY_READING, &data, sizeof(data));
+
+    state.data_written = true;
+    state.next_data_write = make_timeout_time_ms(BOOT_CACHE_DATA_INTERVAL_MS);
+}
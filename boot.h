@@ -0,0 +1,57 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Instant-on boot support.
+
+The last reading and the buzzer limits are kept in the key-value store
+so they can be shown right after power on, before WiFi is up. Boot phases
+are timestamped so time to first useful screen can be tracked.
+*/
+
+enum boot_phase{
+    BOOT_STDIO = 0,
+    BOOT_DISPLAY,
+    BOOT_KEYPAD,
+    BOOT_CACHE,
+    BOOT_FIRST_SCREEN,
+    BOOT_WIFI,
+    BOOT_WIFI_CONNECTED,
+    BOOT_FIRST_RESPONSE,
+    BOOT_PHASES
+};
+
+/**
+ * @brief Record time since power on for boot phase. 
+ * Only the first mark of each phase is kept.
+ * 
+ * @return Returns true if this was the first mark of the phase
+ */
+bool boot_mark(enum boot_phase phase);
+
+/**
+ * @brief Print boot phase timestamps over stdio. 
+ * Each line has the format "boot: <phase> <ms>"
+ */
+void boot_print_timing();
+
+/**
+ * @brief Load cached reading and buzzer limits from flash
+ * and apply them to the server interface and UI. The reading is marked stale.
+ * The key-value store must be initialized first.
+ * 
+ * @return 0 if a valid cache was found, otherwise -1
+ */
+int boot_cache_restore();
+
+/**
+ * @brief Write reading and buzzer limits to flash if they changed.
+ * Changed limits are written right away while readings are written at most
+ * once every BOOT_CACHE_DATA_INTERVAL_MS to limit flash wear.
+ */
+void boot_cache_update();
+
+#endif //BOOT_H
@@ -1,10 +1,49 @@
 #include "buzzer.h"
+#include "trace.h"
 
 #include "pico/stdlib.h"
 #include "hardware/irq.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
 #include "pico/float.h"
 #include <stdio.h>
 
+typedef struct{
+    enum buzzer_note note;
+    uint16_t duration_ms;
+} BuzzerStep;
+
+typedef struct{
+    const BuzzerStep *steps;
+    uint8_t length;
+    bool repeat;
+} BuzzerPattern;
+
+static const BuzzerStep info_steps[] = {
+    {C, 100}
+};
+
+static const BuzzerStep warning_steps[] = {
+    {A, 200}, {REST, 800}
+};
+
+static const BuzzerStep critical_steps[] = {
+    {G, 100}, {REST, 50}, {G, 100}, {REST, 50}, {G, 100}, {REST, 400}
+};
+
+static const BuzzerStep melody_steps[] = {
+    {C, 120}, {E, 120}, {G, 120}, {REST, 60}, {E, 120}, {G, 300}
+};
+
+#define PATTERN(steps, repeat) {steps, sizeof(steps) / sizeof(BuzzerStep), repeat}
+
+static const BuzzerPattern patterns[BUZZER_PATTERNS] = {
+    [BUZZER_PATTERN_NONE] = {NULL, 0, false},
+    [BUZZER_PATTERN_INFO] = PATTERN(info_steps, false),
+    [BUZZER_PATTERN_WARNING] = PATTERN(warning_steps, true),
+    [BUZZER_PATTERN_CRITICAL] = PATTERN(critical_steps, true),
+    [BUZZER_PATTERN_MELODY] = PATTERN(melody_steps, false),
+};
 
 // PWM Channel and slice number variables
 static uint slice_num = 0;
@@ -12,23 +51,151 @@ static uint channel = 0;
 
 static uint8_t _buzzer_pin;
 
+static struct BuzzerState{
+    uint8_t volume;
+
+    // Last pattern requested by buzzer_play
+    enum buzzer_pattern requested;
+
+    // Pattern and step being played. Updated from the alarm callback
+    volatile enum buzzer_pattern playing;
+    volatile uint8_t step;
+
+    volatile alarm_id_t alarm;
+} state = {.volume = BUZZER_DEFAULT_VOLUME};
+
+
+// Output note on PWM. The wrap value is double buffered by the PWM
+// slice, so the note changes at the end of a period without glitches
+static void _buzzer_output_(enum buzzer_note note)
+{
+    if(note == REST){
+        pwm_set_chan_level(slice_num, channel, 0);
+        return;
+    }
+
+    pwm_set_wrap(slice_num, note);
+    pwm_set_chan_level(slice_num, channel, (uint32_t)note * state.volume / 200);
+}
+
+// Advance sequencer. Runs in the timer IRQ
+static int64_t _buzzer_alarm_callback_(alarm_id_t id, void *user_data)
+{
+    const BuzzerPattern *pattern = &patterns[state.playing];
+
+    uint8_t step = state.step + 1;
+
+    if(step >= pattern->length){
+        if(!pattern->repeat){
+            TRACE_INSTANT(TRACE_BUZZER, BUZZER_PATTERN_NONE);
+            _buzzer_output_(REST);
+            state.playing = BUZZER_PATTERN_NONE;
+            state.alarm = 0;
+            return 0;
+        }
+        step = 0;
+    }
+
+    state.step = step;
+    _buzzer_output_(pattern->steps[step].note);
+
+    // Negative value reschedules relative to the previous alarm time so
+    // the pattern does not drift
+    return -(int64_t)pattern->steps[step].duration_ms * 1000;
+}
+
+// Stop sequencer and silence output
+static void _buzzer_silence_()
+{
+    if(state.alarm > 0){
+        cancel_alarm(state.alarm);
+        state.alarm = 0;
+    }
+
+    _buzzer_output_(REST);
+    state.playing = BUZZER_PATTERN_NONE;
+}
 
 void init_buzzer(uint8_t buzzer_pin)
 {
-    _buzzer_pin = buzzer_pin; 
-    
-    // Set pin to output
-    gpio_init(buzzer_pin);
-    gpio_set_dir(buzzer_pin, true);
+    _buzzer_pin = buzzer_pin;
+
+    gpio_set_function(buzzer_pin, GPIO_FUNC_PWM);
 
+    slice_num = pwm_gpio_to_slice_num(buzzer_pin);
+    channel = pwm_gpio_to_channel(buzzer_pin);
+
+    // Count at PICO_W_FREQ in phase correct mode so the TOP values in
+    // enum buzzer_note give the note frequency
+    pwm_config config = pwm_get_default_config();
+    pwm_config_set_phase_correct(&config, true);
+    pwm_config_set_clkdiv(&config, (float)clock_get_hz(clk_sys) / PICO_W_FREQ);
+
+    // Start silent
+    pwm_init(slice_num, &config, false);
+    pwm_set_chan_level(slice_num, channel, 0);
+    pwm_set_enabled(slice_num, true);
 }
 
-void buzzer_put(bool start)
+void buzzer_play(enum buzzer_pattern pattern)
+{
+    if(pattern >= BUZZER_PATTERNS || pattern == state.requested){
+        return;
+    }
+
+    state.requested = pattern;
+
+    TRACE_INSTANT(TRACE_BUZZER, pattern);
+
+    // Stop current pattern before changing sequencer state
+    _buzzer_silence_();
+
+    state.playing = pattern;
+    state.step = 0;
+
+    if(pattern == BUZZER_PATTERN_NONE){
+        return;
+    }
+
+    _buzzer_output_(patterns[pattern].steps[0].note);
+
+    state.alarm = add_alarm_in_ms(patterns[pattern].steps[0].duration_ms, _buzzer_alarm_callback_, NULL, true);
+    if(state.alarm < 0){
+        printf("No free alarm for buzzer\n");
+        state.alarm = 0;
+        _buzzer_silence_();
+    }
+}
+
+bool buzzer_is_playing()
 {
-    gpio_put(_buzzer_pin, start);
+    return state.playing != BUZZER_PATTERN_NONE;
+}
 
+void buzzer_put(bool start)
+{
+    buzzer_play(start ? BUZZER_PATTERN_WARNING : BUZZER_PATTERN_NONE);
 }
 
 void buzzer_stop(){
-    gpio_put(_buzzer_pin, false);
-}
\ No newline at end of file
+    state.requested = BUZZER_PATTERN_NONE;
+    _buzzer_silence_();
+}
+
+void melody()
+{
+    // Always play, even if the melody was the last pattern
+    buzzer_stop();
+    buzzer_play(BUZZER_PATTERN_MELODY);
+}
+
+void set_note(enum buzzer_note note)
+{
+    buzzer_stop();
+    _buzzer_output_(note);
+}
+
+void buzzer_set_volume(uint8_t volume)
+{
+    state.volume = volume > 100 ? 100 : volume;
+}
@@ -27,6 +27,7 @@ TOP_G# = 7222
 
 */
 enum buzzer_note{
+    REST = 0,
     A = 15000,
     Bb = 12875,
     C = 11468,
@@ -40,11 +41,42 @@ enum buzzer_note{
     Gs = 7222
 };
 
+/*
+Patterns are played by a sequencer driven from a hardware alarm, so
+starting or stopping a pattern never blocks. Repeating patterns play
+until another pattern is started.
+*/
+enum buzzer_pattern{
+    BUZZER_PATTERN_NONE = 0,
+    BUZZER_PATTERN_INFO,        // Single short beep
+    BUZZER_PATTERN_WARNING,     // Slow repeating beep
+    BUZZER_PATTERN_CRITICAL,    // Fast repeating triple beep
+    BUZZER_PATTERN_MELODY,      // Introduction melody
+    BUZZER_PATTERNS
+};
+
+// Default volume in percent
+#define BUZZER_DEFAULT_VOLUME 100
+
 /**
- * @brief Set GPIO connected to buzzer as output (and enable PWM?)
+ * @brief Configure GPIO connected to buzzer for PWM output
  */
 void init_buzzer(uint8_t buzzer_pin);
 
+/**
+ * @brief Start playing pattern and return immediately. Nothing happens if the
+ * pattern is already the last requested one. BUZZER_PATTERN_NONE stops the buzzer.
+ */
+void buzzer_play(enum buzzer_pattern pattern);
+
+/**
+ * @brief Returns true while a pattern is playing
+ */
+bool buzzer_is_playing();
+
+/**
+ * @brief Start or stop the warning pattern
+ */
 void buzzer_put(bool start);
 
 void buzzer_stop();
@@ -54,10 +86,15 @@ void buzzer_stop();
  */
 void melody();
 
-void set_note(/*enum buzzer_note note*/);
-
-
+/**
+ * @brief Play note until the buzzer is stopped
+ */
+void set_note(enum buzzer_note note);
 
-void buzzer_set_volume();
+/**
+ * @brief Set volume in percent. Volume is set by the PWM duty cycle 
+ * with 100 % at 50 % duty cycle
+ */
+void buzzer_set_volume(uint8_t volume);
 
-#endif
\ No newline at end of file
+#endif
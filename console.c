@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "console.h"
+#include "boot.h"
+#include "wifi.h"
+#include "netstats.h"
+#include "profiler.h"
+#include "trace.h"
+#include "server_interface.h"
+
+typedef void (*ConsoleFunc)(const char *args);
+
+typedef struct{
+    const char *name;
+    const char *help;
+    ConsoleFunc func;
+} ConsoleCommand;
+
+static void _cmd_help_(const char *args);
+
+static void _cmd_boot_(const char *args)
+{
+    boot_print_timing();
+}
+
+static void _cmd_power_(const char *args)
+{
+    wifi_power_print_stats();
+}
+
+static void _cmd_net_(const char *args)
+{
+    net_stats_print();
+}
+
+#if BASESTATION_PEERS
+static void _cmd_peer_(const char *args)
+{
+    peer_print_stats();
+}
+#endif
+
+#if BASESTATION_PROFILE
+static void _cmd_prof_(const char *args)
+{
+    if(strcmp(args, "reset") == 0){
+        prof_reset();
+        printf("Profiler reset\n");
+        return;
+    }
+
+    prof_dump();
+}
+#endif
+
+#if BASESTATION_TRACE
+static void _cmd_trace_(const char *args)
+{
+    if(strcmp(args, "clear") == 0){
+        trace_clear();
+        printf("Trace cleared\n");
+        return;
+    }
+
+    trace_dump();
+}
+#endif
+
+static const ConsoleCommand commands[] = {
+    {"help", "List commands", _cmd_help_},
+    {"boot", "Print boot phase timing", _cmd_boot_},
+    {"power", "Print time spent in each radio power mode", _cmd_power_},
+    {"net", "Print lwIP heap, pool and traffic statistics", _cmd_net_},
+#if BASESTATION_PEERS
+    {"peer", "Print the peer role and shared reading counters", _cmd_peer_},
+#endif
+#if BASESTATION_PROFILE
+    {"prof", "Print profiler zones. 'prof reset' clears them", _cmd_prof_},
+#endif
+#if BASESTATION_TRACE
+    {"trace", "Dump event trace for tools/trace2json.py. 'trace clear' clears it", _cmd_trace_},
+#endif
+};
+
+#define N_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static struct ConsoleState{
+    char line[CONSOLE_LINE_LENGTH];
+    uint8_t length;
+} state;
+
+static void _cmd_help_(const char *args)
+{
+    for(int i = 0; i < N_COMMANDS; i++){
+        printf("%-8s %s\n", commands[i].name, commands[i].help);
+    }
+}
+
+static void _console_run_(char *line)
+{
+    // Split command name and arguments
+    char *args = strchr(line, ' ');
+    if(args != NULL){
+        *args++ = '\0';
+    }
+    else{
+        args = line + strlen(line);
+    }
+
+    if(line[0] == '\0'){
+        return;
+    }
+
+    for(int i = 0; i < N_COMMANDS; i++){
+        if(strcmp(line, commands[i].name) == 0){
+            commands[i].func(args);
+            return;
+        }
+    }
+
+    printf("Unknown command: %s\n", line);
+}
+
+void console_poll()
+{
+    int c;
+
+    while((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT){
+        if(c == '\r' || c == '\n'){
+            state.line[state.length] = '\0';
+            state.length = 0;
+
+            _console_run_(state.line);
+        }
+        else if(state.length < CONSOLE_LINE_LENGTH - 1){
+            state.line[state.length++] = c;
+        }
+    }
+}
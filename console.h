@@ -0,0 +1,19 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+/*
+Command console on USB stdio.
+
+Commands are read one line at a time. Type "help" for a list of commands.
+*/
+
+// Max length of a command line
+#define CONSOLE_LINE_LENGTH 64
+
+/**
+ * @brief Read available characters from stdio and run a command when a
+ * full line has been received. Never blocks. Should be called from the main loop.
+ */
+void console_poll();
+
+#endif //CONSOLE_H
@@ -1,4 +1,5 @@
 #include "display.h"
+#include "profiler.h"
 
 #include "pico/stdlib.h"
 #include "pico/time.h"
@@ -335,6 +336,8 @@ void _display_set_data_write_mode_(enum display_register_select register_select)
 
 void _display_write_(char data, enum display_register_select register_select)
 {
+    PROF_BEGIN(PROF_DISPLAY_WRITE);
+
     // Block until display controller is ready for instruction
     while(_display_read_busy_flag_()){}
 
@@ -359,6 +362,8 @@ void _display_write_(char data, enum display_register_select register_select)
 
     _display_stop_data_transfer_();
 
+    PROF_END(PROF_DISPLAY_WRITE);
+
     return;
 }
 
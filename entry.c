@@ -0,0 +1,111 @@
+#include <stdio.h>
+
+#include "entry.h"
+
+// Max digits in the field
+#define ENTRY_MAX_DIGITS 7
+
+static struct EntryState{
+    bool active;
+    bool invalid;
+
+    uint8_t decimals;
+    uint8_t width;
+    float min;
+    float max;
+
+    // Digits typed so far as an integer, scaled by 10^decimals
+    uint32_t digits;
+    uint8_t n_digits;
+} state;
+
+static uint32_t _scale_(uint8_t decimals)
+{
+    uint32_t scale = 1;
+    while(decimals--){
+        scale *= 10;
+    }
+    return scale;
+}
+
+void entry_start(uint8_t decimals, float min, float max)
+{
+    uint8_t width = decimals + 1;
+    for(float limit = 10; limit <= max && width < ENTRY_MAX_DIGITS; limit *= 10){
+        width++;
+    }
+
+    state = (struct EntryState){
+        .active = true,
+        .decimals = decimals,
+        .width = width,
+        .min = min,
+        .max = max
+    };
+}
+
+bool entry_active()
+{
+    return state.active;
+}
+
+enum entry_result entry_input(char key)
+{
+    if(!state.active){
+        return ENTRY_CANCELLED;
+    }
+
+    state.invalid = false;
+
+    if(key >= '0' && key <= '9'){
+        if(state.n_digits < state.width && !(state.n_digits == 0 && key == '0')){
+            state.digits = state.digits * 10 + (key - '0');
+            state.n_digits++;
+        }
+    }
+    else if(key == '*'){
+        if(state.n_digits == 0){
+            state.active = false;
+            return ENTRY_CANCELLED;
+        }
+
+        state.digits /= 10;
+        state.n_digits--;
+    }
+    else if(key == '#'){
+        float value = entry_value();
+
+        if(value < state.min || value > state.max){
+            state.invalid = true;
+            return ENTRY_EDITING;
+        }
+
+        state.active = false;
+        return ENTRY_DONE;
+    }
+
+    return ENTRY_EDITING;
+}
+
+float entry_value()
+{
+    return (float)state.digits / _scale_(state.decimals);
+}
+
+bool entry_invalid()
+{
+    return state.invalid;
+}
+
+void entry_format(char *buffer, size_t size)
+{
+    uint32_t scale = _scale_(state.decimals);
+
+    if(state.decimals == 0){
+        snprintf(buffer, size, "%lu", (unsigned long)state.digits);
+    }
+    else{
+        snprintf(buffer, size, "%lu.%0*lu", (unsigned long)(state.digits / scale),
+            state.decimals, (unsigned long)(state.digits % scale));
+    }
+}
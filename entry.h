@@ -0,0 +1,60 @@
+#ifndef ENTRY_H
+#define ENTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Numeric entry widget.
+
+The widget takes one key at a time from the page that owns it, so the
+main loop keeps polling the servers and evaluating alarms while a value
+is typed. Digits shift in from the right as on a calculator, so with one
+decimal typing 2, 5 gives 2.5. * deletes the last digit, or cancels when
+nothing is typed, and # accepts the value if it is within range.
+
+Only one value is entered at a time. The widget does not draw: the page
+shows entry_format and, after an out of range value, entry_invalid.
+*/
+
+enum entry_result{
+    ENTRY_EDITING = 0,
+    ENTRY_DONE,
+    ENTRY_CANCELLED
+};
+
+/**
+ * @brief Start entering a value. The field is wide enough for max
+ * with the given decimals
+ */
+void entry_start(uint8_t decimals, float min, float max);
+
+bool entry_active();
+
+/**
+ * @brief Handle a key while entry is active. Keys other than digits,
+ * * and # are ignored
+ *
+ * @return ENTRY_DONE once a value in range is accepted, ENTRY_CANCELLED
+ * if entry was cancelled, otherwise ENTRY_EDITING
+ */
+enum entry_result entry_input(char key);
+
+/**
+ * @brief Value typed so far
+ */
+float entry_value();
+
+/**
+ * @brief Returns true if the last # was rejected because the value is
+ * out of range. Cleared by the next key
+ */
+bool entry_invalid();
+
+/**
+ * @brief Write the value typed so far with its decimals
+ */
+void entry_format(char *buffer, size_t size);
+
+#endif //ENTRY_H
@@ -0,0 +1,410 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+
+#include "host.h"
+#include "display.h"
+#include "view.h"
+#include "keypad.h"
+#include "json.h"
+#include "alarm.h"
+#include "kvstore.h"
+#include "userinterface.h"
+#include "server_interface.h"
+#include "wifi.h"
+#include "localserver.h"
+
+/*
+Benchmarks of the hot paths on the simulated board.
+
+Usage: bench [results.json]
+
+Results are written as JSON for tools/bench_compare.py, which compares
+them against host/bench_baseline.json. Lower is better for every metric.
+
+Most metrics are simulated: cycles, GPIO accesses and display writes
+counted by the host shim. They only change when the code changes.
+Metrics marked host_timed are measured on the host CPU and depend on
+the machine, so they are compared with a wider threshold.
+*/
+
+// Repeats of host timed loops. The fastest repeat is reported
+#define BENCH_REPEATS 15
+
+// Real time between repeats. Shared hosts slow down in bursts, so the
+// repeats are spread over a few seconds for the fastest one to miss them
+#define BENCH_REPEAT_GAP_MS 250
+
+// Requests timed by the request latency benchmark
+#define BENCH_REQUESTS 10
+
+// Writes timed by the key-value store benchmark. Enough to wrap the
+// log around its sectors, so compactions are included
+#define BENCH_KV_WRITES 500
+
+// Length of the key storm and time between its key presses
+#define BENCH_STORM_MS 1000
+#define BENCH_STORM_KEY_MS 10
+
+static const char *payload =
+    "{\"temp\":21.5,\"humidity\":45.0,\"wind_speed\":3.2,\"wind_dir\":180.0,"
+    "\"pressure\":101.3,\"smoke\":0.0,\"ambient\":60.0}";
+
+static struct BenchState{
+    FILE *out;
+    int n_results;
+} state;
+
+typedef struct{
+    uint64_t cycles;
+    uint32_t gpio;
+    uint32_t display;
+} BenchCounters;
+
+static BenchCounters _counters_()
+{
+    return (BenchCounters){
+        .cycles = host_cycles(),
+        .gpio = host_gpio_accesses(),
+        .display = host_display_writes()
+    };
+}
+
+static uint64_t _host_ns_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// End a repeat that started at start, keep it if it was the fastest
+// and wait out the gap to the next one
+static void _keep_fastest_(uint64_t *best, uint64_t start)
+{
+    uint64_t elapsed = _host_ns_() - start;
+    if(elapsed < *best){
+        *best = elapsed;
+    }
+
+    struct timespec gap = {.tv_nsec = BENCH_REPEAT_GAP_MS * 1000000L};
+    nanosleep(&gap, NULL);
+}
+
+static void _result_(const char *bench, const char *metric, double value, bool host_timed)
+{
+    fprintf(state.out, "%s\n    {\"bench\": \"%s\", \"metric\": \"%s\", \"value\": %.1f, \"host_timed\": %s}",
+        state.n_results++ ? "," : "", bench, metric, value, host_timed ? "true" : "false");
+
+    printf("%-24s %-16s %12.1f%s\n", bench, metric, value, host_timed ? " (host)" : "");
+}
+
+// Report simulated cost per operation since start
+static void _result_counters_(const char *bench, BenchCounters start, uint32_t n)
+{
+    BenchCounters end = _counters_();
+
+    _result_(bench, "cycles", (double)(end.cycles - start.cycles) / n, false);
+    _result_(bench, "gpio_accesses", (double)(end.gpio - start.gpio) / n, false);
+
+    if(end.display != start.display){
+        _result_(bench, "display_writes", (double)(end.display - start.display) / n, false);
+    }
+}
+
+static void bench_json_parse()
+{
+    const uint32_t n = 20000;
+    char buffer[256];
+    uint64_t best = UINT64_MAX;
+
+    for(int r = 0; r < BENCH_REPEATS; r++){
+        uint64_t start = _host_ns_();
+
+        for(uint32_t i = 0; i < n; i++){
+            // The parser writes into the payload
+            strcpy(buffer, payload);
+            WeatherStationData data = parse_weatherstation_json(buffer);
+            __asm__ volatile("" : : "g"(&data) : "memory");
+        }
+
+        _keep_fastest_(&best, start);
+    }
+
+    _result_("json_parse", "ns", (double)best / n, true);
+}
+
+static void bench_display_character()
+{
+    const uint32_t n = 160;
+
+    display_clear();
+    BenchCounters start = _counters_();
+
+    for(uint32_t i = 0; i < n; i++){
+        display_print_character('A' + i % 26);
+    }
+
+    _result_counters_("display_character", start, n);
+}
+
+static void bench_keypad_scan()
+{
+    const uint32_t n = 1000;
+
+    host_keypad_press(0);
+    BenchCounters start = _counters_();
+
+    for(uint32_t i = 0; i < n; i++){
+        poll_keypad();
+    }
+
+    _result_counters_("keypad_scan", start, n);
+}
+
+static void bench_alarm_update()
+{
+    const uint32_t n = 20000;
+    uint64_t best = UINT64_MAX;
+
+    // One rule per metric
+    for(int i = 0; i < METRICS; i++){
+        AlarmRule rule = {.metric = i, .op = ALARM_ABOVE, .severity = ALARM_WARNING, .threshold = 50, .hysteresis = 1};
+        alarm_set_rule(i, &rule);
+    }
+
+    WeatherStationData data = {0};
+
+    for(int r = 0; r < BENCH_REPEATS; r++){
+        uint64_t start = _host_ns_();
+
+        for(uint32_t i = 0; i < n; i++){
+            // Every reading changes, so every rule is evaluated
+            data.temp = 40 + i % 20;
+            data.humidity = 30 + i % 40;
+            alarm_update(0, &data, (r * n + i) * 1000);
+        }
+
+        _keep_fastest_(&best, start);
+    }
+
+    for(int i = 0; i < METRICS; i++){
+        alarm_clear_rule(i);
+    }
+
+    _result_("alarm_update", "ns", (double)best / n, true);
+}
+
+static void bench_kv_get()
+{
+    const uint32_t n = 20000;
+    uint64_t best = UINT64_MAX;
+
+    // Lookups scan the index, so fill it as the firmware does
+    const char *keys[] = {"wifi_ssid", "wifi_pass", "buzz_limits", "reading", "alarm_rules"};
+    uint8_t value[64] = {0};
+
+    for(int i = 0; i < 5; i++){
+        kv_set(keys[i], value, sizeof(value));
+    }
+
+    for(int r = 0; r < BENCH_REPEATS; r++){
+        uint64_t start = _host_ns_();
+
+        for(uint32_t i = 0; i < n; i++){
+            kv_get(keys[i % 5], value, sizeof(value));
+            __asm__ volatile("" : : "g"(value) : "memory");
+        }
+
+        _keep_fastest_(&best, start);
+    }
+
+    _result_("kv_get", "ns", (double)best / n, true);
+}
+
+// Simulated flash time and operations per write, with compactions
+// spread over the writes
+static void bench_kv_set()
+{
+    uint8_t value[64] = {0};
+
+    uint64_t start_us = time_us_64();
+    uint32_t programs = host_flash_programs();
+    uint32_t erases = host_flash_erases();
+
+    for(uint32_t i = 0; i < BENCH_KV_WRITES; i++){
+        // Every write changes the value, so none is skipped
+        memcpy(value, &i, sizeof(i));
+        kv_set("reading", value, sizeof(value));
+    }
+
+    _result_("kv_set", "us", (double)(time_us_64() - start_us) / BENCH_KV_WRITES, false);
+    _result_("kv_set", "page_programs", (double)(host_flash_programs() - programs) / BENCH_KV_WRITES, false);
+    _result_("kv_set", "erases_per_1000", (double)(host_flash_erases() - erases) * 1000 / BENCH_KV_WRITES, false);
+}
+
+static void bench_page(const char *name, enum InterfaceState (*page)(enum Button), enum Button input)
+{
+    const uint32_t n = 20;
+
+    BenchCounters start = _counters_();
+
+    for(uint32_t i = 0; i < n; i++){
+        page(input);
+        view_flush();
+    }
+
+    _result_counters_(name, start, n);
+}
+
+static void bench_pages()
+{
+    WeatherStationData data = {
+        .temp = 21.5, .humidity = 45, .wind_spd = 3.2, .wind_dir = 180,
+        .pressure = 101.3, .smoke = 0, .ambient_light = 60
+    };
+    restore_station_data(0, data);
+
+    bench_page("data_page", data_page, NO_INPUT);
+    bench_page("settings_page", settings_page, INPUT_DOWN);
+    bench_page("buzzer_settings_page", buzzer_settings_page, INPUT_DOWN);
+    bench_page("diagnostics_page", diagnostics_page, INPUT_REFRESH);
+}
+
+static void _storm_press_(void *arg)
+{
+    host_keypad_press('8');
+}
+
+static void _storm_release_(void *arg)
+{
+    host_keypad_press(0);
+}
+
+// Keys pressed faster than frames are drawn, looping as the main loop
+// does. Redraws per second should stay at the frame rate, not the key rate
+static void bench_key_storm()
+{
+    uint64_t start_us = time_us_64();
+    uint32_t keys = 0;
+
+    for(uint32_t t = 0; t < BENCH_STORM_MS; t += BENCH_STORM_KEY_MS){
+        host_event_schedule(start_us + t * 1000, _storm_press_, NULL);
+        host_event_schedule(start_us + (t + BENCH_STORM_KEY_MS / 2) * 1000, _storm_release_, NULL);
+    }
+
+    data_page(NO_INPUT);
+    view_flush();
+
+    uint32_t renders = view_renders();
+    BenchCounters start = _counters_();
+
+    while(time_us_64() - start_us < BENCH_STORM_MS * 1000){
+        view_render();
+
+        char key = poll_keypad();
+        if(key != NO_INPUT){
+            data_page(key);
+            keys++;
+        }
+    }
+
+    double seconds = (double)(time_us_64() - start_us) / 1000000;
+
+    _result_("key_storm", "renders_per_s", (view_renders() - renders) / seconds, false);
+    _result_counters_("key_storm", start, keys);
+}
+
+// Time from request_last_data to the data event, polling as the main
+// loop does between keypad scans
+static void bench_request_latency()
+{
+    host_net_set_latency(20, 30, 50);
+
+    wifi_start_auto_connect();
+    while(wifi_poll() != WIFI_EVENT_CONNECTED){
+        sleep_ms(1);
+    }
+
+    uint64_t total_us = 0;
+
+    for(int i = 0; i < BENCH_REQUESTS; i++){
+        absolute_time_t start = get_absolute_time();
+
+        request_last_data();
+        while(server_poll() != SERVER_EVENT_DATA){
+            poll_keypad();
+        }
+
+        total_us += absolute_time_diff_us(start, get_absolute_time());
+    }
+
+    _result_("request_latency", "us", (double)total_us / BENCH_REQUESTS, false);
+}
+
+// Bytes a LAN client receives from the local server, for a full response
+// and for a conditional request once it has the current version
+static void bench_local_server()
+{
+    static char response[4096];
+    char request[160];
+
+    local_server_init();
+    local_server_poll();
+
+    int latest = host_net_local_request(LOCAL_SERVER_PORT, "GET /latest HTTP/1.1\r\n\r\n", response, sizeof(response));
+
+    char etag[24] = "";
+    const char *header = strstr(response, "ETag: ");
+    if(header != NULL){
+        sscanf(header, "ETag: %23s", etag);
+    }
+
+    snprintf(request, sizeof(request), "GET /latest HTTP/1.1\r\nIf-None-Match: %s\r\n\r\n", etag);
+    int not_modified = host_net_local_request(LOCAL_SERVER_PORT, request, response, sizeof(response));
+
+    int history = host_net_local_request(LOCAL_SERVER_PORT, "GET /history HTTP/1.1\r\n\r\n", response, sizeof(response));
+
+    _result_("local_server", "latest_bytes", latest, false);
+    _result_("local_server", "not_modified_bytes", not_modified, false);
+    _result_("local_server", "history_bytes", history, false);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "bench_results.json";
+
+    state.out = fopen(path, "w");
+    if(state.out == NULL){
+        perror(path);
+        return 1;
+    }
+
+    stdio_init_all();
+    init_display(host_board_display);
+    view_init();
+    init_keypad(host_board_keypad, host_board_key_matrix);
+    kv_init(&kv_flash_pico);
+    init_wifi();
+
+    fprintf(state.out, "{\n  \"results\": [");
+
+    bench_json_parse();
+    bench_display_character();
+    bench_keypad_scan();
+    bench_alarm_update();
+    bench_kv_get();
+    bench_kv_set();
+    bench_pages();
+    bench_key_storm();
+    bench_request_latency();
+    bench_local_server();
+
+    fprintf(state.out, "\n  ]\n}\n");
+    fclose(state.out);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+
+#include "host.h"
+
+// Console input queued by host_console_input
+#define HOST_CONSOLE_QUEUE 256
+
+// Wiring of the base station, as in BaseStation.c
+const struct DisplayPinConfig host_board_display = {
+    .RS_PIN = 2,
+    .RW_PIN = 3,
+    .EN_PIN = 4,
+    .DB0_PIN = 5,
+    .DB1_PIN = 6,
+    .DB2_PIN = 7,
+    .DB3_PIN = 8,
+    .DB4_PIN = 9,
+    .DB5_PIN = 10,
+    .DB6_PIN = 11,
+    .DB7_PIN = 12
+};
+
+const struct keypadPinConfig host_board_keypad = {
+    .COL0_PIN = 16,
+    .COL1_PIN = 17,
+    .COL2_PIN = 18,
+    .ROW0_PIN = 19,
+    .ROW1_PIN = 20,
+    .ROW2_PIN = 21,
+    .ROW3_PIN = 22
+};
+
+const char host_board_key_matrix[4][3] = {
+    {'1', '2', '3'},
+    {'4', '5', '6'},
+    {'7', '8', '9'},
+    {'*', '0', '#'}
+};
+
+static struct HostBoard{
+    bool initialized;
+
+    char console[HOST_CONSOLE_QUEUE];
+    size_t console_head;
+    size_t console_tail;
+} state;
+
+void host_board_init()
+{
+    if(state.initialized){
+        return;
+    }
+    state.initialized = true;
+
+    host_display_attach(host_board_display);
+    host_keypad_attach(host_board_keypad, host_board_key_matrix);
+
+    host_board_add_networks();
+
+    const char *seed = getenv("HOST_SEED");
+    if(seed != NULL){
+        host_rand_seed(strtoul(seed, NULL, 0));
+    }
+
+    const char *realtime = getenv("HOST_REALTIME");
+    if(realtime != NULL && strcmp(realtime, "0") != 0){
+        host_clock_set_realtime(true);
+    }
+}
+
+void host_board_add_networks()
+{
+    // The access point the firmware has default credentials for (see
+    // wifi.c), and an open one to join from the WiFi page
+    host_wifi_add_network("Chrillbob's Hotspot", "NotPassword", -55);
+    host_wifi_add_network("HostNet", "", -70);
+}
+
+void stdio_init_all(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    host_board_init();
+}
+
+void host_console_input(const char *text)
+{
+    while(*text != '\0' && (state.console_tail + 1) % HOST_CONSOLE_QUEUE != state.console_head){
+        state.console[state.console_tail] = *text++;
+        state.console_tail = (state.console_tail + 1) % HOST_CONSOLE_QUEUE;
+    }
+}
+
+int getchar_timeout_us(uint32_t timeout_us)
+{
+    if(state.console_head != state.console_tail){
+        char c = state.console[state.console_head];
+        state.console_head = (state.console_head + 1) % HOST_CONSOLE_QUEUE;
+        return c;
+    }
+
+    // Never wait for stdin, time only passes on the virtual clock
+    struct pollfd fd = {.fd = STDIN_FILENO, .events = POLLIN};
+    unsigned char c;
+
+    if(poll(&fd, 1, 0) == 1 && (fd.revents & POLLIN) && read(STDIN_FILENO, &c, 1) == 1){
+        return c;
+    }
+
+    return PICO_ERROR_TIMEOUT;
+}
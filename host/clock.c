@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "pico/rand.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+#include "host.h"
+
+// Max number of pending alarms and simulation events
+#define HOST_MAX_EVENTS 2048
+
+#define HOST_CYCLES_PER_US (HOST_SYS_CLOCK_HZ / 1000000)
+
+// SysTick is a 24 bit down counter
+#define HOST_SYSTICK_MASK 0x00FFFFFF
+
+typedef struct{
+    int id;
+    uint64_t at_us;
+
+    // Scheduling order, so events due at the same time run first come first
+    uint32_t order;
+
+    HostEventFn func;
+    void *arg;
+
+    // Set for events that run an alarm callback
+    alarm_callback_t alarm;
+} HostEvent;
+
+static struct HostClock{
+    // Processor cycles since start. Virtual time is derived from it
+    uint64_t cycles;
+
+    HostEvent events[HOST_MAX_EVENTS];
+    int next_id;
+    uint32_t next_order;
+
+    // No event is due before this time, so most charges skip the table
+    uint64_t next_at_us;
+
+    uint32_t rand;
+
+    // Virtual time is held back to the wall clock, see host_clock_set_realtime.
+    // Wall clock time at virtual time 0
+    bool realtime;
+    uint64_t wall_start_us;
+} state = {.next_id = 1, .next_at_us = UINT64_MAX, .rand = 0x2545f491};
+
+static systick_hw_t systick;
+systick_hw_t *systick_hw = &systick;
+
+static uint64_t _now_us_()
+{
+    return state.cycles / HOST_CYCLES_PER_US;
+}
+
+static void _set_cycles_(uint64_t cycles)
+{
+    state.cycles = cycles;
+
+    if(systick.csr & M0PLUS_SYST_CSR_ENABLE_BITS){
+        systick.cvr = (uint32_t)(0 - cycles) & HOST_SYSTICK_MASK;
+    }
+}
+
+static HostEvent *_find_event_(int id)
+{
+    for(int i = 0; i < HOST_MAX_EVENTS; i++){
+        if(state.events[i].id == id){
+            return &state.events[i];
+        }
+    }
+
+    return NULL;
+}
+
+static HostEvent *_add_event_(uint64_t at_us)
+{
+    HostEvent *event = _find_event_(0);
+
+    if(event == NULL){
+        printf("host: event table full\n");
+        return NULL;
+    }
+
+    *event = (HostEvent){
+        .id = state.next_id++,
+        .at_us = at_us,
+        .order = state.next_order++
+    };
+
+    if(at_us < state.next_at_us){
+        state.next_at_us = at_us;
+    }
+
+    return event;
+}
+
+// Earliest event due at or before until_us. Updates next_at_us
+static HostEvent *_next_event_(uint64_t until_us)
+{
+    HostEvent *next = NULL;
+    state.next_at_us = UINT64_MAX;
+
+    for(int i = 0; i < HOST_MAX_EVENTS; i++){
+        HostEvent *event = &state.events[i];
+
+        if(event->id == 0){
+            continue;
+        }
+
+        if(event->at_us < state.next_at_us){
+            state.next_at_us = event->at_us;
+        }
+
+        if(event->at_us > until_us){
+            continue;
+        }
+
+        if(next == NULL || event->at_us < next->at_us || (event->at_us == next->at_us && event->order < next->order)){
+            next = event;
+        }
+    }
+
+    return next;
+}
+
+static void _run_event_(HostEvent *event)
+{
+    HostEvent run = *event;
+
+    if(run.alarm == NULL){
+        event->id = 0;
+        run.func(run.arg);
+        return;
+    }
+
+    // Alarm callbacks return the delay to the next call, negative to
+    // reschedule relative to the previous target time
+    int64_t next = run.alarm(run.id, run.arg);
+
+    // Cancelled from its own callback
+    if(event->id != run.id){
+        return;
+    }
+
+    if(next == 0){
+        event->id = 0;
+        return;
+    }
+
+    event->at_us = next > 0 ? _now_us_() + next : run.at_us - next;
+    event->order = state.next_order++;
+
+    if(event->at_us < state.next_at_us){
+        state.next_at_us = event->at_us;
+    }
+}
+
+static uint64_t _wall_us_()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Wait until the wall clock reaches virtual time at_us
+static void _pace_(uint64_t at_us)
+{
+    if(!state.realtime){
+        return;
+    }
+
+    uint64_t wall_us = _wall_us_() - state.wall_start_us;
+
+    if(at_us > wall_us){
+        uint64_t wait_us = at_us - wall_us;
+        struct timespec wait = {.tv_sec = wait_us / 1000000, .tv_nsec = (wait_us % 1000000) * 1000};
+        nanosleep(&wait, NULL);
+    }
+}
+
+void host_clock_set_realtime(bool realtime)
+{
+    state.realtime = realtime;
+    state.wall_start_us = _wall_us_() - _now_us_();
+}
+
+void host_cycles_charge(uint64_t cycles)
+{
+    uint64_t until = state.cycles + cycles;
+
+    HostEvent *event;
+    while(state.next_at_us <= until / HOST_CYCLES_PER_US && (event = _next_event_(until / HOST_CYCLES_PER_US)) != NULL){
+        if(event->at_us * HOST_CYCLES_PER_US > state.cycles){
+            _pace_(event->at_us);
+            _set_cycles_(event->at_us * HOST_CYCLES_PER_US);
+        }
+        _run_event_(event);
+    }
+
+    _pace_(until / HOST_CYCLES_PER_US);
+    _set_cycles_(until);
+}
+
+uint64_t host_cycles()
+{
+    return state.cycles;
+}
+
+void host_time_advance_us(uint64_t us)
+{
+    host_cycles_charge(us * HOST_CYCLES_PER_US);
+}
+
+int host_event_schedule(uint64_t at_us, HostEventFn func, void *arg)
+{
+    HostEvent *event = _add_event_(at_us);
+
+    if(event == NULL){
+        return -1;
+    }
+
+    event->func = func;
+    event->arg = arg;
+
+    return event->id;
+}
+
+void host_event_cancel(int id)
+{
+    HostEvent *event = id > 0 ? _find_event_(id) : NULL;
+
+    if(event != NULL){
+        event->id = 0;
+    }
+}
+
+void host_rand_seed(uint32_t seed)
+{
+    state.rand = seed != 0 ? seed : 1;
+}
+
+uint32_t get_rand_32(void)
+{
+    // xorshift32
+    state.rand ^= state.rand << 13;
+    state.rand ^= state.rand >> 17;
+    state.rand ^= state.rand << 5;
+
+    return state.rand;
+}
+
+absolute_time_t get_absolute_time(void)
+{
+    return _now_us_();
+}
+
+uint64_t time_us_64(void)
+{
+    return _now_us_();
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)_now_us_();
+}
+
+void sleep_us(uint64_t us)
+{
+    host_time_advance_us(us);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    host_time_advance_us((uint64_t)ms * 1000);
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    HostEvent *event = _add_event_(_now_us_() + us);
+
+    if(event == NULL){
+        return -1;
+    }
+
+    event->alarm = callback;
+    event->arg = user_data;
+
+    return event->id;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    return add_alarm_in_us((uint64_t)ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+    HostEvent *event = alarm_id > 0 ? _find_event_(alarm_id) : NULL;
+
+    if(event == NULL || event->alarm == NULL){
+        return false;
+    }
+
+    event->id = 0;
+    return true;
+}
+
+uint get_core_num(void)
+{
+    return 0;
+}
@@ -0,0 +1,287 @@
+#include <string.h>
+
+#include "pico/cyw43_arch.h"
+
+#include "host.h"
+#include "host_internal.h"
+
+// Max number of simulated access points
+#define HOST_MAX_NETWORKS 16
+
+// Time from join to association, and from association to an address
+#define HOST_WIFI_JOIN_MS 300
+#define HOST_WIFI_DHCP_MS 200
+
+// Time between scan results
+#define HOST_WIFI_SCAN_RESULT_MS 50
+
+typedef struct{
+    char ssid[33];
+    char password[64];
+    int16_t rssi;
+    uint8_t bssid[6];
+    uint16_t channel;
+} HostNetwork;
+
+cyw43_t cyw43_state;
+
+static struct HostWifi{
+    HostNetwork networks[HOST_MAX_NETWORKS];
+    uint8_t n_networks;
+
+    // Link status of the station interface
+    int link;
+    bool has_address;
+    int8_t joined;
+    int join_event;
+
+    bool scan_active;
+    uint8_t scan_next;
+    void *scan_env;
+    int (*scan_cb)(void *, const cyw43_ev_scan_result_t *);
+
+    uint32_t pm;
+} state = {.joined = -1, .pm = CYW43_DEFAULT_PM};
+
+static void _set_link_(int link, bool has_address)
+{
+    bool was_up = state.link == CYW43_LINK_JOIN && state.has_address;
+
+    state.link = link;
+    state.has_address = has_address;
+
+    bool up = state.link == CYW43_LINK_JOIN && state.has_address;
+
+    struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+    if(up){
+        netif->flags |= NETIF_FLAG_LINK_UP;
+    }
+    else{
+        netif->flags &= ~NETIF_FLAG_LINK_UP;
+    }
+
+    if(up != was_up && netif->link_callback != NULL){
+        netif->link_callback(netif);
+    }
+}
+
+static void _dhcp_done_(void *arg)
+{
+    state.join_event = 0;
+    _set_link_(CYW43_LINK_JOIN, true);
+}
+
+static void _join_done_(void *arg)
+{
+    intptr_t result = (intptr_t)arg;
+
+    if(result != CYW43_LINK_JOIN){
+        state.join_event = 0;
+        state.joined = -1;
+        _set_link_(result, false);
+        return;
+    }
+
+    _set_link_(CYW43_LINK_JOIN, false);
+    state.join_event = host_event_schedule(time_us_64() + HOST_WIFI_DHCP_MS * 1000, _dhcp_done_, NULL);
+}
+
+static void _scan_result_(void *arg)
+{
+    if(!state.scan_active){
+        return;
+    }
+
+    if(state.scan_next >= state.n_networks){
+        state.scan_active = false;
+        return;
+    }
+
+    const HostNetwork *network = &state.networks[state.scan_next++];
+
+    cyw43_ev_scan_result_t result = {
+        .ssid_len = strlen(network->ssid),
+        .channel = network->channel,
+        .auth_mode = network->password[0] != '\0' ? CYW43_AUTH_WPA2_AES_PSK : CYW43_AUTH_OPEN,
+        .rssi = network->rssi
+    };
+    memcpy(result.ssid, network->ssid, result.ssid_len);
+    memcpy(result.bssid, network->bssid, sizeof(result.bssid));
+
+    state.scan_cb(state.scan_env, &result);
+
+    host_event_schedule(time_us_64() + HOST_WIFI_SCAN_RESULT_MS * 1000, _scan_result_, NULL);
+}
+
+int host_wifi_add_network(const char *ssid, const char *password, int16_t rssi)
+{
+    if(state.n_networks == HOST_MAX_NETWORKS){
+        return -1;
+    }
+
+    HostNetwork *network = &state.networks[state.n_networks];
+
+    *network = (HostNetwork){
+        .rssi = rssi,
+        .bssid = {0x02, 0x00, 0x00, 0x00, 0x00, state.n_networks},
+        .channel = 1 + state.n_networks % 11
+    };
+    strncpy(network->ssid, ssid, sizeof(network->ssid) - 1);
+    strncpy(network->password, password, sizeof(network->password) - 1);
+
+    state.n_networks++;
+
+    return 0;
+}
+
+void host_wifi_clear_networks()
+{
+    host_wifi_drop_link();
+    state.n_networks = 0;
+}
+
+void host_wifi_drop_link()
+{
+    host_event_cancel(state.join_event);
+    state.join_event = 0;
+    state.joined = -1;
+    _set_link_(CYW43_LINK_DOWN, false);
+}
+
+int cyw43_arch_init(void)
+{
+    return 0;
+}
+
+void cyw43_arch_deinit(void)
+{
+}
+
+void cyw43_arch_enable_sta_mode(void)
+{
+}
+
+// Network events only run while the virtual clock advances, so the
+// stack never runs concurrently with the caller
+void cyw43_arch_lwip_begin(void)
+{
+}
+
+void cyw43_arch_lwip_end(void)
+{
+}
+
+void cyw43_init(cyw43_t *self)
+{
+    struct netif *netif = &self->netif[CYW43_ITF_STA];
+
+    netif->input = host_netif_input;
+    netif->linkoutput = host_netif_linkoutput;
+}
+
+void cyw43_wifi_set_up(cyw43_t *self, int itf, bool up, uint32_t country)
+{
+}
+
+int cyw43_wifi_leave(cyw43_t *self, int itf)
+{
+    host_wifi_drop_link();
+    return 0;
+}
+
+int cyw43_wifi_join(cyw43_t *self, size_t ssid_len, const uint8_t *ssid, size_t key_len, const uint8_t *key,
+                    uint32_t auth_type, const uint8_t *bssid, uint32_t channel)
+{
+    host_wifi_drop_link();
+
+    intptr_t result = CYW43_LINK_NONET;
+
+    for(int i = 0; i < state.n_networks; i++){
+        const HostNetwork *network = &state.networks[i];
+
+        if(strlen(network->ssid) != ssid_len || memcmp(network->ssid, ssid, ssid_len) != 0){
+            continue;
+        }
+
+        if(strlen(network->password) != key_len || memcmp(network->password, key, key_len) != 0){
+            result = CYW43_LINK_BADAUTH;
+            break;
+        }
+
+        result = CYW43_LINK_JOIN;
+        state.joined = i;
+        break;
+    }
+
+    state.join_event = host_event_schedule(time_us_64() + HOST_WIFI_JOIN_MS * 1000, _join_done_, (void *)result);
+
+    return 0;
+}
+
+int cyw43_wifi_link_status(cyw43_t *self, int itf)
+{
+    return state.link;
+}
+
+int cyw43_tcpip_link_status(cyw43_t *self, int itf)
+{
+    if(state.link == CYW43_LINK_JOIN){
+        return state.has_address ? CYW43_LINK_UP : CYW43_LINK_NOIP;
+    }
+
+    return state.link;
+}
+
+int cyw43_wifi_scan(cyw43_t *self, cyw43_wifi_scan_options_t *opts, void *env,
+                    int (*result_cb)(void *, const cyw43_ev_scan_result_t *))
+{
+    if(state.scan_active){
+        return -1;
+    }
+
+    state.scan_active = true;
+    state.scan_next = 0;
+    state.scan_env = env;
+    state.scan_cb = result_cb;
+
+    host_event_schedule(time_us_64() + HOST_WIFI_SCAN_RESULT_MS * 1000, _scan_result_, NULL);
+
+    return 0;
+}
+
+bool cyw43_wifi_scan_active(cyw43_t *self)
+{
+    return state.scan_active;
+}
+
+int cyw43_wifi_pm(cyw43_t *self, uint32_t pm)
+{
+    state.pm = pm;
+    return 0;
+}
+
+int cyw43_wifi_get_pm(cyw43_t *self, uint32_t *pm)
+{
+    *pm = state.pm;
+    return 0;
+}
+
+int cyw43_wifi_get_rssi(cyw43_t *self, int32_t *rssi)
+{
+    if(state.joined < 0){
+        return -1;
+    }
+
+    *rssi = state.networks[state.joined].rssi;
+    return 0;
+}
+
+int cyw43_wifi_get_bssid(cyw43_t *self, uint8_t bssid[6])
+{
+    if(state.joined < 0){
+        return -1;
+    }
+
+    memcpy(bssid, state.networks[state.joined].bssid, 6);
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "host.h"
+
+// Display model. DDRAM is addressed the way display.c uses it, with the
+// second row 40 characters after the first
+#define HOST_DISPLAY_COLUMNS 16
+#define HOST_DISPLAY_ROW_LENGTH 40
+#define HOST_DISPLAY_DDRAM_SIZE 80
+
+static struct HostDisplay{
+    bool attached;
+    struct DisplayPinConfig pins;
+    uint8_t data_pins[8];
+
+    char ddram[HOST_DISPLAY_DDRAM_SIZE];
+    uint8_t address;
+    bool increment;
+
+    uint32_t writes;
+
+    // FNV-1a hash of every write, RS as the top bit
+    uint32_t hash;
+
+    char row[2][HOST_DISPLAY_COLUMNS + 1];
+} display = {.hash = 2166136261u};
+
+static struct HostKeypad{
+    bool attached;
+    uint8_t row_pins[4];
+    uint8_t col_pins[3];
+    char key_matrix[4][3];
+
+    // Key held down, 0 if none
+    char key;
+} keypad;
+
+static uint8_t _display_bus_(uint32_t outputs)
+{
+    uint8_t data = 0;
+
+    for(int i = 0; i < 8; i++){
+        data |= ((outputs >> display.data_pins[i]) & 1) << i;
+    }
+
+    return data;
+}
+
+static void _display_instruction_(uint8_t data)
+{
+    if(data & 0x80){
+        display.address = (data & 0x7f) % HOST_DISPLAY_DDRAM_SIZE;
+    }
+    else if(data & 0x60){
+        // CGRAM and function set are not modelled
+    }
+    else if(data & 0x10){
+        // Cursor or display shift
+        bool right = data & 0x04;
+        display.address = (display.address + (right ? 1 : HOST_DISPLAY_DDRAM_SIZE - 1)) % HOST_DISPLAY_DDRAM_SIZE;
+    }
+    else if(data & 0x08){
+        // Display on/off control is not modelled
+    }
+    else if(data & 0x04){
+        display.increment = data & 0x02;
+    }
+    else if(data & 0x02){
+        display.address = 0;
+    }
+    else if(data & 0x01){
+        memset(display.ddram, ' ', sizeof(display.ddram));
+        display.address = 0;
+        display.increment = true;
+    }
+}
+
+static void _display_data_(uint8_t data)
+{
+    display.ddram[display.address] = data;
+    display.address = (display.address + (display.increment ? 1 : HOST_DISPLAY_DDRAM_SIZE - 1)) % HOST_DISPLAY_DDRAM_SIZE;
+}
+
+// The controller latches the bus on the falling edge of EN
+static void _display_changed_(uint32_t previous, uint32_t outputs)
+{
+    uint32_t en = 1u << display.pins.EN_PIN;
+
+    if(!(previous & en) || (outputs & en) || (outputs & (1u << display.pins.RW_PIN))){
+        return;
+    }
+
+    display.writes++;
+
+    uint8_t data = _display_bus_(outputs);
+    bool rs = outputs & (1u << display.pins.RS_PIN);
+
+    display.hash = (display.hash ^ (rs << 8 | data)) * 16777619u;
+
+    if(rs){
+        _display_data_(data);
+    }
+    else{
+        _display_instruction_(data);
+    }
+}
+
+// Reading the instruction register returns the address counter. The
+// model is never busy
+static uint32_t _display_input_(uint32_t outputs, uint32_t output_mask)
+{
+    if(!(outputs & (1u << display.pins.EN_PIN)) || !(outputs & (1u << display.pins.RW_PIN))){
+        return 0;
+    }
+
+    uint8_t data = outputs & (1u << display.pins.RS_PIN) ? display.ddram[display.address] : display.address & 0x7f;
+
+    uint32_t levels = 0;
+    for(int i = 0; i < 8; i++){
+        levels |= (uint32_t)((data >> i) & 1) << display.data_pins[i];
+    }
+
+    return levels;
+}
+
+static const HostGpioDevice display_device = {
+    .input = _display_input_,
+    .changed = _display_changed_
+};
+
+void host_display_attach(struct DisplayPinConfig config)
+{
+    display.pins = config;
+
+    const uint8_t data_pins[8] = {
+        config.DB0_PIN, config.DB1_PIN, config.DB2_PIN, config.DB3_PIN,
+        config.DB4_PIN, config.DB5_PIN, config.DB6_PIN, config.DB7_PIN
+    };
+    memcpy(display.data_pins, data_pins, sizeof(data_pins));
+
+    memset(display.ddram, ' ', sizeof(display.ddram));
+    display.address = 0;
+    display.increment = true;
+
+    if(!display.attached){
+        display.attached = true;
+        host_gpio_attach(&display_device);
+    }
+}
+
+const char *host_display_row(uint8_t row)
+{
+    row = row % 2;
+
+    memcpy(display.row[row], &display.ddram[row * HOST_DISPLAY_ROW_LENGTH], HOST_DISPLAY_COLUMNS);
+    display.row[row][HOST_DISPLAY_COLUMNS] = '\0';
+
+    return display.row[row];
+}
+
+uint32_t host_display_writes()
+{
+    return display.writes;
+}
+
+uint32_t host_display_hash()
+{
+    return display.hash;
+}
+
+// A held key connects its column to its row, so the row reads high
+// while the column is driven high
+static uint32_t _keypad_input_(uint32_t outputs, uint32_t output_mask)
+{
+    if(keypad.key == 0){
+        return 0;
+    }
+
+    for(int row = 0; row < 4; row++){
+        for(int col = 0; col < 3; col++){
+            if(keypad.key_matrix[row][col] == keypad.key && (outputs & (1u << keypad.col_pins[col]))){
+                return 1u << keypad.row_pins[row];
+            }
+        }
+    }
+
+    return 0;
+}
+
+static const HostGpioDevice keypad_device = {
+    .input = _keypad_input_
+};
+
+void host_keypad_attach(struct keypadPinConfig config, const char key_matrix[4][3])
+{
+    const uint8_t row_pins[4] = {config.ROW0_PIN, config.ROW1_PIN, config.ROW2_PIN, config.ROW3_PIN};
+    const uint8_t col_pins[3] = {config.COL0_PIN, config.COL1_PIN, config.COL2_PIN};
+
+    memcpy(keypad.row_pins, row_pins, sizeof(row_pins));
+    memcpy(keypad.col_pins, col_pins, sizeof(col_pins));
+    memcpy(keypad.key_matrix, key_matrix, sizeof(keypad.key_matrix));
+    keypad.key = 0;
+
+    if(!keypad.attached){
+        keypad.attached = true;
+        host_gpio_attach(&keypad_device);
+    }
+}
+
+void host_keypad_press(char key)
+{
+    keypad.key = key;
+}
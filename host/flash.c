@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+#include "host.h"
+
+// Typical sector erase and page program times of the W25Q16JV on the Pico W
+#define HOST_FLASH_ERASE_US 45000
+#define HOST_FLASH_PROGRAM_US 400
+
+uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+
+static struct HostFlash{
+    uint32_t erases;
+    uint32_t programs;
+
+    // Operations left before the power cut, when one is set
+    bool cut_set;
+    uint32_t cut_after;
+    bool power_lost;
+} state;
+
+// Flash starts erased, as a new board would
+__attribute__((constructor)) static void _flash_init_()
+{
+    memset(host_flash, 0xff, sizeof(host_flash));
+}
+
+void host_flash_reset()
+{
+    memset(host_flash, 0xff, sizeof(host_flash));
+}
+
+void host_flash_cut_after(uint32_t operations)
+{
+    state.cut_set = true;
+    state.cut_after = operations;
+    state.power_lost = false;
+}
+
+void host_flash_power_on()
+{
+    state.cut_set = false;
+    state.power_lost = false;
+}
+
+bool host_flash_power_lost()
+{
+    return state.power_lost;
+}
+
+// Returns how many bytes of an operation on count bytes are done before
+// the power cut. The operation at the cut is torn halfway
+static size_t _powered_bytes_(size_t count)
+{
+    if(state.power_lost){
+        return 0;
+    }
+
+    if(!state.cut_set){
+        return count;
+    }
+
+    if(state.cut_after > 0){
+        state.cut_after--;
+        return count;
+    }
+
+    state.power_lost = true;
+    return count / 2;
+}
+
+uint32_t host_flash_erases()
+{
+    return state.erases;
+}
+
+uint32_t host_flash_programs()
+{
+    return state.programs;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if(flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES){
+        printf("host: unaligned flash erase at %lu\n", (unsigned long)flash_offs);
+        return;
+    }
+
+    memset(&host_flash[flash_offs], 0xff, _powered_bytes_(count));
+    state.erases += count / FLASH_SECTOR_SIZE;
+    host_time_advance_us(count / FLASH_SECTOR_SIZE * HOST_FLASH_ERASE_US);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if(flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES){
+        printf("host: unaligned flash program at %lu\n", (unsigned long)flash_offs);
+        return;
+    }
+
+    // Programming can only clear bits
+    size_t powered = _powered_bytes_(count);
+    for(size_t i = 0; i < powered; i++){
+        host_flash[flash_offs + i] &= data[i];
+    }
+    state.programs += count / FLASH_PAGE_SIZE;
+    host_time_advance_us(count / FLASH_PAGE_SIZE * HOST_FLASH_PROGRAM_US);
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms)
+{
+    func(param);
+    return PICO_OK;
+}
@@ -0,0 +1,580 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+#include "pico/rand.h"
+
+#include "host.h"
+#include "kvstore.h"
+#include "netstats.h"
+#include "server_interface.h"
+#include "wifi.h"
+
+/*
+Fleet load simulator.
+
+Usage: fleet [options]
+
+Runs many base stations against one stand-in weather server on the
+virtual clock. Every base station runs the real server_interface.c and
+the polling policy of the main loop: request as soon as it is up, then
+every server_next_poll_ms. The module state of each base station is
+swapped in before it runs, and before its network callbacks run.
+
+Options:
+    -n N                 base stations (default 100)
+    -t SECONDS           simulated time (default 600)
+    --boot-spread MS     base stations boot at random times in this
+                         window (default: the poll interval)
+    --outage START:LEN   server outage in seconds, 0:0 for none
+                         (default 120:60)
+    --outage-mode MODE   refuse: connections are refused
+                         hang: connections are accepted, never answered
+    --latency MS         server response time (default 50)
+    --interval MS        ServerPolicy: poll interval
+    --jitter MS          ServerPolicy: poll jitter
+    --retries N          ServerPolicy: max retries
+    --backoff MIN:MAX    ServerPolicy: retry backoff in ms
+    --seed N             random seed
+    --timeline FILE      write per second load as CSV
+    -v                   show the output of the base stations
+
+Herd synchronisation is the phase coherence R of request arrivals over
+the poll interval: 0 when arrivals are spread evenly over the interval,
+1 when all base stations poll in lockstep.
+*/
+
+// Max number of simulated base stations
+#define FLEET_MAX_INSTANCES 1000
+
+// Time between main loop passes of a base station
+#define FLEET_TICK_MS 10
+
+// Time between staleness samples of every base station
+#define FLEET_SAMPLE_MS 1000
+
+// Length of the windows synchronisation is measured over
+#define FLEET_WINDOW_MS 60000
+
+typedef struct{
+    uint32_t boot_ms;
+    uint32_t next_request_ms;
+    uint32_t wake_ms;
+    bool booted;
+} FleetInstance;
+
+typedef struct{
+    uint32_t arrivals;
+    uint32_t answered;
+    uint32_t rejected;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+} FleetSecond;
+
+typedef struct{
+    uint32_t *values;
+    uint32_t n;
+    uint32_t size;
+} FleetSamples;
+
+static struct FleetState{
+    // Options
+    uint32_t n_instances;
+    uint32_t duration_ms;
+    uint32_t boot_spread_ms;
+    uint32_t outage_start_ms;
+    uint32_t outage_end_ms;
+    bool outage_hang;
+    uint32_t latency_ms;
+    uint32_t seed;
+    const char *timeline_path;
+    bool verbose;
+    ServerPolicy policy;
+
+    FleetInstance instances[FLEET_MAX_INSTANCES];
+
+    // Module state of every base station, and the one swapped in
+    uint8_t *server_states;
+    void *server_live;
+    size_t server_size;
+    int loaded;
+
+    // Virtual time the fleet started
+    uint64_t start_us;
+
+    FleetSecond *seconds;
+    FleetSamples arrivals;
+    FleetSamples staleness;
+    FleetSamples staleness_recovery;
+    uint32_t no_data_samples;
+
+    FILE *report;
+} state = {
+    .n_instances = 100,
+    .duration_ms = 600000,
+    .boot_spread_ms = UINT32_MAX,
+    .outage_start_ms = 120000,
+    .outage_end_ms = 180000,
+    .latency_ms = 50,
+    .seed = 1,
+    .loaded = -1
+};
+
+static const char *payload =
+    "{\"temp\":21.5,\"humidity\":45.0,\"wind_speed\":3.2,\"wind_dir\":180.0,"
+    "\"pressure\":101.3,\"smoke\":0.0,\"ambient\":60.0}";
+
+static uint32_t _now_ms_()
+{
+    return (time_us_64() - state.start_us) / 1000;
+}
+
+static void _add_sample_(FleetSamples *samples, uint32_t value)
+{
+    if(samples->n == samples->size){
+        samples->size = samples->size ? samples->size * 2 : 1024;
+        samples->values = realloc(samples->values, samples->size * sizeof(uint32_t));
+    }
+
+    samples->values[samples->n++] = value;
+}
+
+static int _compare_(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t _percentile_(const FleetSamples *samples, uint32_t percent)
+{
+    if(samples->n == 0){
+        return 0;
+    }
+
+    return samples->values[(uint64_t)(samples->n - 1) * percent / 100];
+}
+
+// Swap the module state of instance in. Also called by the simulated
+// stack before the callbacks of an instance run
+static void _switch_(int instance)
+{
+    if(instance == state.loaded){
+        return;
+    }
+
+    if(state.loaded >= 0){
+        memcpy(state.server_states + state.loaded * state.server_size, state.server_live, state.server_size);
+    }
+
+    memcpy(state.server_live, state.server_states + instance * state.server_size, state.server_size);
+    state.loaded = instance;
+
+    host_net_set_owner(instance);
+}
+
+static bool _in_outage_(uint32_t time_ms)
+{
+    return time_ms >= state.outage_start_ms && time_ms < state.outage_end_ms;
+}
+
+// The stand-in weather server
+static int _server_(const char *uri, char *body, size_t size)
+{
+    uint32_t now_ms = _now_ms_();
+    FleetSecond *second = &state.seconds[now_ms / 1000];
+
+    second->arrivals++;
+    _add_sample_(&state.arrivals, now_ms);
+
+    if(_in_outage_(now_ms)){
+        second->rejected++;
+        return state.outage_hang ? 0 : -1;
+    }
+
+    second->answered++;
+    snprintf(body, size, "%s", payload);
+
+    return 200;
+}
+
+// One pass of the main loop of instance
+static void _step_(int instance, uint32_t now_ms)
+{
+    FleetInstance *fleet_instance = &state.instances[instance];
+
+    _switch_(instance);
+
+    if(!fleet_instance->booted){
+        fleet_instance->booted = true;
+        fleet_instance->next_request_ms = now_ms;
+        server_warm_dns();
+    }
+
+    if(now_ms >= fleet_instance->next_request_ms){
+        request_last_data();
+        fleet_instance->next_request_ms = now_ms + server_next_poll_ms();
+    }
+
+    server_poll();
+    server_refresh_dns();
+
+    // Idle base stations sleep until their next request
+    enum request_state request = get_request_state(0);
+
+    if(request >= REQUEST_RESOLVING && request <= REQUEST_FAILED && request != REQUEST_DONE){
+        fleet_instance->wake_ms = now_ms + FLEET_TICK_MS;
+    }
+    else{
+        fleet_instance->wake_ms = fleet_instance->next_request_ms;
+    }
+}
+
+static void _sample_staleness_(uint32_t now_ms)
+{
+    bool recovery = state.outage_end_ms > state.outage_start_ms
+                 && now_ms >= state.outage_end_ms && now_ms < state.outage_end_ms + FLEET_WINDOW_MS;
+
+    for(int i = 0; i < state.n_instances; i++){
+        if(!state.instances[i].booted){
+            continue;
+        }
+
+        _switch_(i);
+        int32_t age_ms = get_station_data_age_ms(0);
+
+        if(age_ms < 0){
+            state.no_data_samples++;
+            continue;
+        }
+
+        _add_sample_(&state.staleness, age_ms);
+
+        if(recovery){
+            _add_sample_(&state.staleness_recovery, age_ms);
+        }
+    }
+}
+
+// Phase coherence of the arrivals in [from_ms, to_ms) over the poll interval
+static double _coherence_(uint32_t from_ms, uint32_t to_ms, uint32_t *peak)
+{
+    double x = 0;
+    double y = 0;
+    uint32_t n = 0;
+
+    for(uint32_t i = 0; i < state.arrivals.n; i++){
+        uint32_t time_ms = state.arrivals.values[i];
+
+        if(time_ms < from_ms || time_ms >= to_ms){
+            continue;
+        }
+
+        double phase = 2 * M_PI * (time_ms % state.policy.poll_interval_ms) / state.policy.poll_interval_ms;
+        x += cos(phase);
+        y += sin(phase);
+        n++;
+    }
+
+    *peak = 0;
+    for(uint32_t s = from_ms / 1000; s < to_ms / 1000 && s < state.duration_ms / 1000; s++){
+        if(state.seconds[s].arrivals > *peak){
+            *peak = state.seconds[s].arrivals;
+        }
+    }
+
+    return n > 0 ? sqrt(x * x + y * y) / n : 0;
+}
+
+static void _print_window_(const char *name, uint32_t from_ms, uint32_t to_ms)
+{
+    if(to_ms > state.duration_ms){
+        to_ms = state.duration_ms;
+    }
+
+    if(from_ms >= to_ms){
+        return;
+    }
+
+    uint32_t peak;
+    double coherence = _coherence_(from_ms, to_ms, &peak);
+
+    fprintf(state.report, "  %-16s %4lu-%4lu s   R %.2f   peak %lu/s\n", name,
+        (unsigned long)(from_ms / 1000), (unsigned long)(to_ms / 1000), coherence, (unsigned long)peak);
+}
+
+static void _print_staleness_(const char *name, FleetSamples *samples)
+{
+    if(samples->n == 0){
+        return;
+    }
+
+    qsort(samples->values, samples->n, sizeof(uint32_t), _compare_);
+
+    fprintf(state.report, "  %-16s %8lu %8lu %8lu %8lu\n", name,
+        (unsigned long)_percentile_(samples, 50), (unsigned long)_percentile_(samples, 90),
+        (unsigned long)_percentile_(samples, 99), (unsigned long)samples->values[samples->n - 1]);
+}
+
+static void _report_()
+{
+    uint32_t seconds = state.duration_ms / 1000;
+    uint64_t arrivals = 0, answered = 0, rejected = 0, bytes_in = 0, bytes_out = 0;
+    uint32_t peak = 0;
+
+    for(uint32_t s = 0; s < seconds; s++){
+        arrivals += state.seconds[s].arrivals;
+        answered += state.seconds[s].answered;
+        rejected += state.seconds[s].rejected;
+        bytes_in += state.seconds[s].bytes_in;
+        bytes_out += state.seconds[s].bytes_out;
+
+        if(state.seconds[s].arrivals > peak){
+            peak = state.seconds[s].arrivals;
+        }
+    }
+
+    ServerStats total = {0};
+    for(int i = 0; i < state.n_instances; i++){
+        _switch_(i);
+        ServerStats stats = get_server_stats();
+
+        total.requests += stats.requests;
+        total.done += stats.done;
+        total.failed += stats.failed;
+        total.retries += stats.retries;
+        total.timeouts += stats.timeouts;
+    }
+
+    FILE *out = state.report;
+
+    fprintf(out, "Fleet: %lu base stations, %lu s, poll %lu ms + %lu ms jitter, %u retries, backoff %lu-%lu ms\n",
+        (unsigned long)state.n_instances, (unsigned long)seconds, (unsigned long)state.policy.poll_interval_ms,
+        (unsigned long)state.policy.poll_jitter_ms, state.policy.max_retries,
+        (unsigned long)state.policy.backoff_min_ms, (unsigned long)state.policy.backoff_max_ms);
+
+    if(state.outage_end_ms > state.outage_start_ms){
+        fprintf(out, "Outage: %lu-%lu s, %s\n", (unsigned long)(state.outage_start_ms / 1000),
+            (unsigned long)(state.outage_end_ms / 1000), state.outage_hang ? "connections hang" : "connections refused");
+    }
+
+    fprintf(out, "\nServer load\n");
+    fprintf(out, "  requests         %8llu   %.1f/s mean, %lu/s peak\n", (unsigned long long)arrivals,
+        (double)arrivals / seconds, (unsigned long)peak);
+    fprintf(out, "  answered         %8llu\n", (unsigned long long)answered);
+    fprintf(out, "  rejected         %8llu\n", (unsigned long long)rejected);
+    fprintf(out, "  bytes to server  %8llu   %.0f/s\n", (unsigned long long)bytes_out, (double)bytes_out / seconds);
+    fprintf(out, "  bytes to fleet   %8llu   %.0f/s\n", (unsigned long long)bytes_in, (double)bytes_in / seconds);
+
+    fprintf(out, "\nHerd synchronisation (R: 0 spread out, 1 lockstep)\n");
+    if(state.outage_end_ms > state.outage_start_ms){
+        uint32_t before_ms = state.outage_start_ms > FLEET_WINDOW_MS ? state.outage_start_ms - FLEET_WINDOW_MS : 0;
+
+        _print_window_("before outage", before_ms, state.outage_start_ms);
+        _print_window_("after recovery", state.outage_end_ms, state.outage_end_ms + FLEET_WINDOW_MS);
+    }
+    _print_window_("end of run", state.duration_ms > FLEET_WINDOW_MS ? state.duration_ms - FLEET_WINDOW_MS : 0, state.duration_ms);
+
+    fprintf(out, "\nData staleness (ms)        p50      p90      p99      max\n");
+    _print_staleness_("whole run", &state.staleness);
+    _print_staleness_("after recovery", &state.staleness_recovery);
+    if(state.no_data_samples > 0){
+        fprintf(out, "  %lu samples without data\n", (unsigned long)state.no_data_samples);
+    }
+
+    fprintf(out, "\nBase stations\n");
+    fprintf(out, "  attempts %lu, done %lu, failed %lu, retries %lu, timeouts %lu\n",
+        (unsigned long)total.requests, (unsigned long)total.done, (unsigned long)total.failed,
+        (unsigned long)total.retries, (unsigned long)total.timeouts);
+}
+
+static int _write_timeline_()
+{
+    FILE *file = fopen(state.timeline_path, "w");
+    if(file == NULL){
+        perror(state.timeline_path);
+        return -1;
+    }
+
+    fprintf(file, "second,requests,answered,rejected,bytes_to_server,bytes_to_fleet\n");
+
+    for(uint32_t s = 0; s < state.duration_ms / 1000; s++){
+        const FleetSecond *second = &state.seconds[s];
+
+        fprintf(file, "%lu,%lu,%lu,%lu,%lu,%lu\n", (unsigned long)s, (unsigned long)second->arrivals,
+            (unsigned long)second->answered, (unsigned long)second->rejected,
+            (unsigned long)second->bytes_out, (unsigned long)second->bytes_in);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int _usage_()
+{
+    fprintf(stderr, "Usage: fleet [-n N] [-t SECONDS] [--boot-spread MS] [--outage START:LEN] [--outage-mode refuse|hang]\n"
+                    "             [--latency MS] [--interval MS] [--jitter MS] [--retries N] [--backoff MIN:MAX]\n"
+                    "             [--seed N] [--timeline FILE] [-v]\n");
+    return 2;
+}
+
+static int _parse_args_(int argc, char **argv)
+{
+    for(int i = 1; i < argc; i++){
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        unsigned long a, b;
+
+        if(strcmp(arg, "-v") == 0){
+            state.verbose = true;
+            continue;
+        }
+
+        if(value == NULL){
+            return -1;
+        }
+        i++;
+
+        if(strcmp(arg, "-n") == 0){
+            state.n_instances = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(arg, "-t") == 0){
+            state.duration_ms = strtoul(value, NULL, 10) * 1000;
+        }
+        else if(strcmp(arg, "--boot-spread") == 0){
+            state.boot_spread_ms = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(arg, "--outage") == 0 && sscanf(value, "%lu:%lu", &a, &b) == 2){
+            state.outage_start_ms = a * 1000;
+            state.outage_end_ms = (a + b) * 1000;
+        }
+        else if(strcmp(arg, "--outage-mode") == 0 && (strcmp(value, "refuse") == 0 || strcmp(value, "hang") == 0)){
+            state.outage_hang = strcmp(value, "hang") == 0;
+        }
+        else if(strcmp(arg, "--latency") == 0){
+            state.latency_ms = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(arg, "--interval") == 0){
+            state.policy.poll_interval_ms = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(arg, "--jitter") == 0){
+            state.policy.poll_jitter_ms = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(arg, "--retries") == 0){
+            state.policy.max_retries = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(arg, "--backoff") == 0 && sscanf(value, "%lu:%lu", &a, &b) == 2){
+            state.policy.backoff_min_ms = a;
+            state.policy.backoff_max_ms = b;
+        }
+        else if(strcmp(arg, "--seed") == 0){
+            state.seed = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(arg, "--timeline") == 0){
+            state.timeline_path = value;
+        }
+        else{
+            return -1;
+        }
+    }
+
+    if(state.n_instances == 0 || state.n_instances > FLEET_MAX_INSTANCES || state.duration_ms == 0
+       || state.policy.poll_interval_ms == 0 || state.policy.backoff_min_ms == 0){
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    state.policy = server_get_policy();
+
+    if(_parse_args_(argc, argv) != 0){
+        return _usage_();
+    }
+
+    if(state.boot_spread_ms == UINT32_MAX){
+        state.boot_spread_ms = state.policy.poll_interval_ms;
+    }
+
+    // The report goes to stdout, the output of the base stations only with -v
+    state.report = fdopen(dup(STDOUT_FILENO), "w");
+    if(!state.verbose && freopen("/dev/null", "w", stdout) == NULL){
+        perror("stdout");
+        return 1;
+    }
+
+    host_rand_seed(state.seed);
+    stdio_init_all();
+
+    // One WiFi link carries the whole fleet
+    kv_init(&kv_flash_pico);
+    init_wifi();
+    net_stats_init();
+    wifi_start_auto_connect();
+    while(wifi_poll() != WIFI_EVENT_CONNECTED){
+        sleep_ms(1);
+    }
+
+    host_http_set_handler(_server_);
+    host_net_set_latency(0, 30, state.latency_ms);
+
+    // Every base station starts from the boot state of the module
+    state.server_live = server_state(&state.server_size);
+    state.server_states = malloc(state.n_instances * state.server_size);
+
+    for(int i = 0; i < state.n_instances; i++){
+        memcpy(state.server_states + i * state.server_size, state.server_live, state.server_size);
+
+        _switch_(i);
+        server_set_policy(&state.policy);
+
+        uint32_t boot_ms = state.boot_spread_ms > 0 ? get_rand_32() % state.boot_spread_ms : 0;
+        state.instances[i] = (FleetInstance){.boot_ms = boot_ms, .wake_ms = boot_ms};
+    }
+
+    host_net_set_switch(_switch_);
+
+    state.seconds = calloc(state.duration_ms / 1000 + 1, sizeof(FleetSecond));
+    state.start_us = time_us_64();
+
+    NetTrafficStats traffic = net_stats_traffic();
+
+    for(uint32_t now_ms = 0; now_ms < state.duration_ms; now_ms += FLEET_TICK_MS){
+        for(int i = 0; i < state.n_instances; i++){
+            if(now_ms >= state.instances[i].wake_ms){
+                _step_(i, now_ms);
+            }
+        }
+
+        if(now_ms % FLEET_SAMPLE_MS == 0){
+            _sample_staleness_(now_ms);
+        }
+
+        host_time_advance_us(FLEET_TICK_MS * 1000);
+
+        // Traffic of the second that just ended
+        if((now_ms + FLEET_TICK_MS) % 1000 == 0){
+            NetTrafficStats now = net_stats_traffic();
+            FleetSecond *second = &state.seconds[now_ms / 1000];
+
+            second->bytes_in = now.bytes_in - traffic.bytes_in;
+            second->bytes_out = now.bytes_out - traffic.bytes_out;
+            traffic = now;
+        }
+    }
+
+    _report_();
+    fflush(state.report);
+
+    if(state.timeline_path != NULL && _write_timeline_() != 0){
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+
+#include "host.h"
+
+// Max number of device models on the GPIO pins
+#define HOST_MAX_DEVICES 4
+
+// Estimated cost of one SIO register access including the call
+#define HOST_GPIO_CYCLES 4
+
+typedef struct{
+    bool enabled;
+    uint16_t wrap;
+    uint16_t level[2];
+} HostPwmSlice;
+
+static struct HostGpio{
+    uint32_t outputs;
+    uint32_t output_mask;
+    uint32_t pull_up_mask;
+
+    uint32_t accesses;
+
+    const HostGpioDevice *devices[HOST_MAX_DEVICES];
+    uint8_t n_devices;
+
+    HostPwmSlice slices[NUM_PWM_SLICES];
+} state;
+
+static void _access_()
+{
+    state.accesses++;
+    host_cycles_charge(HOST_GPIO_CYCLES);
+}
+
+static void _set_outputs_(uint32_t outputs)
+{
+    uint32_t previous = state.outputs;
+    state.outputs = outputs;
+    _access_();
+
+    if(previous == outputs){
+        return;
+    }
+
+    for(int i = 0; i < state.n_devices; i++){
+        if(state.devices[i]->changed != NULL){
+            state.devices[i]->changed(previous, outputs);
+        }
+    }
+}
+
+int host_gpio_attach(const HostGpioDevice *device)
+{
+    if(state.n_devices == HOST_MAX_DEVICES){
+        return -1;
+    }
+
+    state.devices[state.n_devices++] = device;
+    return 0;
+}
+
+uint32_t host_gpio_accesses()
+{
+    return state.accesses;
+}
+
+void gpio_init(uint gpio)
+{
+    gpio_init_mask(1u << gpio);
+}
+
+void gpio_init_mask(uint32_t mask)
+{
+    state.output_mask &= ~mask;
+    state.pull_up_mask &= ~mask;
+    _set_outputs_(state.outputs & ~mask);
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    if(out){
+        gpio_set_dir_out_masked(1u << gpio);
+    }
+    else{
+        gpio_set_dir_in_masked(1u << gpio);
+    }
+}
+
+void gpio_set_dir_out_masked(uint32_t mask)
+{
+    state.output_mask |= mask;
+    _access_();
+}
+
+void gpio_set_dir_in_masked(uint32_t mask)
+{
+    state.output_mask &= ~mask;
+    _access_();
+}
+
+void gpio_pull_down(uint gpio)
+{
+    state.pull_up_mask &= ~(1u << gpio);
+}
+
+void gpio_pull_up(uint gpio)
+{
+    state.pull_up_mask |= 1u << gpio;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    gpio_put_masked(1u << gpio, (uint32_t)value << gpio);
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+    _set_outputs_((state.outputs & ~mask) | (value & mask));
+}
+
+uint32_t gpio_get_all(void)
+{
+    _access_();
+
+    // Undriven inputs follow their pull
+    uint32_t inputs = state.pull_up_mask;
+
+    for(int i = 0; i < state.n_devices; i++){
+        if(state.devices[i]->input != NULL){
+            inputs |= state.devices[i]->input(state.outputs & state.output_mask, state.output_mask);
+        }
+    }
+
+    return (state.outputs & state.output_mask) | (inputs & ~state.output_mask);
+}
+
+bool gpio_get(uint gpio)
+{
+    return (gpio_get_all() >> gpio) & 1;
+}
+
+void pwm_init(uint slice_num, pwm_config *c, bool start)
+{
+    state.slices[slice_num] = (HostPwmSlice){.enabled = start, .wrap = c->top};
+}
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap)
+{
+    state.slices[slice_num].wrap = wrap;
+}
+
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level)
+{
+    state.slices[slice_num].level[chan] = level;
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled)
+{
+    state.slices[slice_num].enabled = enabled;
+}
+
+uint16_t host_pwm_level(unsigned gpio)
+{
+    const HostPwmSlice *slice = &state.slices[pwm_gpio_to_slice_num(gpio)];
+    return slice->enabled ? slice->level[pwm_gpio_to_channel(gpio)] : 0;
+}
+
+uint16_t host_pwm_wrap(unsigned gpio)
+{
+    return state.slices[pwm_gpio_to_slice_num(gpio)].wrap;
+}
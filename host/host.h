@@ -0,0 +1,245 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "display.h"
+#include "keypad.h"
+
+/*
+Simulated board for the host build (BASESTATION_HOST_BUILD).
+
+The headers in host/include stand in for the Pico SDK, cyw43 and lwIP
+headers used by the modules, so the modules build unchanged as a Linux
+library. This header controls the simulation around them.
+
+Time is virtual and counted in cycles of the simulated 125 MHz processor.
+It advances in sleep_us/sleep_ms, host_time_advance_us and by a fixed
+charge for each GPIO and flash access, which stands in for the bus time
+on the board. Code running on the host CPU takes no simulated time.
+SysTick counts the same cycles, so the profiler works unchanged.
+
+Alarms, WiFi events and network events run when time advances, in time
+order, on the calling thread. A run is therefore repeatable and does not
+depend on the speed of the host. The exception is realtime mode, for
+running several instances against each other over UDP: virtual time is
+then held back to the wall clock.
+
+GPIO drives device models: an HD44780 display and a key matrix wired as
+on the base station (see host_board_init), and PWM slices that only
+record their settings. Flash is a RAM array with NOR semantics.
+*/
+
+// Wiring of the base station
+extern const struct DisplayPinConfig host_board_display;
+extern const struct keypadPinConfig host_board_keypad;
+extern const char host_board_key_matrix[4][3];
+
+/**
+ * @brief Attach the display and keypad models to the base station pins and
+ * set up a default WiFi network and server. Called by stdio_init_all.
+ *
+ * Reads the environment: HOST_REALTIME=1 turns on realtime mode and
+ * HOST_SEED seeds get_rand_32, so instances run side by side differ
+ */
+void host_board_init();
+
+/**
+ * @brief Add the default access points of host_board_init
+ */
+void host_board_add_networks();
+
+// ===================================================================================
+// Virtual clock
+
+typedef void (*HostEventFn)(void *arg);
+
+/**
+ * @brief Advance virtual time, running all alarms and events that fall due
+ */
+void host_time_advance_us(uint64_t us);
+
+/**
+ * @brief Advance virtual time by a number of processor cycles
+ */
+void host_cycles_charge(uint64_t cycles);
+
+/**
+ * @brief Simulated processor cycles since start
+ */
+uint64_t host_cycles();
+
+/**
+ * @brief Run func at virtual time at_us. Events at the same time run in the
+ * order they were scheduled
+ *
+ * @return Event id, or -1 if the event table is full
+ */
+int host_event_schedule(uint64_t at_us, HostEventFn func, void *arg);
+
+void host_event_cancel(int id);
+
+/**
+ * @brief Hold virtual time back to the wall clock from now on, so
+ * instances exchanging datagrams see the same passage of time
+ */
+void host_clock_set_realtime(bool realtime);
+
+/**
+ * @brief Seed the generator behind get_rand_32
+ */
+void host_rand_seed(uint32_t seed);
+
+// ===================================================================================
+// GPIO and device models
+
+typedef struct{
+    // Levels driven onto input pins, given the pins driven by the board
+    uint32_t (*input)(uint32_t outputs, uint32_t output_mask);
+
+    // Called after the output levels changed
+    void (*changed)(uint32_t previous, uint32_t outputs);
+} HostGpioDevice;
+
+int host_gpio_attach(const HostGpioDevice *device);
+
+/**
+ * @brief Number of GPIO register accesses since start, as a measure of
+ * bus traffic. Every gpio_put, gpio_put_masked, gpio_get and direction
+ * change counts as one
+ */
+uint32_t host_gpio_accesses();
+
+void host_display_attach(struct DisplayPinConfig config);
+
+/**
+ * @brief Visible text of a display row, 16 characters and a terminator
+ */
+const char *host_display_row(uint8_t row);
+
+/**
+ * @brief Instructions and characters written to the display since start
+ */
+uint32_t host_display_writes();
+
+/**
+ * @brief Hash of all instructions and characters written to the display
+ * since start. Two runs that showed the same screens give the same hash
+ */
+uint32_t host_display_hash();
+
+void host_keypad_attach(struct keypadPinConfig config, const char key_matrix[4][3]);
+
+/**
+ * @brief Hold key down. 0 releases all keys
+ */
+void host_keypad_press(char key);
+
+/**
+ * @brief Level and wrap of a PWM channel. Level 0 is silent
+ */
+uint16_t host_pwm_level(unsigned gpio);
+uint16_t host_pwm_wrap(unsigned gpio);
+
+// ===================================================================================
+// Console
+
+/**
+ * @brief Queue text to be read by getchar_timeout_us. Once the queue is
+ * empty, stdin is read without blocking
+ */
+void host_console_input(const char *text);
+
+// ===================================================================================
+// Flash
+
+/**
+ * @brief Erase the whole simulated flash
+ */
+void host_flash_reset();
+
+uint32_t host_flash_erases();
+uint32_t host_flash_programs();
+
+/**
+ * @brief Cut power after operations more sector erases or page programs.
+ * The next one stops halfway through its bytes, and later ones do nothing
+ * until host_flash_power_on. Reboot with kv_init to see what survived
+ */
+void host_flash_cut_after(uint32_t operations);
+
+/**
+ * @brief Restore power and clear any pending cut
+ */
+void host_flash_power_on();
+
+/**
+ * @brief True once the cut set by host_flash_cut_after has happened
+ */
+bool host_flash_power_lost();
+
+// ===================================================================================
+// WiFi
+
+/**
+ * @brief Add an access point. An empty password makes an open network
+ *
+ * @return 0 on success, -1 if the network table is full
+ */
+int host_wifi_add_network(const char *ssid, const char *password, int16_t rssi);
+
+void host_wifi_clear_networks();
+
+/**
+ * @brief Drop the link, as if the access point went away. The driver
+ * rejoins when asked to
+ */
+void host_wifi_drop_link();
+
+// ===================================================================================
+// Network
+
+/**
+ * @brief Answers an HTTP GET. Writes the body to body and returns the HTTP
+ * status. A negative return refuses the connection and 0 never answers
+ */
+typedef int (*HostHttpHandler)(const char *uri, char *body, size_t size);
+
+void host_http_set_handler(HostHttpHandler handler);
+
+/**
+ * @brief Simulated network delays. dns_ms applies to names that are not
+ * dotted addresses, connect_ms to the TCP handshake and response_ms from
+ * the request to the response
+ */
+void host_net_set_latency(uint32_t dns_ms, uint32_t connect_ms, uint32_t response_ms);
+
+/**
+ * @brief Deliver response bodies in pbufs of at most bytes each, as TCP
+ * segments would split them. 0, the default, delivers a body in one pbuf
+ */
+void host_net_set_segment(uint16_t bytes);
+
+/**
+ * @brief Serve many simulated devices from one stack. Connections and
+ * lookups belong to the owner set when they start, and switch_fn(owner)
+ * is called before their callbacks run, so the caller can swap in the
+ * state of that device. The pool limits of a single device are not
+ * enforced while a switch function is set
+ */
+void host_net_set_switch(void (*switch_fn)(int owner));
+
+void host_net_set_owner(int owner);
+
+/**
+ * @brief Send request to the server listening on port, as a client on
+ * the LAN would, and read the response until the server closes. The
+ * response is cut to fit size and terminated
+ *
+ * @return Length of the whole response, or -1 if the connection was refused
+ */
+int host_net_local_request(uint16_t port, const char *request, char *response, size_t size);
+
+#endif //HOST_H
@@ -0,0 +1,10 @@
+#ifndef HOST_INTERNAL_H
+#define HOST_INTERNAL_H
+
+#include "lwip/netif.h"
+
+// Driver functions of the station netif, implemented by the simulated stack
+err_t host_netif_input(struct pbuf *p, struct netif *inp);
+err_t host_netif_linkoutput(struct netif *netif, struct pbuf *p);
+
+#endif //HOST_INTERNAL_H
@@ -0,0 +1,15 @@
+#ifndef HOST_HARDWARE_CLOCKS_H
+#define HOST_HARDWARE_CLOCKS_H
+
+#include <stdint.h>
+
+// System clock of the simulated RP2040
+#define HOST_SYS_CLOCK_HZ 125000000
+
+enum clock_index{
+    clk_sys = 5
+};
+
+static inline uint32_t clock_get_hz(enum clock_index clk_index) { (void)clk_index; return HOST_SYS_CLOCK_HZ; }
+
+#endif //HOST_HARDWARE_CLOCKS_H
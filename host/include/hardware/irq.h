@@ -0,0 +1,4 @@
+#ifndef HOST_HARDWARE_IRQ_H
+#define HOST_HARDWARE_IRQ_H
+
+#endif //HOST_HARDWARE_IRQ_H
@@ -0,0 +1,29 @@
+#ifndef HOST_HARDWARE_PWM_H
+#define HOST_HARDWARE_PWM_H
+
+#include "pico/stdlib.h"
+
+// PWM slices only record their settings, see host_pwm_level
+
+#define NUM_PWM_SLICES 8
+
+typedef struct{
+    bool phase_correct;
+    float clkdiv;
+    uint16_t top;
+} pwm_config;
+
+static inline uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+static inline uint pwm_gpio_to_channel(uint gpio) { return gpio & 1; }
+
+static inline pwm_config pwm_get_default_config(void) { return (pwm_config){.phase_correct = false, .clkdiv = 1, .top = 0xffff}; }
+static inline void pwm_config_set_phase_correct(pwm_config *c, bool phase_correct) { c->phase_correct = phase_correct; }
+static inline void pwm_config_set_clkdiv(pwm_config *c, float div) { c->clkdiv = div; }
+static inline void pwm_config_set_wrap(pwm_config *c, uint16_t wrap) { c->top = wrap; }
+
+void pwm_init(uint slice_num, pwm_config *c, bool start);
+void pwm_set_wrap(uint slice_num, uint16_t wrap);
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level);
+void pwm_set_enabled(uint slice_num, bool enabled);
+
+#endif //HOST_HARDWARE_PWM_H
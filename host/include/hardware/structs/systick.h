@@ -0,0 +1,19 @@
+#ifndef HOST_HARDWARE_STRUCTS_SYSTICK_H
+#define HOST_HARDWARE_STRUCTS_SYSTICK_H
+
+#include <stdint.h>
+
+typedef struct{
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+
+// Counts down with the virtual clock while enabled
+extern systick_hw_t *systick_hw;
+
+#define M0PLUS_SYST_CSR_ENABLE_BITS 0x00000001
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004
+
+#endif //HOST_HARDWARE_STRUCTS_SYSTICK_H
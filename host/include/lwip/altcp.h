@@ -0,0 +1,50 @@
+#ifndef HOST_LWIP_ALTCP_H
+#define HOST_LWIP_ALTCP_H
+
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+
+struct altcp_pcb;
+
+typedef err_t (*altcp_accept_fn)(void *arg, struct altcp_pcb *new_conn, err_t err);
+typedef err_t (*altcp_recv_fn)(void *arg, struct altcp_pcb *conn, struct pbuf *p, err_t err);
+typedef err_t (*altcp_sent_fn)(void *arg, struct altcp_pcb *conn, u16_t len);
+typedef err_t (*altcp_poll_fn)(void *arg, struct altcp_pcb *conn);
+typedef void (*altcp_err_fn)(void *arg, err_t err);
+
+// Same layout as lwIP for the fields the application reads. A plain TCP
+// connection keeps its tcp_pcb in state
+struct altcp_pcb{
+    const void *fns;
+    struct altcp_pcb *inner_conn;
+    void *arg;
+    void *state;
+};
+
+typedef struct altcp_pcb *(*altcp_new_fn)(void *arg, u8_t ip_type);
+
+typedef struct altcp_allocator_s{
+    altcp_new_fn alloc;
+    void *arg;
+} altcp_allocator_t;
+
+void altcp_arg(struct altcp_pcb *conn, void *arg);
+void altcp_accept(struct altcp_pcb *conn, altcp_accept_fn accept);
+void altcp_recv(struct altcp_pcb *conn, altcp_recv_fn recv);
+void altcp_sent(struct altcp_pcb *conn, altcp_sent_fn sent);
+void altcp_poll(struct altcp_pcb *conn, altcp_poll_fn poll, u8_t interval);
+void altcp_err(struct altcp_pcb *conn, altcp_err_fn err);
+
+void altcp_recved(struct altcp_pcb *conn, u16_t len);
+err_t altcp_bind(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t port);
+struct altcp_pcb *altcp_listen_with_backlog_and_err(struct altcp_pcb *conn, u8_t backlog, err_t *err);
+#define altcp_listen(conn) altcp_listen_with_backlog_and_err(conn, 0xff, NULL)
+
+err_t altcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags);
+err_t altcp_output(struct altcp_pcb *conn);
+u16_t altcp_sndbuf(struct altcp_pcb *conn);
+
+err_t altcp_close(struct altcp_pcb *conn);
+void altcp_abort(struct altcp_pcb *conn);
+
+#endif //HOST_LWIP_ALTCP_H
@@ -0,0 +1,8 @@
+#ifndef HOST_LWIP_ALTCP_TCP_H
+#define HOST_LWIP_ALTCP_TCP_H
+
+#include "lwip/altcp.h"
+
+struct altcp_pcb *altcp_tcp_new_ip_type(u8_t ip_type);
+
+#endif //HOST_LWIP_ALTCP_TCP_H
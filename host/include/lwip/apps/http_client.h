@@ -0,0 +1,40 @@
+#ifndef HOST_LWIP_APPS_HTTP_CLIENT_H
+#define HOST_LWIP_APPS_HTTP_CLIENT_H
+
+#include "lwip/altcp.h"
+
+// Requests are answered by the simulated server, see host_http_set_handler
+
+#define HTTP_DEFAULT_PORT 80
+
+typedef enum ehttpc_result{
+    HTTPC_RESULT_OK = 0,
+    HTTPC_RESULT_ERR_UNKNOWN = 1,
+    HTTPC_RESULT_ERR_CONNECT = 2,
+    HTTPC_RESULT_ERR_HOSTNAME = 3,
+    HTTPC_RESULT_ERR_CLOSED = 4,
+    HTTPC_RESULT_ERR_TIMEOUT = 5,
+    HTTPC_RESULT_ERR_SVR_RESP = 6,
+    HTTPC_RESULT_ERR_MEM = 7,
+    HTTPC_RESULT_LOCAL_ABORT = 8,
+    HTTPC_RESULT_ERR_CONTENT_LEN = 9
+} httpc_result_t;
+
+typedef struct _httpc_state httpc_state_t;
+
+typedef void (*httpc_result_fn)(void *arg, httpc_result_t httpc_result, u32_t rx_content_len, u32_t srv_res, err_t err);
+typedef err_t (*httpc_headers_done_fn)(httpc_state_t *connection, void *arg, struct pbuf *hdr, u16_t hdr_len, u32_t content_len);
+
+typedef struct _httpc_connection{
+    ip_addr_t proxy_addr;
+    u16_t proxy_port;
+    u8_t use_proxy;
+    altcp_allocator_t *altcp_allocator;
+    httpc_result_fn result_fn;
+    httpc_headers_done_fn headers_done_fn;
+} httpc_connection_t;
+
+err_t httpc_get_file(const ip_addr_t *server_addr, u16_t port, const char *uri, const httpc_connection_t *settings,
+                     altcp_recv_fn recv_fn, void *callback_arg, httpc_state_t **connection);
+
+#endif //HOST_LWIP_APPS_HTTP_CLIENT_H
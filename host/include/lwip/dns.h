@@ -0,0 +1,12 @@
+#ifndef HOST_LWIP_DNS_H
+#define HOST_LWIP_DNS_H
+
+#include "lwip/ip_addr.h"
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+// Addresses in dotted notation resolve at once. Other names resolve to
+// the loopback address after the DNS latency, see host_net_set_latency
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg);
+
+#endif //HOST_LWIP_DNS_H
@@ -0,0 +1,10 @@
+#ifndef HOST_LWIP_IGMP_H
+#define HOST_LWIP_IGMP_H
+
+#include "lwip/ip_addr.h"
+
+// Groups are joined on the loopback interface, so instances on one
+// machine receive each other's multicast
+err_t igmp_joingroup(const ip4_addr_t *ifaddr, const ip4_addr_t *groupaddr);
+
+#endif //HOST_LWIP_IGMP_H
@@ -0,0 +1,32 @@
+#ifndef HOST_LWIP_IP_ADDR_H
+#define HOST_LWIP_IP_ADDR_H
+
+#include "lwip/err.h"
+
+// IPv4 only. The address is kept in network byte order as in lwIP
+typedef struct{
+    u32_t addr;
+} ip_addr_t;
+
+typedef ip_addr_t ip4_addr_t;
+
+#define IPADDR_TYPE_V4 0U
+#define IPADDR_TYPE_ANY 46U
+
+#define IP4_ADDR(ipaddr, a, b, c, d) ((ipaddr)->addr = ((u32_t)(a)) | ((u32_t)(b) << 8) | ((u32_t)(c) << 16) | ((u32_t)(d) << 24))
+#define IP_ADDR4(ipaddr, a, b, c, d) IP4_ADDR(ipaddr, a, b, c, d)
+
+// Any address. Binding and joining groups ignore the address
+#define IP_ANY_TYPE ((const ip_addr_t *)NULL)
+#define IP4_ADDR_ANY4 ((const ip4_addr_t *)NULL)
+
+#define ip_2_ip4(ipaddr) (ipaddr)
+#define ip_addr_copy(dest, src) ((dest) = (src))
+#define ip_addr_cmp(addr1, addr2) ((addr1)->addr == (addr2)->addr)
+#define ip_addr_isany(ipaddr) ((ipaddr) == NULL || (ipaddr)->addr == 0)
+#define ip_addr_get_ip4_u32(ipaddr) ((ipaddr)->addr)
+
+char *ipaddr_ntoa(const ip_addr_t *addr);
+int ipaddr_aton(const char *cp, ip_addr_t *addr);
+
+#endif //HOST_LWIP_IP_ADDR_H
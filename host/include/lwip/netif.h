@@ -0,0 +1,29 @@
+#ifndef HOST_LWIP_NETIF_H
+#define HOST_LWIP_NETIF_H
+
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+struct netif;
+
+#define NETIF_FLAG_LINK_UP 0x04U
+
+#define netif_is_link_up(netif) (((netif)->flags & NETIF_FLAG_LINK_UP) ? (u8_t)1 : (u8_t)0)
+
+typedef err_t (*netif_input_fn)(struct pbuf *p, struct netif *inp);
+typedef err_t (*netif_linkoutput_fn)(struct netif *netif, struct pbuf *p);
+typedef void (*netif_status_callback_fn)(struct netif *netif);
+
+struct netif{
+    netif_input_fn input;
+    netif_linkoutput_fn linkoutput;
+    netif_status_callback_fn status_callback;
+    netif_status_callback_fn link_callback;
+    ip_addr_t ip_addr;
+    u8_t flags;
+};
+
+void netif_set_link_callback(struct netif *netif, netif_status_callback_fn link_callback);
+void netif_set_status_callback(struct netif *netif, netif_status_callback_fn status_callback);
+
+#endif //HOST_LWIP_NETIF_H
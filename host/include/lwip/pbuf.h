@@ -0,0 +1,27 @@
+#ifndef HOST_LWIP_PBUF_H
+#define HOST_LWIP_PBUF_H
+
+#include "lwip/err.h"
+
+typedef enum{
+    PBUF_TRANSPORT = 0,
+    PBUF_RAW = 1
+} pbuf_layer;
+
+typedef enum{
+    PBUF_RAM = 0,
+    PBUF_POOL = 1
+} pbuf_type;
+
+struct pbuf{
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+u8_t pbuf_free(struct pbuf *p);
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset);
+
+#endif //HOST_LWIP_PBUF_H
@@ -0,0 +1,37 @@
+#ifndef HOST_LWIP_STATS_H
+#define HOST_LWIP_STATS_H
+
+#include "lwip/err.h"
+#include "lwip/memp.h"
+
+// Counters the simulated stack keeps, with the lwIP field names
+
+struct stats_proto{
+    u32_t xmit;
+    u32_t recv;
+    u32_t drop;
+};
+
+struct stats_mem{
+    const char *name;
+    u32_t err;
+    u32_t avail;
+    u32_t used;
+    u32_t max;
+    u32_t illegal;
+};
+
+struct stats_mib2{
+    u32_t tcpretranssegs;
+};
+
+struct stats_{
+    struct stats_proto link;
+    struct stats_mem mem;
+    struct stats_mem *memp[MEMP_MAX];
+    struct stats_mib2 mib2;
+};
+
+extern struct stats_ lwip_stats;
+
+#endif //HOST_LWIP_STATS_H
@@ -0,0 +1,80 @@
+#ifndef HOST_PICO_CYW43_ARCH_H
+#define HOST_PICO_CYW43_ARCH_H
+
+// Simulated cyw43 driver, implemented by host/cyw43.c. Networks seen by
+// scans and joins are set up with host_wifi_add_network
+
+#include "pico/stdlib.h"
+#include "lwip/netif.h"
+
+#define CYW43_ITF_STA 0
+#define CYW43_ITF_AP 1
+
+#define CYW43_LINK_DOWN 0
+#define CYW43_LINK_JOIN 1
+#define CYW43_LINK_NOIP 2
+#define CYW43_LINK_UP 3
+#define CYW43_LINK_FAIL (-1)
+#define CYW43_LINK_NONET (-2)
+#define CYW43_LINK_BADAUTH (-3)
+
+#define CYW43_AUTH_OPEN 0
+#define CYW43_AUTH_WPA_TKIP_PSK 0x00200002
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+#define CYW43_AUTH_WPA2_MIXED_PSK 0x00400006
+
+#define CYW43_COUNTRY(A, B, REV) ((unsigned char)(A) | ((unsigned char)(B) << 8) | ((REV) << 16))
+#define CYW43_COUNTRY_DENMARK CYW43_COUNTRY('D', 'K', 0)
+
+#define CYW43_CHANNEL_NONE (0xffffffff)
+
+#define CYW43_DEFAULT_PM 0xa11142
+#define CYW43_AGGRESSIVE_PM 0xa11c82
+#define CYW43_PERFORMANCE_PM 0x111022
+#define CYW43_NONE_PM 0x10
+
+typedef struct{
+    uint8_t bssid[6];
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+    uint16_t channel;
+    uint8_t auth_mode;
+    int16_t rssi;
+} cyw43_ev_scan_result_t;
+
+typedef struct{
+    uint32_t version;
+    uint16_t action;
+    uint16_t _;
+    uint32_t ssid_len;
+    uint8_t ssid[32];
+} cyw43_wifi_scan_options_t;
+
+typedef struct{
+    struct netif netif[2];
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+int cyw43_arch_init(void);
+void cyw43_arch_deinit(void);
+void cyw43_arch_enable_sta_mode(void);
+void cyw43_arch_lwip_begin(void);
+void cyw43_arch_lwip_end(void);
+
+void cyw43_init(cyw43_t *self);
+void cyw43_wifi_set_up(cyw43_t *self, int itf, bool up, uint32_t country);
+int cyw43_wifi_leave(cyw43_t *self, int itf);
+int cyw43_wifi_join(cyw43_t *self, size_t ssid_len, const uint8_t *ssid, size_t key_len, const uint8_t *key,
+                    uint32_t auth_type, const uint8_t *bssid, uint32_t channel);
+int cyw43_wifi_link_status(cyw43_t *self, int itf);
+int cyw43_tcpip_link_status(cyw43_t *self, int itf);
+int cyw43_wifi_scan(cyw43_t *self, cyw43_wifi_scan_options_t *opts, void *env,
+                    int (*result_cb)(void *, const cyw43_ev_scan_result_t *));
+bool cyw43_wifi_scan_active(cyw43_t *self);
+int cyw43_wifi_pm(cyw43_t *self, uint32_t pm);
+int cyw43_wifi_get_pm(cyw43_t *self, uint32_t *pm);
+int cyw43_wifi_get_rssi(cyw43_t *self, int32_t *rssi);
+int cyw43_wifi_get_bssid(cyw43_t *self, uint8_t bssid[6]);
+
+#endif //HOST_PICO_CYW43_ARCH_H
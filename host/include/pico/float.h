@@ -0,0 +1,6 @@
+#ifndef HOST_PICO_FLOAT_H
+#define HOST_PICO_FLOAT_H
+
+#include <math.h>
+
+#endif //HOST_PICO_FLOAT_H
@@ -0,0 +1,4 @@
+#ifndef HOST_PICO_LWIP_NOSYS_H
+#define HOST_PICO_LWIP_NOSYS_H
+
+#endif //HOST_PICO_LWIP_NOSYS_H
@@ -0,0 +1,9 @@
+#ifndef HOST_PICO_RAND_H
+#define HOST_PICO_RAND_H
+
+#include <stdint.h>
+
+// Deterministic on the host so runs can be repeated, see host_rand_seed
+uint32_t get_rand_32(void);
+
+#endif //HOST_PICO_RAND_H
@@ -0,0 +1,75 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+// Subset of pico_stdlib used by the base station, implemented by host/hal.c
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+
+#define PICO_OK 0
+#define PICO_ERROR_TIMEOUT (-1)
+
+static inline void tight_loop_contents(void) {}
+
+void stdio_init_all(void);
+int getchar_timeout_us(uint32_t timeout_us);
+
+uint get_core_num(void);
+
+// Time. All time is read from the virtual clock, see host.h
+
+typedef uint64_t absolute_time_t;
+
+absolute_time_t get_absolute_time(void);
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) { return t + us; }
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) { return t + (uint64_t)ms * 1000; }
+static inline absolute_time_t make_timeout_time_us(uint64_t us) { return delayed_by_us(get_absolute_time(), us); }
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return delayed_by_ms(get_absolute_time(), ms); }
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) { return (int64_t)(to - from); }
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+// Alarms run from the virtual clock when time advances
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
+
+// GPIO
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+enum gpio_function{
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_NULL = 0x1f
+};
+
+void gpio_init(uint gpio);
+void gpio_init_mask(uint32_t mask);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_set_dir_out_masked(uint32_t mask);
+void gpio_set_dir_in_masked(uint32_t mask);
+void gpio_pull_down(uint gpio);
+void gpio_pull_up(uint gpio);
+void gpio_put(uint gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+bool gpio_get(uint gpio);
+uint32_t gpio_get_all(void);
+
+#endif //HOST_PICO_STDLIB_H
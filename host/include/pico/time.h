@@ -0,0 +1,6 @@
+#ifndef HOST_PICO_TIME_H
+#define HOST_PICO_TIME_H
+
+#include "pico/stdlib.h"
+
+#endif //HOST_PICO_TIME_H
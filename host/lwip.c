@@ -0,0 +1,967 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "pico/cyw43_arch.h"
+#include "lwip/apps/http_client.h"
+#include "lwip/altcp_tcp.h"
+#include "lwip/dns.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/igmp.h"
+#include "lwip/stats.h"
+#include "lwipopts.h"
+
+#include "host.h"
+#include "host_internal.h"
+
+/*
+Simulated lwIP: just enough of the stack for the http client and the
+local server.
+
+Each request is answered by the HTTP handler after the connect and
+response latencies. Callbacks follow lwIP's http client: headers_done_fn,
+recv_fn with the body in one pbuf or in segments (host_net_set_segment),
+then result_fn when the server closes. Non-200 responses are delivered
+the same way with the status in srv_res. Bytes pass through the station netif so its counters see them.
+
+Connections to a listening pcb are made by host_net_local_request,
+which stands in for a client on the LAN.
+
+UDP pcbs are real sockets on the loopback interface, polled as virtual
+time advances, so several instances on one machine reach each other by
+multicast. Run them with HOST_REALTIME set so their clocks agree (see
+host_board_init).
+
+The stack can also serve many simulated devices at once, see
+host_net_set_switch.
+*/
+
+// Max number of connections and lookups in flight, for all devices
+#define HOST_MAX_CONNECTIONS 1024
+#define HOST_MAX_LOOKUPS 64
+
+// Max size of a response body
+#define HOST_HTTP_BODY_SIZE 1024
+
+// Send buffer of connections to the local server, two segments so long
+// responses are sent over several acknowledgements
+#define HOST_LOCAL_SNDBUF 2920
+
+// Polls of a local connection without progress before the client gives up
+#define HOST_LOCAL_MAX_POLLS 8
+
+// Max number of UDP pcbs and multicast groups, for all devices
+#define HOST_MAX_UDP_PCBS 64
+#define HOST_MAX_GROUPS 4
+
+// Largest datagram delivered, and the interval the sockets are read at
+#define HOST_UDP_DATAGRAM 1472
+#define HOST_UDP_POLL_MS 5
+
+#ifndef MEMP_NUM_TCP_PCB
+#define MEMP_NUM_TCP_PCB 5
+#endif
+
+#ifndef MEMP_NUM_UDP_PCB
+#define MEMP_NUM_UDP_PCB 4
+#endif
+
+typedef struct{
+    bool used;
+    struct altcp_pcb altcp;
+    struct tcp_pcb tcp;
+
+    // Callbacks of listening and accepted connections
+    u16_t port;
+    altcp_accept_fn accept;
+    altcp_recv_fn recv;
+    altcp_sent_fn sent;
+    altcp_poll_fn poll;
+    altcp_err_fn err;
+
+    // Response written to a local client, and bytes not yet acknowledged
+    char *response;
+    size_t size;
+    size_t length;
+    u16_t unacked;
+} HostPcb;
+
+struct _httpc_state{
+    bool used;
+    struct altcp_pcb *pcb;
+
+    const httpc_connection_t *settings;
+    altcp_recv_fn recv_fn;
+    void *arg;
+
+    char uri[128];
+    int event;
+    int owner;
+
+    // Response decided when the connection is accepted
+    int status;
+    char body[HOST_HTTP_BODY_SIZE];
+    u32_t content_len;
+};
+
+typedef struct{
+    bool used;
+    const char *name;
+    dns_found_callback found;
+    void *arg;
+    int owner;
+} HostLookup;
+
+struct stats_ lwip_stats;
+
+static struct HostNet{
+    HostHttpHandler handler;
+
+    uint32_t dns_ms;
+    uint32_t connect_ms;
+    uint32_t response_ms;
+
+    // Largest pbuf a response body is delivered in, 0 for the whole body
+    u16_t segment;
+
+    HostPcb pcbs[HOST_MAX_CONNECTIONS];
+    httpc_state_t connections[HOST_MAX_CONNECTIONS];
+    HostLookup lookups[HOST_MAX_LOOKUPS];
+
+    struct stats_mem memp[MEMP_MAX];
+
+    // Device starting connections and lookups, and the function that
+    // switches to a device before its callbacks run
+    int owner;
+    void (*switch_fn)(int owner);
+} state = {.dns_ms = 20, .connect_ms = 30, .response_ms = 50};
+
+// Default answer: a fixed reading for every station
+static int _default_handler_(const char *uri, char *body, size_t size)
+{
+    snprintf(body, size,
+        "{\"temp\":21.5,\"humidity\":45.0,\"wind_speed\":3.2,\"wind_dir\":180.0,"
+        "\"pressure\":101.3,\"smoke\":0.0,\"ambient\":60.0}");
+    return 200;
+}
+
+__attribute__((constructor)) static void _net_init_()
+{
+    state.handler = _default_handler_;
+
+    lwip_stats.mem = (struct stats_mem){.name = "MEM", .avail = MEM_SIZE};
+
+    static const char *names[MEMP_MAX] = {
+        [MEMP_RAW_PCB] = "RAW_PCB",
+        [MEMP_UDP_PCB] = "UDP_PCB",
+        [MEMP_TCP_PCB] = "TCP_PCB",
+        [MEMP_TCP_PCB_LISTEN] = "TCP_PCB_LISTEN",
+        [MEMP_TCP_SEG] = "TCP_SEG",
+        [MEMP_ALTCP_PCB] = "ALTCP_PCB",
+        [MEMP_SYS_TIMEOUT] = "SYS_TIMEOUT",
+        [MEMP_PBUF] = "PBUF_REF/ROM",
+        [MEMP_PBUF_POOL] = "PBUF_POOL",
+    };
+
+    for(int i = 0; i < MEMP_MAX; i++){
+        state.memp[i].name = names[i];
+        lwip_stats.memp[i] = &state.memp[i];
+    }
+
+    state.memp[MEMP_TCP_PCB].avail = MEMP_NUM_TCP_PCB;
+    state.memp[MEMP_ALTCP_PCB].avail = MEMP_NUM_TCP_PCB;
+    state.memp[MEMP_UDP_PCB].avail = MEMP_NUM_UDP_PCB;
+    state.memp[MEMP_TCP_SEG].avail = MEMP_NUM_TCP_SEG;
+    state.memp[MEMP_PBUF_POOL].avail = PBUF_POOL_SIZE;
+}
+
+static bool _memp_alloc_(memp_t type)
+{
+    struct stats_mem *stats = &state.memp[type];
+
+    // The pools of one device do not limit many devices
+    if(stats->used >= stats->avail && state.switch_fn == NULL){
+        stats->err++;
+        return false;
+    }
+
+    stats->used++;
+    if(stats->used > stats->max){
+        stats->max = stats->used;
+    }
+
+    return true;
+}
+
+static void _memp_free_(memp_t type)
+{
+    state.memp[type].used--;
+}
+
+void host_http_set_handler(HostHttpHandler handler)
+{
+    state.handler = handler != NULL ? handler : _default_handler_;
+}
+
+void host_net_set_segment(uint16_t bytes)
+{
+    state.segment = bytes;
+}
+
+void host_net_set_switch(void (*switch_fn)(int owner))
+{
+    state.switch_fn = switch_fn;
+}
+
+void host_net_set_owner(int owner)
+{
+    state.owner = owner;
+}
+
+static void _switch_(int owner)
+{
+    if(state.switch_fn != NULL){
+        state.switch_fn(owner);
+    }
+}
+
+void host_net_set_latency(uint32_t dns_ms, uint32_t connect_ms, uint32_t response_ms)
+{
+    state.dns_ms = dns_ms;
+    state.connect_ms = connect_ms;
+    state.response_ms = response_ms;
+}
+
+// ===================================================================================
+// Station interface
+
+err_t host_netif_input(struct pbuf *p, struct netif *inp)
+{
+    lwip_stats.link.recv++;
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+err_t host_netif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+    lwip_stats.link.xmit++;
+    return ERR_OK;
+}
+
+// Pass a packet of length bytes through the station netif
+static void _transfer_(bool in, u16_t length)
+{
+    struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
+
+    if(p == NULL){
+        lwip_stats.link.drop++;
+        return;
+    }
+
+    if(in){
+        // input takes the pbuf
+        netif->input(p, netif);
+    }
+    else{
+        netif->linkoutput(netif, p);
+        pbuf_free(p);
+    }
+}
+
+void netif_set_link_callback(struct netif *netif, netif_status_callback_fn link_callback)
+{
+    netif->link_callback = link_callback;
+}
+
+void netif_set_status_callback(struct netif *netif, netif_status_callback_fn status_callback)
+{
+    netif->status_callback = status_callback;
+}
+
+// ===================================================================================
+// pbuf
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+    if(!_memp_alloc_(MEMP_PBUF_POOL)){
+        return NULL;
+    }
+
+    // One extra byte keeps the payload terminated for the JSON parser
+    struct pbuf *p = calloc(1, sizeof(struct pbuf) + length + 1);
+
+    p->payload = p + 1;
+    p->tot_len = length;
+    p->len = length;
+
+    return p;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+    if(p == NULL){
+        return 0;
+    }
+
+    free(p);
+    _memp_free_(MEMP_PBUF_POOL);
+
+    return 1;
+}
+
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset)
+{
+    if(offset >= p->len){
+        return 0;
+    }
+
+    if(len > p->len - offset){
+        len = p->len - offset;
+    }
+
+    memcpy(dataptr, (const uint8_t *)p->payload + offset, len);
+
+    return len;
+}
+
+// ===================================================================================
+// Addresses and DNS
+
+char *ipaddr_ntoa(const ip_addr_t *addr)
+{
+    static char buffer[16];
+    u32_t a = addr->addr;
+
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", a & 0xff, (a >> 8) & 0xff, (a >> 16) & 0xff, a >> 24);
+
+    return buffer;
+}
+
+int ipaddr_aton(const char *cp, ip_addr_t *addr)
+{
+    unsigned a, b, c, d;
+    char end;
+
+    if(sscanf(cp, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255){
+        return 0;
+    }
+
+    IP4_ADDR(addr, a, b, c, d);
+    return 1;
+}
+
+static void _lookup_done_(void *arg)
+{
+    HostLookup *lookup = arg;
+    ip_addr_t addr;
+
+    _switch_(lookup->owner);
+
+    IP4_ADDR(&addr, 127, 0, 0, 1);
+    lookup->used = false;
+    lookup->found(lookup->name, &addr, lookup->arg);
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg)
+{
+    if(ipaddr_aton(hostname, addr)){
+        return ERR_OK;
+    }
+
+    for(int i = 0; i < HOST_MAX_LOOKUPS; i++){
+        HostLookup *lookup = &state.lookups[i];
+
+        if(!lookup->used){
+            *lookup = (HostLookup){.used = true, .name = hostname, .found = found, .arg = callback_arg, .owner = state.owner};
+            host_event_schedule(time_us_64() + state.dns_ms * 1000, _lookup_done_, lookup);
+            return ERR_INPROGRESS;
+        }
+    }
+
+    return ERR_MEM;
+}
+
+// ===================================================================================
+// altcp
+
+struct altcp_pcb *altcp_tcp_new_ip_type(u8_t ip_type)
+{
+    for(int i = 0; i < HOST_MAX_CONNECTIONS; i++){
+        HostPcb *pcb = &state.pcbs[i];
+
+        if(pcb->used){
+            continue;
+        }
+
+        if(!_memp_alloc_(MEMP_TCP_PCB)){
+            return NULL;
+        }
+        if(!_memp_alloc_(MEMP_ALTCP_PCB)){
+            _memp_free_(MEMP_TCP_PCB);
+            return NULL;
+        }
+
+        *pcb = (HostPcb){.used = true, .tcp = {.state = CLOSED}};
+        pcb->altcp.state = &pcb->tcp;
+
+        return &pcb->altcp;
+    }
+
+    return NULL;
+}
+
+static HostPcb *_host_pcb_(struct altcp_pcb *conn)
+{
+    return (HostPcb *)((uint8_t *)conn - offsetof(HostPcb, altcp));
+}
+
+static void _pcb_free_(struct altcp_pcb *conn)
+{
+    HostPcb *pcb = _host_pcb_(conn);
+
+    pcb->used = false;
+    _memp_free_(MEMP_TCP_PCB);
+    _memp_free_(MEMP_ALTCP_PCB);
+}
+
+void altcp_recved(struct altcp_pcb *conn, u16_t len)
+{
+}
+
+void altcp_arg(struct altcp_pcb *conn, void *arg)
+{
+    conn->arg = arg;
+}
+
+void altcp_accept(struct altcp_pcb *conn, altcp_accept_fn accept)
+{
+    _host_pcb_(conn)->accept = accept;
+}
+
+void altcp_recv(struct altcp_pcb *conn, altcp_recv_fn recv)
+{
+    _host_pcb_(conn)->recv = recv;
+}
+
+void altcp_sent(struct altcp_pcb *conn, altcp_sent_fn sent)
+{
+    _host_pcb_(conn)->sent = sent;
+}
+
+void altcp_poll(struct altcp_pcb *conn, altcp_poll_fn poll, u8_t interval)
+{
+    _host_pcb_(conn)->poll = poll;
+}
+
+void altcp_err(struct altcp_pcb *conn, altcp_err_fn err)
+{
+    _host_pcb_(conn)->err = err;
+}
+
+err_t altcp_bind(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t port)
+{
+    for(int i = 0; i < HOST_MAX_CONNECTIONS; i++){
+        if(state.pcbs[i].used && state.pcbs[i].tcp.state == LISTEN && state.pcbs[i].port == port){
+            return ERR_USE;
+        }
+    }
+
+    _host_pcb_(conn)->port = port;
+    return ERR_OK;
+}
+
+struct altcp_pcb *altcp_listen_with_backlog_and_err(struct altcp_pcb *conn, u8_t backlog, err_t *err)
+{
+    ((struct tcp_pcb *)conn->state)->state = LISTEN;
+
+    if(err != NULL){
+        *err = ERR_OK;
+    }
+
+    return conn;
+}
+
+// Written data goes straight to the client's response buffer
+err_t altcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags)
+{
+    HostPcb *pcb = _host_pcb_(conn);
+
+    if(pcb->tcp.state != ESTABLISHED){
+        return ERR_CONN;
+    }
+
+    if(pcb->unacked + len > HOST_LOCAL_SNDBUF){
+        return ERR_MEM;
+    }
+
+    if(pcb->length + 1 < pcb->size){
+        size_t n = pcb->size - 1 - pcb->length < len ? pcb->size - 1 - pcb->length : len;
+        memcpy(&pcb->response[pcb->length], dataptr, n);
+        pcb->response[pcb->length + n] = '\0';
+    }
+
+    pcb->length += len;
+    pcb->unacked += len;
+
+    _transfer_(false, len);
+
+    return ERR_OK;
+}
+
+err_t altcp_output(struct altcp_pcb *conn)
+{
+    return ERR_OK;
+}
+
+u16_t altcp_sndbuf(struct altcp_pcb *conn)
+{
+    return HOST_LOCAL_SNDBUF - _host_pcb_(conn)->unacked;
+}
+
+err_t altcp_close(struct altcp_pcb *conn)
+{
+    _pcb_free_(conn);
+    return ERR_OK;
+}
+
+int host_net_local_request(uint16_t port, const char *request, char *response, size_t size)
+{
+    HostPcb *listener = NULL;
+
+    for(int i = 0; i < HOST_MAX_CONNECTIONS; i++){
+        if(state.pcbs[i].used && state.pcbs[i].tcp.state == LISTEN && state.pcbs[i].port == port){
+            listener = &state.pcbs[i];
+            break;
+        }
+    }
+
+    if(listener == NULL || listener->accept == NULL || size == 0){
+        return -1;
+    }
+
+    struct altcp_pcb *conn = altcp_tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if(conn == NULL){
+        return -1;
+    }
+
+    HostPcb *pcb = _host_pcb_(conn);
+    pcb->tcp.state = ESTABLISHED;
+    pcb->response = response;
+    pcb->size = size;
+    response[0] = '\0';
+
+    // A refused connection is aborted by the stack
+    if(listener->accept(listener->altcp.arg, conn, ERR_OK) != ERR_OK){
+        _pcb_free_(conn);
+        return -1;
+    }
+
+    u16_t length = strlen(request);
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
+
+    if(p == NULL){
+        altcp_abort(conn);
+        return -1;
+    }
+
+    memcpy(p->payload, request, length);
+    _transfer_(true, length);
+
+    if(pcb->recv != NULL){
+        pcb->recv(conn->arg, conn, p, ERR_OK);
+    }
+    else{
+        pbuf_free(p);
+    }
+
+    // Acknowledge everything written until the server closes
+    for(int polls = 0; pcb->used && polls < HOST_LOCAL_MAX_POLLS; ){
+        if(pcb->unacked > 0){
+            u16_t n = pcb->unacked;
+            pcb->unacked = 0;
+
+            if(pcb->sent != NULL){
+                pcb->sent(conn->arg, conn, n);
+            }
+        }
+        else{
+            polls++;
+
+            if(pcb->poll != NULL){
+                pcb->poll(conn->arg, conn);
+            }
+        }
+    }
+
+    // The client gives up and closes its end
+    if(pcb->used && pcb->recv != NULL){
+        pcb->recv(conn->arg, conn, NULL, ERR_OK);
+    }
+
+    if(pcb->used){
+        altcp_abort(conn);
+    }
+
+    return pcb->length;
+}
+
+// ===================================================================================
+// http client
+
+static void _close_(httpc_state_t *connection, httpc_result_t result, u32_t srv_res, err_t err)
+{
+    host_event_cancel(connection->event);
+
+    connection->used = false;
+    _pcb_free_(connection->pcb);
+
+    if(connection->settings->result_fn != NULL){
+        connection->settings->result_fn(connection->arg, result, connection->content_len, srv_res, err);
+    }
+}
+
+static void _respond_(void *arg)
+{
+    httpc_state_t *connection = arg;
+    connection->event = 0;
+
+    _switch_(connection->owner);
+
+    // Status line and headers
+    char headers[128];
+    u16_t body_len = strlen(connection->body);
+    u16_t hdr_len = snprintf(headers, sizeof(headers),
+        "HTTP/1.1 %d\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", connection->status, body_len);
+
+    _transfer_(true, hdr_len + body_len);
+
+    if(connection->settings->headers_done_fn != NULL){
+        struct pbuf *hdr = pbuf_alloc(PBUF_RAW, hdr_len, PBUF_POOL);
+
+        if(hdr == NULL){
+            _close_(connection, HTTPC_RESULT_ERR_MEM, connection->status, ERR_MEM);
+            return;
+        }
+
+        memcpy(hdr->payload, headers, hdr_len);
+        err_t err = connection->settings->headers_done_fn(connection, connection->arg, hdr, hdr_len, body_len);
+        pbuf_free(hdr);
+
+        if(err != ERR_OK){
+            _close_(connection, HTTPC_RESULT_LOCAL_ABORT, connection->status, ERR_OK);
+            return;
+        }
+    }
+
+    for(u16_t offset = 0; offset < body_len; ){
+        u16_t length = body_len - offset;
+        if(state.segment > 0 && length > state.segment){
+            length = state.segment;
+        }
+
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
+
+        if(p == NULL){
+            _close_(connection, HTTPC_RESULT_ERR_MEM, connection->status, ERR_MEM);
+            return;
+        }
+
+        memcpy(p->payload, &connection->body[offset], length);
+        offset += length;
+        connection->content_len = offset;
+
+        // The application frees the pbuf
+        connection->recv_fn(connection->arg, connection->pcb, p, ERR_OK);
+    }
+
+    // The server closes the connection after the body
+    _close_(connection, HTTPC_RESULT_OK, connection->status, ERR_OK);
+}
+
+static void _connected_(void *arg)
+{
+    httpc_state_t *connection = arg;
+    connection->event = 0;
+
+    _switch_(connection->owner);
+
+    connection->status = state.handler(connection->uri, connection->body, sizeof(connection->body));
+
+    if(connection->status < 0){
+        _close_(connection, HTTPC_RESULT_ERR_CONNECT, 0, ERR_CONN);
+        return;
+    }
+
+    ((struct tcp_pcb *)connection->pcb->state)->state = ESTABLISHED;
+
+    // Request line and headers
+    _transfer_(false, strlen(connection->uri) + 64);
+
+    // Without an answer the request stays open until the client gives up
+    if(connection->status > 0){
+        connection->event = host_event_schedule(time_us_64() + state.response_ms * 1000, _respond_, connection);
+    }
+}
+
+err_t httpc_get_file(const ip_addr_t *server_addr, u16_t port, const char *uri, const httpc_connection_t *settings,
+                     altcp_recv_fn recv_fn, void *callback_arg, httpc_state_t **connection)
+{
+    httpc_state_t *c = NULL;
+
+    for(int i = 0; i < HOST_MAX_CONNECTIONS; i++){
+        if(!state.connections[i].used){
+            c = &state.connections[i];
+            break;
+        }
+    }
+
+    if(c == NULL){
+        return ERR_MEM;
+    }
+
+    struct altcp_pcb *pcb;
+    if(settings->altcp_allocator != NULL){
+        pcb = settings->altcp_allocator->alloc(settings->altcp_allocator->arg, IPADDR_TYPE_ANY);
+    }
+    else{
+        pcb = altcp_tcp_new_ip_type(IPADDR_TYPE_ANY);
+    }
+
+    if(pcb == NULL){
+        return ERR_MEM;
+    }
+
+    *c = (struct _httpc_state){
+        .used = true,
+        .pcb = pcb,
+        .settings = settings,
+        .recv_fn = recv_fn,
+        .arg = callback_arg,
+        .owner = state.owner
+    };
+    strncpy(c->uri, uri, sizeof(c->uri) - 1);
+
+    ((struct tcp_pcb *)pcb->state)->state = SYN_SENT;
+
+    c->event = host_event_schedule(time_us_64() + state.connect_ms * 1000, _connected_, c);
+
+    if(connection != NULL){
+        *connection = c;
+    }
+
+    return ERR_OK;
+}
+
+// Aborting reports the connection as closed, as lwIP's error callback does
+void altcp_abort(struct altcp_pcb *conn)
+{
+    HostPcb *pcb = _host_pcb_(conn);
+
+    for(int i = 0; i < HOST_MAX_CONNECTIONS; i++){
+        httpc_state_t *connection = &state.connections[i];
+
+        if(connection->used && connection->pcb == conn){
+            _close_(connection, HTTPC_RESULT_ERR_CLOSED, 0, ERR_ABRT);
+            return;
+        }
+    }
+
+    altcp_err_fn err = pcb->err;
+    void *arg = conn->arg;
+
+    _pcb_free_(conn);
+
+    if(err != NULL){
+        err(arg, ERR_ABRT);
+    }
+}
+
+// ===================================================================================
+// UDP
+
+struct udp_pcb{
+    bool used;
+    int fd;
+    int owner;
+
+    udp_recv_fn recv;
+    void *arg;
+};
+
+static struct HostUdp{
+    struct udp_pcb pcbs[HOST_MAX_UDP_PCBS];
+
+    // Groups joined so far. Sockets opened later join them too
+    ip_addr_t groups[HOST_MAX_GROUPS];
+    int n_groups;
+
+    int poll_event;
+} udp;
+
+static void _udp_join_(struct udp_pcb *pcb, const ip_addr_t *group)
+{
+    struct ip_mreq request = {
+        .imr_multiaddr.s_addr = group->addr,
+        .imr_interface.s_addr = htonl(INADDR_LOOPBACK)
+    };
+
+    if(setsockopt(pcb->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) != 0){
+        perror("host: IP_ADD_MEMBERSHIP");
+    }
+}
+
+// Deliver datagrams waiting on the sockets. Runs while any pcb is open
+static void _udp_poll_(void *arg)
+{
+    udp.poll_event = 0;
+    bool open = false;
+
+    for(int i = 0; i < HOST_MAX_UDP_PCBS; i++){
+        struct udp_pcb *pcb = &udp.pcbs[i];
+        uint8_t buffer[HOST_UDP_DATAGRAM];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t length;
+
+        while(pcb->used && (length = recvfrom(pcb->fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len)) >= 0){
+            _transfer_(true, length);
+
+            struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, length, PBUF_RAM);
+
+            if(pcb->recv == NULL || p == NULL){
+                pbuf_free(p);
+                continue;
+            }
+
+            memcpy(p->payload, buffer, length);
+            ip_addr_t addr = {.addr = from.sin_addr.s_addr};
+
+            _switch_(pcb->owner);
+            pcb->recv(pcb->arg, pcb, p, &addr, ntohs(from.sin_port));
+        }
+
+        open |= pcb->used;
+    }
+
+    if(open){
+        udp.poll_event = host_event_schedule(time_us_64() + HOST_UDP_POLL_MS * 1000, _udp_poll_, NULL);
+    }
+}
+
+struct udp_pcb *udp_new(void)
+{
+    struct udp_pcb *pcb = NULL;
+
+    for(int i = 0; i < HOST_MAX_UDP_PCBS && pcb == NULL; i++){
+        if(!udp.pcbs[i].used){
+            pcb = &udp.pcbs[i];
+        }
+    }
+
+    if(pcb == NULL || !_memp_alloc_(MEMP_UDP_PCB)){
+        return NULL;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if(fd < 0){
+        perror("host: socket");
+        _memp_free_(MEMP_UDP_PCB);
+        return NULL;
+    }
+
+    // Instances on one machine share the port, and see each other's
+    // multicast over the loopback interface
+    int on = 1;
+    struct in_addr loopback = {.s_addr = htonl(INADDR_LOOPBACK)};
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &on, sizeof(on));
+
+    *pcb = (struct udp_pcb){.used = true, .fd = fd, .owner = state.owner};
+
+    for(int i = 0; i < udp.n_groups; i++){
+        _udp_join_(pcb, &udp.groups[i]);
+    }
+
+    if(udp.poll_event == 0){
+        udp.poll_event = host_event_schedule(time_us_64() + HOST_UDP_POLL_MS * 1000, _udp_poll_, NULL);
+    }
+
+    return pcb;
+}
+
+void udp_remove(struct udp_pcb *pcb)
+{
+    close(pcb->fd);
+    pcb->used = false;
+    _memp_free_(MEMP_UDP_PCB);
+}
+
+err_t udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = ip_addr_isany(ipaddr) ? htonl(INADDR_ANY) : ipaddr->addr
+    };
+
+    if(bind(pcb->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+        perror("host: bind");
+        return ERR_USE;
+    }
+
+    return ERR_OK;
+}
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg)
+{
+    pcb->recv = recv;
+    pcb->arg = recv_arg;
+}
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *dst_ip, u16_t dst_port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(dst_port),
+        .sin_addr.s_addr = dst_ip->addr
+    };
+
+    if(sendto(pcb->fd, p->payload, p->tot_len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        return ERR_MEM;
+    }
+
+    _transfer_(false, p->tot_len);
+
+    return ERR_OK;
+}
+
+err_t igmp_joingroup(const ip4_addr_t *ifaddr, const ip4_addr_t *groupaddr)
+{
+    // Joined for every pcb already, by an earlier instance
+    for(int i = 0; i < udp.n_groups; i++){
+        if(udp.groups[i].addr == groupaddr->addr){
+            return ERR_OK;
+        }
+    }
+
+    if(udp.n_groups == HOST_MAX_GROUPS){
+        return ERR_MEM;
+    }
+
+    udp.groups[udp.n_groups++] = *groupaddr;
+
+    for(int i = 0; i < HOST_MAX_UDP_PCBS; i++){
+        if(udp.pcbs[i].used){
+            _udp_join_(&udp.pcbs[i], groupaddr);
+        }
+    }
+
+    return ERR_OK;
+}
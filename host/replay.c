@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "lwip/err.h"
+#include "lwip/apps/http_client.h"
+
+#include "host.h"
+#include "record.h"
+#include "wifi.h"
+
+/*
+Replay of a session recorded with BASESTATION_RECORD.
+
+Usage: replay <capture>
+
+The capture is the USB serial output of the session. Lines other than
+the record log are ignored. The firmware main loop runs against the
+simulated board while the log is fed back at the recorded times:
+
+- key presses are pressed on the keypad model
+- WiFi disconnects take the access points away until the next connect
+- HTTP responses answer the firmware's requests in recorded order.
+  Requests that timed out are never answered and refused connections
+  are refused again
+
+Everything runs on the virtual clock, so two replays of a log give the
+same output byte for byte. The summary at the end (display hash, cycles,
+GPIO accesses) is meant for bisecting regressions against real traffic.
+*/
+
+// Time a key is held down
+#define REPLAY_KEY_HOLD_MS 50
+
+// Time the firmware keeps running after the last record
+#define REPLAY_TAIL_MS 15000
+
+// Longest line in a capture
+#define REPLAY_LINE 4096
+
+// The firmware main loop, built from BaseStation.c with main renamed
+int basestation_main();
+
+typedef struct{
+    uint32_t time_ms;
+    uint8_t type;
+    uint16_t length;
+    uint8_t *payload;
+} ReplayRecord;
+
+typedef struct{
+    // HTTP status, 0 to never answer, negative to refuse
+    int status;
+    char *body;
+} ReplayResponse;
+
+static struct ReplayState{
+    ReplayRecord *records;
+    uint32_t n_records;
+
+    ReplayResponse *responses;
+    uint32_t n_responses;
+    uint32_t next_response;
+
+    // Next key or WiFi record to replay
+    uint32_t next_input;
+    int release_event;
+    bool networks_down;
+
+    uint32_t keys;
+    uint32_t wifi_events;
+} state;
+
+static int _hex_(char c)
+{
+    if(c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f'){
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F'){
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Decode one "R <hex>" line. Returns -1 if the line is damaged
+static int _parse_record_(const char *hex, ReplayRecord *record)
+{
+    uint8_t bytes[7 + RECORD_MAX_PAYLOAD];
+    size_t n = 0;
+
+    while(_hex_(hex[0]) >= 0 && _hex_(hex[1]) >= 0 && n < sizeof(bytes)){
+        bytes[n++] = _hex_(hex[0]) << 4 | _hex_(hex[1]);
+        hex += 2;
+    }
+
+    if(n < 7){
+        return -1;
+    }
+
+    record->time_ms = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    record->type = bytes[4];
+    record->length = bytes[5] | bytes[6] << 8;
+
+    if(record->type >= RECORD_TYPES || record->length != n - 7){
+        return -1;
+    }
+
+    record->payload = malloc(record->length + 1);
+    memcpy(record->payload, &bytes[7], record->length);
+    record->payload[record->length] = '\0';
+
+    return 0;
+}
+
+static int _load_(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL){
+        perror(path);
+        return -1;
+    }
+
+    static char line[REPLAY_LINE];
+    bool header = false;
+    uint32_t line_no = 0;
+
+    while(fgets(line, sizeof(line), file) != NULL){
+        line_no++;
+
+        int version;
+        if(sscanf(line, "RECORD %d", &version) == 1){
+            if(version != RECORD_VERSION){
+                fprintf(stderr, "%s:%lu: log version %d, expected %d\n", path, (unsigned long)line_no, version, RECORD_VERSION);
+                fclose(file);
+                return -1;
+            }
+
+            // A new header means the board rebooted. Replay the last boot
+            for(uint32_t i = 0; i < state.n_records; i++){
+                free(state.records[i].payload);
+            }
+            state.n_records = 0;
+            header = true;
+            continue;
+        }
+
+        if(!header || strncmp(line, "R ", 2) != 0){
+            continue;
+        }
+
+        ReplayRecord record;
+        if(_parse_record_(&line[2], &record) != 0){
+            fprintf(stderr, "%s:%lu: damaged record skipped\n", path, (unsigned long)line_no);
+            continue;
+        }
+
+        state.records = realloc(state.records, (state.n_records + 1) * sizeof(ReplayRecord));
+        state.records[state.n_records++] = record;
+    }
+
+    fclose(file);
+
+    if(!header){
+        fprintf(stderr, "%s: no RECORD header found\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Pair each result with the body received before it on the same station
+static void _build_responses_()
+{
+    const char *bodies[256] = {0};
+
+    state.responses = calloc(state.n_records + 1, sizeof(ReplayResponse));
+
+    for(uint32_t i = 0; i < state.n_records; i++){
+        const ReplayRecord *record = &state.records[i];
+
+        if(record->type == RECORD_HTTP_BODY && record->length >= 1){
+            bodies[record->payload[0]] = (const char *)&record->payload[1];
+        }
+        else if(record->type == RECORD_HTTP_RESULT && record->length == 5){
+            uint8_t station = record->payload[0];
+            uint8_t result = record->payload[1];
+            int8_t err = record->payload[2];
+            uint16_t srv_res = record->payload[3] | record->payload[4] << 8;
+
+            ReplayResponse *response = &state.responses[state.n_responses++];
+
+            if(result == HTTPC_RESULT_OK){
+                response->status = srv_res;
+            }
+            else if(result == HTTPC_RESULT_ERR_TIMEOUT || err == ERR_ABRT){
+                response->status = 0;
+            }
+            else{
+                response->status = -1;
+            }
+
+            response->body = strdup(bodies[station] != NULL ? bodies[station] : "");
+            bodies[station] = NULL;
+        }
+    }
+}
+
+static int _handler_(const char *uri, char *body, size_t size)
+{
+    // Past the end of the recording the server is gone
+    if(state.next_response == state.n_responses){
+        return -1;
+    }
+
+    const ReplayResponse *response = &state.responses[state.next_response++];
+    snprintf(body, size, "%s", response->body);
+
+    return response->status;
+}
+
+static void _finish_(void *arg)
+{
+    printf("REPLAY end at %lu ms: %lu keys, %lu WiFi events, %lu of %lu responses\n",
+        (unsigned long)to_ms_since_boot(get_absolute_time()), (unsigned long)state.keys,
+        (unsigned long)state.wifi_events, (unsigned long)state.next_response, (unsigned long)state.n_responses);
+    printf("REPLAY display hash %08lx, %lu writes, %lu GPIO accesses, %llu cycles\n",
+        (unsigned long)host_display_hash(), (unsigned long)host_display_writes(),
+        (unsigned long)host_gpio_accesses(), (unsigned long long)host_cycles());
+    printf("REPLAY |%s|\n", host_display_row(0));
+    printf("REPLAY |%s|\n", host_display_row(1));
+
+    exit(0);
+}
+
+static void _release_(void *arg)
+{
+    state.release_event = 0;
+    host_keypad_press(0);
+}
+
+static void _schedule_next_(uint32_t from);
+
+static void _input_(void *arg)
+{
+    const ReplayRecord *record = &state.records[state.next_input];
+
+    if(record->type == RECORD_KEY){
+        host_event_cancel(state.release_event);
+        host_keypad_press(record->payload[0]);
+        state.keys++;
+
+        // Release before the next key so every press is an edge
+        uint32_t hold_ms = REPLAY_KEY_HOLD_MS;
+        for(uint32_t i = state.next_input + 1; i < state.n_records; i++){
+            if(state.records[i].type == RECORD_KEY){
+                uint32_t gap_ms = state.records[i].time_ms - record->time_ms;
+                if(gap_ms / 2 < hold_ms){
+                    hold_ms = gap_ms / 2;
+                }
+                break;
+            }
+        }
+
+        state.release_event = host_event_schedule(time_us_64() + hold_ms * 1000, _release_, NULL);
+    }
+    else if(record->payload[0] == WIFI_EVENT_DISCONNECTED){
+        host_wifi_clear_networks();
+        state.networks_down = true;
+        state.wifi_events++;
+    }
+    else if(record->payload[0] == WIFI_EVENT_CONNECTED){
+        if(state.networks_down){
+            host_board_add_networks();
+            state.networks_down = false;
+        }
+        state.wifi_events++;
+    }
+
+    _schedule_next_(state.next_input + 1);
+}
+
+// Keys and WiFi events are scheduled one at a time, so long logs do not
+// fill the event table
+static void _schedule_next_(uint32_t from)
+{
+    for(state.next_input = from; state.next_input < state.n_records; state.next_input++){
+        const ReplayRecord *record = &state.records[state.next_input];
+
+        if((record->type == RECORD_KEY || record->type == RECORD_WIFI) && record->length == 1){
+            host_event_schedule((uint64_t)record->time_ms * 1000, _input_, NULL);
+            return;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if(argc != 2){
+        fprintf(stderr, "Usage: %s <capture>\n", argv[0]);
+        return 2;
+    }
+
+    if(_load_(argv[1]) != 0){
+        return 1;
+    }
+
+    _build_responses_();
+
+    // The console must not read from the terminal, or replays would differ
+    if(freopen("/dev/null", "r", stdin) == NULL){
+        perror("stdin");
+        return 1;
+    }
+
+    host_http_set_handler(_handler_);
+
+    uint32_t end_ms = state.n_records > 0 ? state.records[state.n_records - 1].time_ms : 0;
+    host_event_schedule((uint64_t)(end_ms + REPLAY_TAIL_MS) * 1000, _finish_, NULL);
+
+    _schedule_next_(0);
+
+    return basestation_main();
+}
@@ -0,0 +1,76 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "host.h"
+#include "display.h"
+#include "view.h"
+#include "keypad.h"
+#include "kvstore.h"
+#include "wifi.h"
+
+/*
+Checks for the host tests, which ctest runs from the host build.
+
+Each test is a program against the simulated board. A failed check
+prints where it failed and the test goes on, so one run shows every
+failure. test_result() is the exit status of the test.
+*/
+
+static int test_checks;
+static int test_failures;
+
+#define CHECK(expr) _test_check_((expr), #expr, __FILE__, __LINE__)
+
+// Floats read back from the modules are compared to a tolerance
+#define CHECK_NEAR(a, b) _test_check_(fabsf((float)(a) - (float)(b)) < 1e-3f, #a " == " #b, __FILE__, __LINE__)
+
+static inline void _test_check_(int ok, const char *expr, const char *file, int line)
+{
+    test_checks++;
+
+    if(!ok){
+        test_failures++;
+        printf("%s:%d: check failed: %s\n", file, line, expr);
+    }
+}
+
+#define TEST_RUN(test) (printf("-- %s\n", #test), test())
+
+static inline int test_result()
+{
+    printf("%d checks, %d failed\n", test_checks, test_failures);
+
+    return test_failures > 0 ? 1 : 0;
+}
+
+/**
+ * @brief Bring up the board as the firmware does before its main loop
+ */
+static inline void test_board_init()
+{
+    stdio_init_all();
+    init_display(host_board_display);
+    view_init();
+    init_keypad(host_board_keypad, host_board_key_matrix);
+    kv_init(&kv_flash_pico);
+}
+
+/**
+ * @brief Join the default network of the simulated board
+ */
+static inline void test_wifi_connect()
+{
+    init_wifi();
+    wifi_start_auto_connect();
+
+    while(wifi_poll() != WIFI_EVENT_CONNECTED){
+        sleep_ms(1);
+    }
+}
+
+#endif //HOST_TEST_H
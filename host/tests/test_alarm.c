@@ -0,0 +1,155 @@
+#include "test.h"
+#include "alarm.h"
+
+/*
+Alarm rules fed flapping and stale input. Time is passed to the engine
+directly, so no board is needed.
+*/
+
+// Time between readings of a station
+#define TEST_POLL_MS 10000
+
+static uint32_t now_ms;
+
+static enum alarm_severity _reading_(float temp)
+{
+    WeatherStationData data = {.temp = temp};
+
+    now_ms += TEST_POLL_MS;
+    return alarm_update(0, &data, now_ms);
+}
+
+static void _set_rule_(float threshold, float hysteresis, uint32_t holdoff_ms)
+{
+    AlarmRule rule = {
+        .metric = METRIC_TEMP,
+        .op = ALARM_ABOVE,
+        .severity = ALARM_WARNING,
+        .threshold = threshold,
+        .hysteresis = hysteresis,
+        .holdoff_ms = holdoff_ms
+    };
+
+    CHECK(alarm_set_rule(0, &rule) == 0);
+}
+
+// Start each test from a station with no alarm and a stale past
+static void _reset_()
+{
+    now_ms += ALARM_STALE_MS;
+    alarm_tick(now_ms);
+}
+
+static void test_hysteresis_flapping()
+{
+    _reset_();
+    _set_rule_(30, 1, 0);
+
+    CHECK(_reading_(31) == ALARM_WARNING);
+
+    // Hovering at the limit, within the hysteresis, keeps the alarm
+    int changes = 0;
+    bool active = true;
+
+    for(int i = 0; i < 20; i++){
+        _reading_(i % 2 ? 30.5f : 29.5f);
+
+        changes += alarm_rule_active(0, 0) != active;
+        active = alarm_rule_active(0, 0);
+    }
+
+    CHECK(changes == 0);
+    CHECK(active);
+
+    // Cleared once past the hysteresis
+    CHECK(_reading_(28.9f) == ALARM_NONE);
+}
+
+static void test_holdoff_flapping()
+{
+    _reset_();
+    _set_rule_(30, 0, 3 * TEST_POLL_MS);
+
+    // The condition never holds for the hold-off time
+    for(int i = 0; i < 21; i++){
+        CHECK(_reading_(i % 3 == 2 ? 25 : 35) == ALARM_NONE);
+        CHECK(alarm_tick(now_ms + TEST_POLL_MS / 2) == ALARM_NONE);
+    }
+
+    // Raised once it holds long enough
+    for(int i = 0; i < 3; i++){
+        CHECK(_reading_(35) == ALARM_NONE);
+    }
+    CHECK(_reading_(35) == ALARM_WARNING);
+}
+
+static void test_holdoff_between_readings()
+{
+    _reset_();
+    _set_rule_(30, 0, 25000);
+
+    CHECK(_reading_(35) == ALARM_NONE);
+    uint32_t reading_ms = now_ms;
+
+    // The station goes quiet. The alarm is raised on time anyway
+    CHECK(alarm_tick(reading_ms + 24999) == ALARM_NONE);
+    CHECK(alarm_tick(reading_ms + 25000) == ALARM_WARNING);
+    CHECK(alarm_rule_active(0, 0));
+}
+
+static void test_stale_input_clears()
+{
+    _reset_();
+    _set_rule_(30, 1, 0);
+
+    CHECK(_reading_(35) == ALARM_WARNING);
+    uint32_t reading_ms = now_ms;
+
+    // Still raised while the reading is recent
+    CHECK(alarm_tick(reading_ms + ALARM_STALE_MS - 1) == ALARM_WARNING);
+
+    // The station stopped reporting, its alarm is dropped
+    CHECK(alarm_tick(reading_ms + ALARM_STALE_MS) == ALARM_NONE);
+    CHECK(!alarm_rule_active(0, 0));
+    CHECK(alarm_severity() == ALARM_NONE);
+
+    // A fresh reading is evaluated from scratch
+    now_ms = reading_ms + ALARM_STALE_MS;
+    CHECK(_reading_(35) == ALARM_WARNING);
+}
+
+static void test_stale_rate()
+{
+    _reset_();
+
+    AlarmRule rule = {
+        .metric = METRIC_TEMP,
+        .op = ALARM_RATE,
+        .severity = ALARM_CRITICAL,
+        .threshold = 1
+    };
+    CHECK(alarm_set_rule(0, &rule) == 0);
+
+    CHECK(_reading_(10) == ALARM_NONE);
+
+    // A jump after a long silence is not a rate of change
+    now_ms += ALARM_STALE_MS;
+    alarm_tick(now_ms);
+    CHECK(_reading_(20) == ALARM_NONE);
+
+    // A jump between two readings is
+    CHECK(_reading_(30) == ALARM_CRITICAL);
+
+    alarm_clear_rule(0);
+}
+
+int main()
+{
+    TEST_RUN(test_hysteresis_flapping);
+    TEST_RUN(test_holdoff_flapping);
+    TEST_RUN(test_holdoff_between_readings);
+    TEST_RUN(test_stale_input_clears);
+    TEST_RUN(test_stale_rate);
+
+    return test_result();
+}
@@ -0,0 +1,150 @@
+#include "test.h"
+#include "buzzer.h"
+
+/*
+Buzzer patterns played by the alarm driven sequencer, checked against
+the simulated clock. The PWM output is sampled every millisecond and
+each change of note is compared with the pattern tables.
+*/
+
+#define TEST_BUZZER_PIN 26
+
+// Max note changes recorded in one run
+#define TEST_MAX_EDGES 64
+
+typedef struct{
+    uint32_t ms;
+    enum buzzer_note note;
+} Edge;
+
+static Edge edges[TEST_MAX_EDGES];
+static int n_edges;
+
+static enum buzzer_note _output_()
+{
+    return host_pwm_level(TEST_BUZZER_PIN) > 0 ? host_pwm_wrap(TEST_BUZZER_PIN) : REST;
+}
+
+// Play pattern and record the output for ms, up to but not including ms
+static void _record_(enum buzzer_pattern pattern, uint32_t ms)
+{
+    buzzer_play(BUZZER_PATTERN_NONE);
+    buzzer_play(pattern);
+
+    uint64_t start_us = time_us_64();
+    enum buzzer_note note = _output_();
+
+    n_edges = 0;
+    edges[n_edges++] = (Edge){0, note};
+
+    for(uint32_t t = 1; t < ms; t++){
+        sleep_ms(1);
+
+        if(_output_() != note && n_edges < TEST_MAX_EDGES){
+            note = _output_();
+            edges[n_edges++] = (Edge){(time_us_64() - start_us) / 1000, note};
+        }
+    }
+}
+
+// Check the recorded edges against expected notes and start times
+static void _check_edges_(const Edge *expected, int n)
+{
+    CHECK(n_edges == n);
+
+    for(int i = 0; i < n && i < n_edges; i++){
+        if(edges[i].ms != expected[i].ms || edges[i].note != expected[i].note){
+            printf("edge %d: %u ms note %d, expected %u ms note %d\n",
+                i, edges[i].ms, edges[i].note, expected[i].ms, expected[i].note);
+        }
+
+        CHECK(edges[i].ms == expected[i].ms);
+        CHECK(edges[i].note == expected[i].note);
+    }
+}
+
+static void test_info_beep()
+{
+    _record_(BUZZER_PATTERN_INFO, 500);
+
+    const Edge expected[] = {{0, C}, {100, REST}};
+    _check_edges_(expected, 2);
+
+    CHECK(!buzzer_is_playing());
+}
+
+static void test_warning_repeats_without_drift()
+{
+    // Ten periods of 1 s
+    _record_(BUZZER_PATTERN_WARNING, 10000);
+
+    Edge expected[20];
+    for(int i = 0; i < 10; i++){
+        expected[2 * i] = (Edge){i * 1000, A};
+        expected[2 * i + 1] = (Edge){i * 1000 + 200, REST};
+    }
+
+    _check_edges_(expected, 20);
+    CHECK(buzzer_is_playing());
+}
+
+static void test_critical_triple_beep()
+{
+    _record_(BUZZER_PATTERN_CRITICAL, 1600);
+
+    // The rests between beeps are the only edges, G stays set
+    const Edge expected[] = {
+        {0, G}, {100, REST}, {150, G}, {250, REST}, {300, G}, {400, REST},
+        {800, G}, {900, REST}, {950, G}, {1050, REST}, {1100, G}, {1200, REST}
+    };
+    _check_edges_(expected, 12);
+}
+
+static void test_pattern_change()
+{
+    // Critical takes over from warning at once, with nothing of the
+    // warning left running
+    buzzer_play(BUZZER_PATTERN_WARNING);
+    sleep_ms(500);
+
+    _record_(BUZZER_PATTERN_CRITICAL, 800);
+
+    const Edge expected[] = {{0, G}, {100, REST}, {150, G}, {250, REST}, {300, G}, {400, REST}};
+    _check_edges_(expected, 6);
+
+    // Stopping silences the output and the sequencer
+    buzzer_play(BUZZER_PATTERN_NONE);
+    CHECK(_output_() == REST);
+    CHECK(!buzzer_is_playing());
+
+    sleep_ms(2000);
+    CHECK(_output_() == REST);
+}
+
+static void test_volume()
+{
+    buzzer_set_volume(50);
+    buzzer_play(BUZZER_PATTERN_NONE);
+    buzzer_play(BUZZER_PATTERN_WARNING);
+
+    // 100 % is a 50 % duty cycle
+    CHECK(host_pwm_wrap(TEST_BUZZER_PIN) == A);
+    CHECK(host_pwm_level(TEST_BUZZER_PIN) == A / 4);
+
+    buzzer_play(BUZZER_PATTERN_NONE);
+    buzzer_set_volume(BUZZER_DEFAULT_VOLUME);
+}
+
+int main()
+{
+    stdio_init_all();
+    init_buzzer(TEST_BUZZER_PIN);
+
+    TEST_RUN(test_info_beep);
+    TEST_RUN(test_warning_repeats_without_drift);
+    TEST_RUN(test_critical_triple_beep);
+    TEST_RUN(test_pattern_change);
+    TEST_RUN(test_volume);
+
+    return test_result();
+}
@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include "test.h"
+#include "kvstore.h"
+
+/*
+Power lost in the middle of kvstore writes. Each test cuts power at
+every flash operation of a write in turn, reboots with kv_init and checks
+that no key was lost and the store still takes writes.
+*/
+
+// Writes of the counter key that fill the log and start a compaction
+#define TEST_KV_WRITES 200
+
+static const char ssid[] = "Chrillbob's Hotspot";
+static const uint8_t limits[] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+// Largest value, so a record spans more than one page
+static void _value_(uint32_t i, uint8_t value[KV_MAX_VALUE_SIZE])
+{
+    memset(value, i & 0xff, KV_MAX_VALUE_SIZE);
+    memcpy(value, &i, sizeof(i));
+}
+
+// Returns the counter stored under key or -1
+static int _counter_(const char *key)
+{
+    uint8_t value[KV_MAX_VALUE_SIZE];
+    uint8_t expected[KV_MAX_VALUE_SIZE];
+
+    if(kv_get(key, value, sizeof(value)) != KV_MAX_VALUE_SIZE){
+        return -1;
+    }
+
+    uint32_t i;
+    memcpy(&i, value, sizeof(i));
+    _value_(i, expected);
+
+    return memcmp(value, expected, sizeof(value)) == 0 ? (int)i : -1;
+}
+
+static void _set_counter_(const char *key, uint32_t i)
+{
+    uint8_t value[KV_MAX_VALUE_SIZE];
+    _value_(i, value);
+    kv_set(key, value, sizeof(value));
+}
+
+// New board with the keys that are written once
+static void _format_()
+{
+    host_flash_power_on();
+    host_flash_reset();
+    kv_init(&kv_flash_pico);
+
+    kv_set("wifi_ssid", ssid, sizeof(ssid));
+    kv_set("buzz_limits", limits, sizeof(limits));
+}
+
+static void _reboot_()
+{
+    host_flash_power_on();
+    CHECK(kv_init(&kv_flash_pico) == KV_ERR_OK);
+}
+
+// Keys written once must survive every cut
+static void _check_static_keys_()
+{
+    char ssid_read[sizeof(ssid)] = "";
+    uint8_t limits_read[sizeof(limits)] = {0};
+
+    CHECK(kv_get("wifi_ssid", ssid_read, sizeof(ssid_read)) == sizeof(ssid));
+    CHECK(strcmp(ssid_read, ssid) == 0);
+    CHECK(kv_get("buzz_limits", limits_read, sizeof(limits_read)) == sizeof(limits));
+    CHECK(memcmp(limits_read, limits, sizeof(limits)) == 0);
+}
+
+// The store takes writes after the cut, and they survive the next reboot
+static void _check_writable_(uint32_t i)
+{
+    _set_counter_("counter", i);
+    _reboot_();
+
+    CHECK(_counter_("counter") == (int)i);
+    _check_static_keys_();
+}
+
+static void test_interrupted_write()
+{
+    int cuts = 0;
+
+    for(uint32_t cut = 0; ; cut++){
+        _format_();
+        _set_counter_("counter", 1);
+
+        host_flash_cut_after(cut);
+        _set_counter_("counter", 2);
+        bool lost = host_flash_power_lost();
+
+        _reboot_();
+
+        // The old value until the record is complete, never a mix
+        int counter = _counter_("counter");
+        CHECK(counter == 1 || counter == 2);
+        CHECK(lost || counter == 2);
+        _check_static_keys_();
+
+        _check_writable_(3);
+
+        if(!lost){
+            break;
+        }
+        cuts++;
+    }
+
+    // The record spans pages, so there is more than one place to tear it
+    CHECK(cuts > 1);
+}
+
+static void test_interrupted_compaction()
+{
+    // Find the write that compacts the oldest sector
+    _format_();
+
+    uint32_t compacting = 0;
+    uint32_t operations = 0;
+
+    for(uint32_t i = 0; i < TEST_KV_WRITES && compacting == 0; i++){
+        uint32_t erases = kv_erase_count();
+        uint32_t start = host_flash_erases() + host_flash_programs();
+
+        _set_counter_("counter", i);
+
+        // The new head sector and the compacted one are both erased
+        if(kv_erase_count() - erases > 1){
+            compacting = i;
+            operations = host_flash_erases() + host_flash_programs() - start;
+        }
+    }
+
+    CHECK(compacting > 0);
+
+    for(uint32_t cut = 0; cut < operations; cut++){
+        _format_();
+
+        for(uint32_t i = 0; i < compacting; i++){
+            _set_counter_("counter", i);
+        }
+
+        host_flash_cut_after(cut);
+        _set_counter_("counter", compacting);
+        CHECK(host_flash_power_lost());
+
+        _reboot_();
+
+        int counter = _counter_("counter");
+        CHECK(counter == (int)compacting - 1 || counter == (int)compacting);
+        _check_static_keys_();
+
+        // Keep going through the next compactions
+        for(uint32_t i = 1; i <= TEST_KV_WRITES; i++){
+            _set_counter_("counter", compacting + i);
+        }
+        CHECK(_counter_("counter") == (int)(compacting + TEST_KV_WRITES));
+
+        _reboot_();
+
+        CHECK(_counter_("counter") == (int)(compacting + TEST_KV_WRITES));
+        _check_static_keys_();
+    }
+}
+
+int main()
+{
+    test_board_init();
+
+    TEST_RUN(test_interrupted_write);
+    TEST_RUN(test_interrupted_compaction);
+
+    return test_result();
+}
@@ -0,0 +1,282 @@
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "server_interface.h"
+
+/*
+Base stations in peer mode, all in one process. The module state of each
+is swapped in before it runs and before its network callbacks run, as in
+the fleet simulator, and their datagrams meet on the loopback interface.
+*/
+
+#define TEST_NODES 3
+
+// Time between main loop passes
+#define TEST_TICK_MS 10
+
+#define TEST_POLL_MS 5000
+
+enum upstream{UPSTREAM_UP, UPSTREAM_REFUSED, UPSTREAM_HANGING};
+
+static struct{
+    uint8_t *live;
+    uint8_t *states;
+    size_t size;
+    int loaded;
+
+    uint32_t next_request_ms[TEST_NODES];
+    enum upstream upstream[TEST_NODES];
+    uint32_t requests[TEST_NODES];
+} nodes = {.loaded = -1};
+
+static void _switch_(int node)
+{
+    if(node == nodes.loaded){
+        return;
+    }
+
+    if(nodes.loaded >= 0){
+        memcpy(nodes.states + nodes.loaded * nodes.size, nodes.live, nodes.size);
+    }
+
+    memcpy(nodes.live, nodes.states + node * nodes.size, nodes.size);
+    nodes.loaded = node;
+
+    host_net_set_owner(node);
+}
+
+// The server as seen by the node making the request
+static int _handler_(const char *uri, char *body, size_t size)
+{
+    nodes.requests[nodes.loaded]++;
+
+    switch(nodes.upstream[nodes.loaded]){
+    case UPSTREAM_REFUSED:
+        return -1;
+    case UPSTREAM_HANGING:
+        return 0;
+    default:
+        snprintf(body, size, "{\"temp\":21.5,\"humidity\":45.0,\"wind_speed\":3.2}");
+        return 200;
+    }
+}
+
+// Run the main loop of every node for ms
+static void _run_(uint32_t ms)
+{
+    for(uint32_t t = 0; t < ms; t += TEST_TICK_MS){
+        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+
+        for(int i = 0; i < TEST_NODES; i++){
+            _switch_(i);
+
+            if(now_ms >= nodes.next_request_ms[i]){
+                request_last_data();
+                nodes.next_request_ms[i] = now_ms + server_next_poll_ms();
+            }
+
+            server_poll();
+        }
+
+        sleep_ms(TEST_TICK_MS);
+    }
+}
+
+static PeerStats _stats_(int node)
+{
+    _switch_(node);
+    return get_peer_stats();
+}
+
+// The one node leading, with the others following it. -1 if there is none
+static int _leader_()
+{
+    int leader = -1;
+
+    for(int i = 0; i < TEST_NODES; i++){
+        if(_stats_(i).leader == 0){
+            if(leader >= 0){
+                return -1;
+            }
+            leader = i;
+        }
+    }
+
+    for(int i = 0; i < TEST_NODES && leader >= 0; i++){
+        if(i != leader && _stats_(i).leader != _stats_(leader).node){
+            return -1;
+        }
+    }
+
+    return leader;
+}
+
+// Every node has a reading younger than ms
+static bool _fresh_(int32_t ms)
+{
+    for(int i = 0; i < TEST_NODES; i++){
+        _switch_(i);
+        int32_t age_ms = get_station_data_age_ms(0);
+
+        if(age_ms < 0 || age_ms > ms){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void test_one_leader_polls()
+{
+    _run_(3 * TEST_POLL_MS);
+
+    int leader = _leader_();
+    CHECK(leader >= 0);
+
+    // The lowest id leads
+    for(int i = 0; i < TEST_NODES; i++){
+        CHECK(_stats_(leader).node <= _stats_(i).node);
+    }
+
+    memset(nodes.requests, 0, sizeof(nodes.requests));
+    _run_(4 * TEST_POLL_MS);
+
+    for(int i = 0; i < TEST_NODES; i++){
+        CHECK(i == leader ? nodes.requests[i] > 0 : nodes.requests[i] == 0);
+        CHECK(i == leader || _stats_(i).received > 0);
+    }
+
+    CHECK(_fresh_(TEST_POLL_MS));
+}
+
+static void test_forged_datagram()
+{
+    // Announcement from the lowest node id there is, with a made up MAC.
+    // Same layout as PeerPacket in server_interface.c
+    struct{
+        uint32_t magic;
+        uint8_t version;
+        uint8_t type;
+        uint8_t station;
+        uint8_t n_metrics;
+        uint32_t node;
+        uint32_t seq;
+        uint8_t flags;
+        uint8_t reserved[3];
+        float values[METRICS];
+        uint64_t mac;
+    } packet = {.magic = 0x53425057, .version = 2, .n_metrics = METRICS, .node = 1, .mac = 0x0123456789abcdefULL};
+
+    struct sockaddr_in group = {.sin_family = AF_INET, .sin_port = htons(PEER_PORT)};
+    struct in_addr loopback = {.s_addr = htonl(INADDR_LOOPBACK)};
+    inet_pton(AF_INET, PEER_GROUP, &group.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+    CHECK(sendto(fd, &packet, sizeof(packet), 0, (struct sockaddr *)&group, sizeof(group)) == sizeof(packet));
+    close(fd);
+
+    int leader = _leader_();
+    _run_(1000);
+
+    CHECK(_leader_() == leader);
+
+    for(int i = 0; i < TEST_NODES; i++){
+        CHECK(_stats_(i).rejected == 1);
+    }
+}
+
+static void test_leader_loses_server()
+{
+    int leader = _leader_();
+    CHECK(leader >= 0);
+
+    // The leader's requests are never answered. The followers stop
+    // waiting for its readings before it gives up on the server
+    nodes.upstream[leader] = UPSTREAM_HANGING;
+    _run_(PEER_STALE_POLLS * TEST_POLL_MS + PEER_TIMEOUT_MS + 2 * TEST_POLL_MS);
+
+    for(int i = 0; i < TEST_NODES; i++){
+        CHECK(i == leader || _stats_(i).fallbacks > 0);
+    }
+
+    // Its failures add up and a node that reaches the server takes over
+    _run_(30 * TEST_POLL_MS);
+
+    int next = _leader_();
+    CHECK(next >= 0 && next != leader);
+
+    for(int i = 0; i < TEST_NODES; i++){
+        CHECK(i == leader || _stats_(i).step_downs > 0);
+    }
+
+    // Readings come from the new leader again
+    memset(nodes.requests, 0, sizeof(nodes.requests));
+    _run_(4 * TEST_POLL_MS);
+
+    for(int i = 0; i < TEST_NODES; i++){
+        CHECK(i == next ? nodes.requests[i] > 0 : nodes.requests[i] == 0);
+    }
+
+    CHECK(_fresh_(TEST_POLL_MS));
+    nodes.upstream[leader] = UPSTREAM_UP;
+}
+
+static void test_no_node_reaches_server()
+{
+    // The lowest id leads again when all of them are off the server
+    for(int i = 0; i < TEST_NODES; i++){
+        nodes.upstream[i] = UPSTREAM_REFUSED;
+    }
+    _run_(30 * TEST_POLL_MS);
+
+    int leader = _leader_();
+    CHECK(leader >= 0);
+
+    for(int i = 0; i < TEST_NODES; i++){
+        CHECK(_stats_(leader).node <= _stats_(i).node);
+        nodes.upstream[i] = UPSTREAM_UP;
+    }
+
+    // and keeps trying, so readings come back with the server
+    _run_(4 * TEST_POLL_MS);
+
+    CHECK(_leader_() == leader);
+    CHECK(_fresh_(TEST_POLL_MS));
+}
+
+int main()
+{
+    test_board_init();
+    test_wifi_connect();
+
+    host_http_set_handler(_handler_);
+
+    ServerPolicy policy = server_get_policy();
+    policy.poll_interval_ms = TEST_POLL_MS;
+
+    // Every node starts from the boot state of the module
+    nodes.live = server_state(&nodes.size);
+    nodes.states = malloc(TEST_NODES * nodes.size);
+
+    for(int i = 0; i < TEST_NODES; i++){
+        memcpy(nodes.states + i * nodes.size, nodes.live, nodes.size);
+
+        _switch_(i);
+        server_set_policy(&policy);
+        server_warm_dns();
+    }
+
+    host_net_set_switch(_switch_);
+
+    TEST_RUN(test_one_leader_polls);
+    TEST_RUN(test_forged_datagram);
+    TEST_RUN(test_leader_loses_server);
+    TEST_RUN(test_no_node_reaches_server);
+
+    return test_result();
+}
@@ -0,0 +1,120 @@
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "test.h"
+#include "seqlock.h"
+
+/*
+One writer and several readers hammer a seqlock from host threads, as
+core 1 and core 0 would on the board. Every word of a snapshot is
+written with its generation, so a torn snapshot has words that differ
+from each other or from the generation the read returned.
+*/
+
+#define TEST_WRITES 2000000
+#define TEST_READERS 3
+
+// Larger than a reading, so a copy is far from atomic
+#define TEST_WORDS 64
+
+typedef struct{
+    uint32_t word[TEST_WORDS];
+} Snapshot;
+
+static seqlock_t lock;
+static Snapshot shared;
+
+static atomic_bool writing;
+
+typedef struct{
+    uint32_t reads;
+    uint32_t torn;
+    uint32_t backwards;
+    uint32_t generations;
+} ReaderResult;
+
+static void *_writer_(void *arg)
+{
+    Snapshot snapshot;
+
+    for(uint32_t generation = 1; generation <= TEST_WRITES; generation++){
+        for(int i = 0; i < TEST_WORDS; i++){
+            snapshot.word[i] = generation;
+        }
+
+        seqlock_write(&lock, &shared, &snapshot, sizeof(snapshot));
+    }
+
+    atomic_store(&writing, false);
+
+    return NULL;
+}
+
+static void *_reader_(void *arg)
+{
+    ReaderResult *result = arg;
+    uint32_t last = 0;
+
+    while(atomic_load(&writing)){
+        Snapshot snapshot;
+        uint32_t generation = seqlock_read(&lock, &snapshot, &shared, sizeof(snapshot));
+
+        result->reads++;
+
+        for(int i = 0; i < TEST_WORDS; i++){
+            if(snapshot.word[i] != generation){
+                result->torn++;
+                break;
+            }
+        }
+
+        if(generation < last){
+            result->backwards++;
+        }
+        else if(generation > last){
+            result->generations++;
+        }
+        last = generation;
+    }
+
+    return NULL;
+}
+
+static void test_concurrent_reads()
+{
+    pthread_t writer;
+    pthread_t readers[TEST_READERS];
+    ReaderResult results[TEST_READERS] = {0};
+
+    atomic_store(&writing, true);
+
+    for(int i = 0; i < TEST_READERS; i++){
+        CHECK(pthread_create(&readers[i], NULL, _reader_, &results[i]) == 0);
+    }
+    CHECK(pthread_create(&writer, NULL, _writer_, NULL) == 0);
+
+    pthread_join(writer, NULL);
+    for(int i = 0; i < TEST_READERS; i++){
+        pthread_join(readers[i], NULL);
+    }
+
+    for(int i = 0; i < TEST_READERS; i++){
+        printf("reader %d: %u reads, %u generations seen, %u torn\n",
+            i, results[i].reads, results[i].generations, results[i].torn);
+
+        CHECK(results[i].torn == 0);
+        CHECK(results[i].backwards == 0);
+
+        // The reader ran alongside the writer, not only before or after it
+        CHECK(results[i].generations > 1);
+    }
+
+    CHECK(seqlock_generation(&lock) == TEST_WRITES);
+}
+
+int main()
+{
+    TEST_RUN(test_concurrent_reads);
+
+    return test_result();
+}
@@ -0,0 +1,208 @@
+#include <string.h>
+
+#include "test.h"
+#include "server_interface.h"
+#include "userinterface.h"
+#include "alarm.h"
+
+/*
+Several stations polled at once from a stand-in server, with some of
+them failing.
+*/
+
+enum{STATION_MAIN, STATION_NORTH, STATION_BROKEN, STATION_DOWN};
+
+// Answer of the stand-in server for each station path
+typedef struct{
+    const char *path;
+    int status;         // HTTP status, negative to refuse the connection
+    const char *body;
+} StandIn;
+
+static StandIn server[] = {
+    [STATION_MAIN] = {"latest/"},
+    [STATION_NORTH] = {"north/"},
+    [STATION_BROKEN] = {"broken/"},
+    [STATION_DOWN] = {"down/"},
+};
+
+static int requests[4];
+
+static const char *reading_main = "{\"temp\":21.5,\"humidity\":45.0,\"wind_speed\":3.2}";
+static const char *reading_north = "{\"temp\":-4.0,\"humidity\":80.0,\"wind_speed\":11.5}";
+static const char *error_page = "<html><body>500 Internal Server Error</body></html>";
+
+static int _handler_(const char *uri, char *body, size_t size)
+{
+    for(int i = 0; i < 4; i++){
+        size_t length = strlen(server[i].path);
+
+        if(strlen(uri) >= length && strcmp(&uri[strlen(uri) - length], server[i].path) == 0){
+            requests[i]++;
+            snprintf(body, size, "%s", server[i].body != NULL ? server[i].body : "");
+            return server[i].status;
+        }
+    }
+
+    return 404;
+}
+
+static void _serve_(int station, int status, const char *body)
+{
+    server[station].status = status;
+    server[station].body = body;
+}
+
+// Poll the stations once and run the main loop until every request ended
+static uint32_t _poll_round_()
+{
+    // Past the backoff of stations that failed in the last round
+    sleep_ms(5000);
+
+    absolute_time_t start = get_absolute_time();
+    memset(requests, 0, sizeof(requests));
+
+    CHECK(request_last_data() == 0);
+
+    bool busy = true;
+    while(busy){
+        server_poll();
+        sleep_ms(1);
+
+        busy = false;
+        for(int i = 0; i < get_station_count(); i++){
+            enum request_state request = get_request_state(i);
+            busy |= request != REQUEST_DONE && request != REQUEST_FAILED;
+        }
+    }
+
+    return absolute_time_diff_us(start, get_absolute_time()) / 1000;
+}
+
+static void test_concurrent_requests()
+{
+    _serve_(STATION_MAIN, 200, reading_main);
+    _serve_(STATION_NORTH, 200, reading_north);
+    _serve_(STATION_BROKEN, 500, error_page);
+    _serve_(STATION_DOWN, -1, NULL);
+
+    ServerStats before = get_server_stats();
+    uint32_t round_ms = _poll_round_();
+    ServerStats after = get_server_stats();
+
+    // All stations were requested at once, so the round takes one
+    // connect and one response, not four
+    CHECK(round_ms < 2 * (30 + 50));
+
+    for(int i = 0; i < 4; i++){
+        CHECK(requests[i] == 1);
+    }
+
+    CHECK(get_request_state(STATION_MAIN) == REQUEST_DONE);
+    CHECK(get_request_state(STATION_NORTH) == REQUEST_DONE);
+    CHECK(get_request_state(STATION_BROKEN) == REQUEST_FAILED);
+    CHECK(get_request_state(STATION_DOWN) == REQUEST_FAILED);
+
+    CHECK(after.done - before.done == 2);
+    CHECK(after.failed - before.failed == 2);
+
+    // Each station got its own reading
+    CHECK(station_new_data(STATION_MAIN));
+    CHECK(station_new_data(STATION_NORTH));
+    CHECK_NEAR(get_station_data(STATION_MAIN).temp, 21.5);
+    CHECK_NEAR(get_station_data(STATION_NORTH).temp, -4.0);
+    CHECK_NEAR(get_station_data(STATION_NORTH).wind_spd, 11.5);
+
+    // The error page and the refused connection published nothing
+    CHECK(!station_new_data(STATION_BROKEN));
+    CHECK(!station_new_data(STATION_DOWN));
+    CHECK(get_station_data_age_ms(STATION_BROKEN) < 0);
+    CHECK(get_station_data_age_ms(STATION_DOWN) < 0);
+}
+
+static void test_failure_keeps_last_reading()
+{
+    // The main station breaks, the broken one recovers
+    _serve_(STATION_MAIN, 404, "Not found");
+    _serve_(STATION_BROKEN, 200, reading_north);
+
+    uint32_t generation = station_data_generation(STATION_MAIN);
+    _poll_round_();
+
+    CHECK(get_request_state(STATION_MAIN) == REQUEST_FAILED);
+    CHECK(station_data_generation(STATION_MAIN) == generation);
+    CHECK_NEAR(peek_station_data(STATION_MAIN).temp, 21.5);
+
+    CHECK(station_new_data(STATION_BROKEN));
+    CHECK_NEAR(get_station_data(STATION_BROKEN).temp, -4.0);
+}
+
+static void test_split_body()
+{
+    // Bodies arrive a few bytes at a time, as over a slow link
+    host_net_set_segment(7);
+
+    _serve_(STATION_MAIN, 200, reading_main);
+    _serve_(STATION_NORTH, 200, "{\"temp\":12.25,\"humidity\":33.0,\"wind_speed\":0.5}");
+    _poll_round_();
+
+    CHECK(get_request_state(STATION_NORTH) == REQUEST_DONE);
+    CHECK(station_new_data(STATION_NORTH));
+
+    WeatherStationData north = get_station_data(STATION_NORTH);
+    CHECK_NEAR(north.temp, 12.25);
+    CHECK_NEAR(north.humidity, 33.0);
+    CHECK_NEAR(north.wind_spd, 0.5);
+
+    // An error page in segments is still not published
+    _serve_(STATION_NORTH, 503, error_page);
+    uint32_t generation = station_data_generation(STATION_NORTH);
+    _poll_round_();
+
+    CHECK(station_data_generation(STATION_NORTH) == generation);
+
+    host_net_set_segment(0);
+}
+
+static void test_page_leaves_reading_for_alarms()
+{
+    AlarmRule rule = {.metric = METRIC_TEMP, .op = ALARM_ABOVE, .severity = ALARM_WARNING, .threshold = 20};
+    CHECK(alarm_set_rule(0, &rule) == 0);
+
+    _serve_(STATION_MAIN, 200, reading_main);
+    _poll_round_();
+
+    // A key press draws the data page between the reading and the alarms
+    data_page(NO_INPUT);
+    CHECK(station_new_data(STATION_MAIN));
+
+    ui_update_alarms();
+    CHECK(alarm_severity() == ALARM_WARNING);
+    CHECK(!station_new_data(STATION_MAIN));
+
+    alarm_clear_rule(0);
+}
+
+int main()
+{
+    test_board_init();
+    host_http_set_handler(_handler_);
+
+    CHECK(add_station("North", server[STATION_NORTH].path) == STATION_NORTH);
+    CHECK(add_station("Broken", server[STATION_BROKEN].path) == STATION_BROKEN);
+    CHECK(add_station("Down", server[STATION_DOWN].path) == STATION_DOWN);
+
+    // One attempt per round keeps the rounds apart
+    ServerPolicy policy = server_get_policy();
+    policy.max_retries = 0;
+    server_set_policy(&policy);
+
+    test_wifi_connect();
+
+    TEST_RUN(test_concurrent_requests);
+    TEST_RUN(test_failure_keeps_last_reading);
+    TEST_RUN(test_split_body);
+    TEST_RUN(test_page_leaves_reading_for_alarms);
+
+    return test_result();
+}
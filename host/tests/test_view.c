@@ -0,0 +1,99 @@
+#include "test.h"
+#include "userinterface.h"
+#include "server_interface.h"
+
+/*
+Display updates from the view model. Keys are pressed from scheduled
+events on the simulated clock while the test loops as the main loop
+does, and display writes are counted by the display model.
+*/
+
+// Length of the key storm and time between its key presses
+#define TEST_STORM_MS 1000
+#define TEST_STORM_KEY_MS 10
+
+static void _press_(void *arg)
+{
+    host_keypad_press(INPUT_DOWN);
+}
+
+static void _release_(void *arg)
+{
+    host_keypad_press(0);
+}
+
+static void test_key_storm_frame_rate()
+{
+    uint64_t start_us = time_us_64();
+
+    for(uint32_t t = 0; t < TEST_STORM_MS; t += TEST_STORM_KEY_MS){
+        host_event_schedule(start_us + t * 1000, _press_, NULL);
+        host_event_schedule(start_us + (t + TEST_STORM_KEY_MS / 2) * 1000, _release_, NULL);
+    }
+
+    data_page(NO_INPUT);
+    view_flush();
+
+    uint32_t renders = view_renders();
+    uint32_t keys = 0;
+
+    while(time_us_64() - start_us < TEST_STORM_MS * 1000){
+        view_render();
+
+        char key = poll_keypad();
+        if(key != NO_INPUT){
+            data_page(key);
+            keys++;
+        }
+    }
+
+    double seconds = (double)(time_us_64() - start_us) / 1000000;
+    double renders_per_s = (view_renders() - renders) / seconds;
+
+    // Every key is handled, but the display is drawn once per frame
+    CHECK(keys == TEST_STORM_MS / TEST_STORM_KEY_MS);
+    CHECK(renders_per_s > 0);
+    CHECK(renders_per_s <= 1000.0 / VIEW_FRAME_MS);
+
+    // The last key is on the display after the next frame
+    sleep_ms(VIEW_FRAME_MS);
+    view_render();
+    CHECK(!view_dirty());
+}
+
+static void test_unchanged_page_no_writes()
+{
+    data_page(NO_INPUT);
+    view_flush();
+
+    uint32_t writes = host_display_writes();
+    uint32_t renders = view_renders();
+
+    // Composed again with the same content, frame after frame
+    for(int i = 0; i < 10; i++){
+        data_page(INPUT_REFRESH);
+        CHECK(!view_dirty());
+
+        sleep_ms(VIEW_FRAME_MS);
+        CHECK(!view_render());
+    }
+
+    CHECK(host_display_writes() == writes);
+    CHECK(view_renders() == renders);
+}
+
+int main()
+{
+    test_board_init();
+
+    WeatherStationData data = {
+        .temp = 21.5, .humidity = 45, .wind_spd = 3.2, .wind_dir = 180,
+        .pressure = 101.3, .smoke = 0, .ambient_light = 60
+    };
+    restore_station_data(0, data);
+
+    TEST_RUN(test_key_storm_frame_rate);
+    TEST_RUN(test_unchanged_page_no_writes);
+
+    return test_result();
+}
@@ -0,0 +1,173 @@
+#include <string.h>
+
+#include "pico/cyw43_arch.h"
+
+#include "test.h"
+#include "wifi.h"
+#include "server_interface.h"
+
+/*
+The WiFi supervisor keeps rejoining on its own: after a lost link, when
+no network could be joined and after a failed join from the wifi page.
+The power governor keeps the radio awake while responses are due.
+*/
+
+// Polls the supervisor for up to ms and returns the last event other than none
+static enum wifi_event _poll_for_(uint32_t ms, enum wifi_event until)
+{
+    absolute_time_t end = make_timeout_time_ms(ms);
+    enum wifi_event last = WIFI_EVENT_NONE;
+
+    while(get_absolute_time() < end){
+        enum wifi_event event = wifi_poll();
+
+        if(event != WIFI_EVENT_NONE){
+            last = event;
+        }
+
+        if(last == until){
+            break;
+        }
+
+        sleep_ms(1);
+    }
+
+    return last;
+}
+
+static void test_no_network_retries()
+{
+    // Nothing saved to join
+    kv_delete("wifi0");
+    wifi_start_auto_connect();
+
+    CHECK(_poll_for_(3000, WIFI_EVENT_CONNECTED) == WIFI_EVENT_NONE);
+    CHECK(!wifi_is_connected());
+
+    // Joined on a later retry once credentials are saved
+    wifi_save_credential("Chrillbob's Hotspot", "NotPassword", CYW43_AUTH_WPA2_AES_PSK);
+
+    CHECK(_poll_for_(10000, WIFI_EVENT_CONNECTED) == WIFI_EVENT_CONNECTED);
+    CHECK(wifi_is_connected());
+}
+
+static void test_link_drop_rejoins()
+{
+    host_wifi_drop_link();
+
+    // The link callback is seen on the next poll
+    CHECK(wifi_poll() == WIFI_EVENT_DISCONNECTED);
+    CHECK(_poll_for_(2000, WIFI_EVENT_CONNECTED) == WIFI_EVENT_CONNECTED);
+}
+
+static void test_failed_join_resumes()
+{
+    host_wifi_add_network("Locked", "secret", -40);
+    scan_for_networks();
+
+    // Secured network without saved credentials, nothing is joined
+    CHECK(connect_to_network("Locked") != 0);
+    CHECK(_poll_for_(1000, WIFI_EVENT_DISCONNECTED) == WIFI_EVENT_NONE);
+    CHECK(wifi_is_connected());
+
+    // Wrong password. The join is reported failed and the saved networks
+    // are joined again
+    wifi_save_credential("Locked", "wrong", CYW43_AUTH_WPA2_AES_PSK);
+    CHECK(connect_to_network("Locked") == 0);
+    CHECK(_poll_for_(5000, WIFI_EVENT_JOIN_FAILED) == WIFI_EVENT_JOIN_FAILED);
+    CHECK(_poll_for_(5000, WIFI_EVENT_CONNECTED) == WIFI_EVENT_CONNECTED);
+}
+
+static void test_join_does_not_block()
+{
+    wifi_save_credential("Locked", "secret", CYW43_AUTH_WPA2_AES_PSK);
+
+    uint64_t start_us = time_us_64();
+    CHECK(connect_to_network("Locked") == 0);
+    CHECK(time_us_64() - start_us < 1000);
+
+    CHECK(_poll_for_(5000, WIFI_EVENT_CONNECTED) == WIFI_EVENT_CONNECTED);
+
+    // Joined again without a scan after the next drop
+    host_wifi_drop_link();
+    CHECK(wifi_poll() == WIFI_EVENT_DISCONNECTED);
+    CHECK(_poll_for_(2000, WIFI_EVENT_CONNECTED) == WIFI_EVENT_CONNECTED);
+}
+
+static void test_join_shown_network()
+{
+    char shown[WIFI_SSID_SIZE];
+    CHECK(get_network_ssid(0, shown) == 0);
+    CHECK(strcmp(shown, "Locked") == 0);
+
+    // A stronger network takes the first line, the copy shown is kept
+    host_wifi_add_network("Cafe", "", -20);
+    scan_for_networks();
+
+    char first[WIFI_SSID_SIZE];
+    CHECK(get_network_ssid(0, first) == 0);
+    CHECK(strcmp(first, "Cafe") == 0);
+    CHECK(strcmp(shown, "Locked") == 0);
+    CHECK(get_network_ssid(get_network_buffer_size(), first) != 0);
+
+    // Networks are joined by SSID, so the one shown is joined
+    CHECK(connect_to_network(shown) == 0);
+    CHECK(_poll_for_(5000, WIFI_EVENT_CONNECTED) == WIFI_EVENT_CONNECTED);
+
+    CHECK(connect_to_network("Gone") != 0);
+}
+
+static uint32_t _pm_()
+{
+    uint32_t pm;
+    cyw43_wifi_get_pm(&cyw43_state, &pm);
+
+    return pm;
+}
+
+static void test_power_hold_for_response()
+{
+    // The response takes longer than the hold after the request
+    host_net_set_latency(0, 30, 6000);
+
+    // As the main loop does: request, then schedule the next one
+    CHECK(request_last_data() == 0);
+    wifi_power_schedule_request(make_timeout_time_ms(60000));
+
+    bool awake = true;
+    uint32_t ms = 0;
+
+    while(server_poll() != SERVER_EVENT_DATA && ms < 10000){
+        wifi_power_set_requests_pending(server_requests_pending());
+        wifi_poll();
+
+        awake &= _pm_() == CYW43_PERFORMANCE_PM;
+        sleep_ms(1);
+        ms++;
+    }
+
+    CHECK(ms > 6000 && ms < 10000);
+    CHECK(awake);
+
+    // Power save once the response is in and the hold is over
+    wifi_power_set_requests_pending(server_requests_pending());
+    _poll_for_(100, WIFI_EVENT_NONE);
+    CHECK(_pm_() == CYW43_AGGRESSIVE_PM);
+
+    host_net_set_latency(20, 30, 50);
+}
+
+int main()
+{
+    test_board_init();
+    init_wifi();
+
+    TEST_RUN(test_no_network_retries);
+    TEST_RUN(test_link_drop_rejoins);
+    TEST_RUN(test_failed_join_resumes);
+    TEST_RUN(test_join_does_not_block);
+    TEST_RUN(test_join_shown_network);
+    TEST_RUN(test_power_hold_for_response);
+
+    return test_result();
+}
@@ -1,4 +1,5 @@
 #include "json.h"
+#include "profiler.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -28,37 +29,25 @@ json_err_t find_json_element(raw_json_t raw_json_object, char *element_key, json
 
 WeatherStationData parse_weatherstation_json(raw_json_t raw_str)
 {
-    WeatherStationData result;
+    PROF_BEGIN(PROF_PARSE_JSON);
 
-    json_element_t working_element;
-    
-    // Extract ambient from json
-    find_json_element(raw_str, "ambient", &working_element);
-    result.ambient_light = strtod(working_element.value, NULL);
-
-    // Extract smoke from json
-    find_json_element(raw_str, "smoke", &working_element);
-    result.smoke = strtod(working_element.value, NULL);
+    WeatherStationData result = {0};
 
-    // Extract pressure from json
-    find_json_element(raw_str, "pressure", &working_element);
-    result.pressure = strtod(working_element.value, NULL);
+    // Keys are found in any order without modifying the payload.
+    // Missing metrics read as 0
+    for(int m = 0; m < METRICS; m++){
+        char* p = strstr(raw_str, metric_info[m].json_key);
 
-    // Extract wind direction from json
-    find_json_element(raw_str, "wind_dir", &working_element);
-    result.wind_dir = strtod(working_element.value, NULL);
+        if(p != NULL){
+            p = strchr(p, ':');
+        }
 
-    // Extract wind speed from json
-    find_json_element(raw_str, "wind_speed", &working_element);
-    result.wind_spd = strtod(working_element.value, NULL);
-
-    // Extract humidity from json
-    find_json_element(raw_str, "humidity", &working_element);
-    result.humidity= strtod(working_element.value, NULL);
+        if(p != NULL){
+            metric_set_value(&result, m, strtof(p + 1, NULL));
+        }
+    }
 
-    // Extract temperature from json
-    find_json_element(raw_str, "temp", &working_element);
-    result.temp = strtod(working_element.value, NULL);
+    PROF_END(PROF_PARSE_JSON);
 
     return result;
 }
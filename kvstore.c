@@ -0,0 +1,578 @@
+#include "kvstore.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+// Store is kept in the last sectors of flash
+#define KV_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - KV_SECTORS * FLASH_SECTOR_SIZE)
+
+// Max time to wait for the other core to pause during flash writes
+#define KV_FLASH_TIMEOUT_MS 100
+
+#define KV_SECTOR_MAGIC 0x4B565331 // "KVS1"
+
+// Sequence number of a sector that is not part of the log
+#define KV_SECTOR_FREE 0xFFFFFFFF
+
+// Largest supported flash page
+#define KV_MAX_PAGE_SIZE 256
+
+// Key length of unwritten flash
+#define KV_KEY_LENGTH_ERASED 0xFF
+
+#define KV_FLAG_DELETED (1 << 0)
+
+// Records are padded to a multiple of 4 bytes
+#define KV_ALIGN(x) (((x) + 3) & ~3)
+
+typedef struct{
+    uint32_t magic;
+    // Increases by one for every sector added to the log
+    uint32_t seq;
+} KvSectorHeader;
+
+typedef struct{
+    uint8_t key_len;
+    uint8_t flags;
+    uint16_t value_len;
+    // CRC of key_len, flags, value_len, key and value
+    uint32_t crc;
+} KvRecordHeader;
+
+#define KV_MAX_RECORD_SIZE KV_ALIGN(sizeof(KvRecordHeader) + KV_MAX_KEY_LENGTH + KV_MAX_VALUE_SIZE)
+
+// Index entry pointing to the latest record of a key
+typedef struct{
+    char key[KV_MAX_KEY_LENGTH + 1];
+    uint8_t sector;
+    uint16_t offset;
+    uint16_t value_len;
+} KvIndexEntry;
+
+static struct KvState{
+    const struct KvFlash *flash;
+
+    KvIndexEntry index[KV_MAX_KEYS];
+    uint8_t n_keys;
+
+    uint32_t sector_seq[KV_SECTORS];
+    uint32_t next_seq;
+
+    // Sector and offset the next record is written to
+    uint8_t head;
+    uint32_t head_offset;
+
+    uint32_t erase_count;
+} state;
+
+// =================================================================
+// Pico flash backend
+
+static void pico_erase_fn(void *param)
+{
+    uint32_t offset = *(uint32_t *)param;
+    flash_range_erase(KV_FLASH_OFFSET + offset, FLASH_SECTOR_SIZE);
+}
+
+struct PicoProgramParam{
+    uint32_t offset;
+    const uint8_t *page;
+};
+
+static void pico_program_fn(void *param)
+{
+    struct PicoProgramParam *program = param;
+    flash_range_program(KV_FLASH_OFFSET + program->offset, program->page, FLASH_PAGE_SIZE);
+}
+
+// Flash is unavailable while erasing or programming, so interrupts are
+// disabled and the other core is paused through flash_safe_execute
+static int pico_erase(uint32_t offset)
+{
+    return flash_safe_execute(pico_erase_fn, &offset, KV_FLASH_TIMEOUT_MS) == PICO_OK ? 0 : -1;
+}
+
+static int pico_program(uint32_t offset, const uint8_t *page)
+{
+    struct PicoProgramParam program = {.offset = offset, .page = page};
+    return flash_safe_execute(pico_program_fn, &program, KV_FLASH_TIMEOUT_MS) == PICO_OK ? 0 : -1;
+}
+
+const struct KvFlash kv_flash_pico = {
+    .base = (const uint8_t *)(XIP_BASE + KV_FLASH_OFFSET),
+    .sector_size = FLASH_SECTOR_SIZE,
+    .page_size = FLASH_PAGE_SIZE,
+    .erase = pico_erase,
+    .program = pico_program
+};
+
+// =================================================================
+// Helpers
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+
+    for(size_t i = 0; i < len; i++){
+        crc ^= bytes[i];
+        for(int j = 0; j < 8; j++){
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return crc;
+}
+
+static uint32_t record_crc(const KvRecordHeader *header, const char *key, const uint8_t *value)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    crc = crc32_update(crc, header, offsetof(KvRecordHeader, crc));
+    crc = crc32_update(crc, key, header->key_len);
+    crc = crc32_update(crc, value, header->value_len);
+
+    return ~crc;
+}
+
+static const uint8_t *sector_ptr(uint8_t sector)
+{
+    return state.flash->base + sector * state.flash->sector_size;
+}
+
+static const KvRecordHeader *record_ptr(uint8_t sector, uint32_t offset)
+{
+    return (const KvRecordHeader *)(sector_ptr(sector) + offset);
+}
+
+static const uint8_t *record_value(const KvRecordHeader *record)
+{
+    return (const uint8_t *)(record + 1) + record->key_len;
+}
+
+static uint32_t record_size(const KvRecordHeader *record)
+{
+    return KV_ALIGN(sizeof(KvRecordHeader) + record->key_len + record->value_len);
+}
+
+static int find_key(const char *key)
+{
+    for(int i = 0; i < state.n_keys; i++){
+        if(strncmp(state.index[i].key, key, KV_MAX_KEY_LENGTH) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void remove_index_entry(int entry)
+{
+    state.n_keys--;
+    state.index[entry] = state.index[state.n_keys];
+}
+
+// Point index entry of key at record. Tombstones remove the key
+static kv_err_t update_index(const char *key, uint8_t key_len, uint8_t sector, uint32_t offset, const KvRecordHeader *record)
+{
+    int entry = find_key(key);
+
+    if(record->flags & KV_FLAG_DELETED){
+        if(entry >= 0){
+            remove_index_entry(entry);
+        }
+        return KV_ERR_OK;
+    }
+
+    if(entry < 0){
+        if(state.n_keys == KV_MAX_KEYS){
+            return KV_ERR_FULL;
+        }
+
+        entry = state.n_keys++;
+        memcpy(state.index[entry].key, key, key_len);
+        state.index[entry].key[key_len] = '\0';
+    }
+
+    state.index[entry].sector = sector;
+    state.index[entry].offset = offset;
+    state.index[entry].value_len = record->value_len;
+
+    return KV_ERR_OK;
+}
+
+// Program bytes at offset in the region. Pages are read back and merged
+// so bytes already written in the page are programmed with the same value
+static kv_err_t write_bytes(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    static uint8_t page[KV_MAX_PAGE_SIZE];
+    uint32_t page_size = state.flash->page_size;
+
+    while(len > 0){
+        uint32_t page_start = offset - offset % page_size;
+        uint32_t page_offset = offset - page_start;
+        uint32_t n = page_size - page_offset;
+
+        if(n > len){
+            n = len;
+        }
+
+        memcpy(page, state.flash->base + page_start, page_size);
+        memcpy(page + page_offset, data, n);
+
+        if(state.flash->program(page_start, page) != 0){
+            return KV_ERR_FLASH;
+        }
+
+        offset += n;
+        data += n;
+        len -= n;
+    }
+
+    return KV_ERR_OK;
+}
+
+static kv_err_t erase_sector(uint8_t sector)
+{
+    state.erase_count++;
+    state.sector_seq[sector] = KV_SECTOR_FREE;
+
+    if(state.flash->erase(sector * state.flash->sector_size) != 0){
+        return KV_ERR_FLASH;
+    }
+
+    return KV_ERR_OK;
+}
+
+// Erase sector and add it to the head of the log
+static kv_err_t start_sector(uint8_t sector)
+{
+    kv_err_t err = erase_sector(sector);
+
+    if(err != KV_ERR_OK){
+        return err;
+    }
+
+    KvSectorHeader header = {.magic = KV_SECTOR_MAGIC, .seq = state.next_seq};
+
+    err = write_bytes(sector * state.flash->sector_size, (const uint8_t *)&header, sizeof(header));
+
+    if(err != KV_ERR_OK){
+        return err;
+    }
+
+    state.sector_seq[sector] = state.next_seq++;
+    state.head = sector;
+    state.head_offset = sizeof(KvSectorHeader);
+
+    return KV_ERR_OK;
+}
+
+// Returns the sector in the log with the lowest sequence number or -1
+static int oldest_sector()
+{
+    int result = -1;
+
+    for(int i = 0; i < KV_SECTORS; i++){
+        if(state.sector_seq[i] == KV_SECTOR_FREE){
+            continue;
+        }
+
+        if(result < 0 || state.sector_seq[i] < state.sector_seq[result]){
+            result = i;
+        }
+    }
+
+    return result;
+}
+
+// Returns the first free sector after the head or -1. Using sectors round
+// robin spreads erases evenly over the region
+static int next_free_sector()
+{
+    for(int i = 1; i <= KV_SECTORS; i++){
+        int sector = (state.head + i) % KV_SECTORS;
+
+        if(state.sector_seq[sector] == KV_SECTOR_FREE){
+            return sector;
+        }
+    }
+
+    return -1;
+}
+
+static int count_free_sectors()
+{
+    int n = 0;
+    for(int i = 0; i < KV_SECTORS; i++){
+        n += state.sector_seq[i] == KV_SECTOR_FREE;
+    }
+    return n;
+}
+
+// Append a record to the head sector. The head must have room for it
+static kv_err_t append_record(const char *key, uint8_t key_len, uint8_t flags, const void *value, uint16_t value_len)
+{
+    static uint8_t buffer[KV_MAX_RECORD_SIZE];
+
+    KvRecordHeader header = {
+        .key_len = key_len,
+        .flags = flags,
+        .value_len = value_len
+    };
+    header.crc = record_crc(&header, key, value);
+
+    uint32_t size = record_size(&header);
+
+    memset(buffer, 0xFF, size);
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), key, key_len);
+    if(value_len > 0){
+        memcpy(buffer + sizeof(header) + key_len, value, value_len);
+    }
+
+    uint32_t offset = state.head_offset;
+    kv_err_t err = write_bytes(state.head * state.flash->sector_size + offset, buffer, size);
+
+    if(err != KV_ERR_OK){
+        // The record may be partially written, and scanning stops at it on
+        // the next boot. Continue the log in a new sector
+        state.head_offset = state.flash->sector_size;
+        return err;
+    }
+
+    state.head_offset += size;
+
+    return update_index(key, key_len, state.head, offset, record_ptr(state.head, offset));
+}
+
+// Copy live records in the oldest sector to the head and erase it
+static kv_err_t compact_oldest()
+{
+    int oldest = oldest_sector();
+
+    if(oldest < 0 || oldest == state.head){
+        return KV_ERR_OK;
+    }
+
+    for(int i = 0; i < state.n_keys; i++){
+        KvIndexEntry entry = state.index[i];
+
+        if(entry.sector != oldest){
+            continue;
+        }
+
+        const KvRecordHeader *record = record_ptr(entry.sector, entry.offset);
+
+        if(state.head_offset + record_size(record) > state.flash->sector_size){
+            return KV_ERR_FULL;
+        }
+
+        kv_err_t err = append_record(entry.key, record->key_len, record->flags, record_value(record), record->value_len);
+
+        if(err != KV_ERR_OK){
+            return err;
+        }
+    }
+
+    return erase_sector(oldest);
+}
+
+// Make room for size bytes at the head of the log
+static kv_err_t reserve(uint32_t size)
+{
+    if(state.head_offset + size <= state.flash->sector_size){
+        return KV_ERR_OK;
+    }
+
+    int sector = next_free_sector();
+
+    if(sector < 0){
+        return KV_ERR_FULL;
+    }
+
+    kv_err_t err = start_sector(sector);
+
+    if(err != KV_ERR_OK){
+        return err;
+    }
+
+    // Always keep one erased sector so the oldest sector can be compacted.
+    // All live records fit in one sector, so they fit in the new head
+    if(count_free_sectors() == 0){
+        err = compact_oldest();
+    }
+
+    return err;
+}
+
+static kv_err_t write_record(const char *key, uint8_t flags, const void *value, uint16_t value_len)
+{
+    size_t key_len = strlen(key);
+
+    if(key_len == 0 || key_len > KV_MAX_KEY_LENGTH || value_len > KV_MAX_VALUE_SIZE){
+        return KV_ERR_INVALID;
+    }
+
+    // New keys need a free index entry
+    if(!(flags & KV_FLAG_DELETED) && find_key(key) < 0 && state.n_keys == KV_MAX_KEYS){
+        return KV_ERR_FULL;
+    }
+
+    uint32_t size = KV_ALIGN(sizeof(KvRecordHeader) + key_len + value_len);
+
+    kv_err_t err = reserve(size);
+
+    if(err != KV_ERR_OK){
+        return err;
+    }
+
+    return append_record(key, key_len, flags, value, value_len);
+}
+
+// Reads all valid records in sector into the index and returns
+// the offset after the last valid record
+static uint32_t scan_sector(uint8_t sector)
+{
+    uint32_t offset = sizeof(KvSectorHeader);
+    uint32_t sector_size = state.flash->sector_size;
+
+    while(offset + sizeof(KvRecordHeader) <= sector_size){
+        const KvRecordHeader *record = record_ptr(sector, offset);
+
+        if(record->key_len == KV_KEY_LENGTH_ERASED){
+            // Start of unwritten space
+            return offset;
+        }
+
+        const char *key = (const char *)(record + 1);
+
+        if(record->key_len == 0 || record->key_len > KV_MAX_KEY_LENGTH ||
+           record->value_len > KV_MAX_VALUE_SIZE ||
+           offset + record_size(record) > sector_size ||
+           record->crc != record_crc(record, key, record_value(record))){
+            // Torn or corrupt record. Nothing after it can be trusted
+            // and the space cannot be reused until the sector is erased
+            printf("KV: invalid record in sector %u at %lu\n", sector, (unsigned long)offset);
+            return sector_size;
+        }
+
+        char key_buffer[KV_MAX_KEY_LENGTH + 1];
+        memcpy(key_buffer, key, record->key_len);
+        key_buffer[record->key_len] = '\0';
+
+        update_index(key_buffer, record->key_len, sector, offset, record);
+
+        offset += record_size(record);
+    }
+
+    return sector_size;
+}
+
+// =================================================================
+// Public functions
+
+kv_err_t kv_init(const struct KvFlash *flash)
+{
+    memset(&state, 0, sizeof(state));
+    state.flash = flash;
+    state.next_seq = 1;
+
+    // Find sectors belonging to the log
+    for(int i = 0; i < KV_SECTORS; i++){
+        const KvSectorHeader *header = (const KvSectorHeader *)sector_ptr(i);
+
+        if(header->magic == KV_SECTOR_MAGIC && header->seq != KV_SECTOR_FREE){
+            state.sector_seq[i] = header->seq;
+
+            if(header->seq >= state.next_seq){
+                state.next_seq = header->seq + 1;
+            }
+        }
+        else{
+            state.sector_seq[i] = KV_SECTOR_FREE;
+        }
+    }
+
+    // Replay sectors from oldest to newest so later records win
+    uint32_t last_seq = 0;
+
+    while(true){
+        int sector = -1;
+
+        for(int i = 0; i < KV_SECTORS; i++){
+            if(state.sector_seq[i] != KV_SECTOR_FREE && state.sector_seq[i] > last_seq &&
+               (sector < 0 || state.sector_seq[i] < state.sector_seq[sector])){
+                sector = i;
+            }
+        }
+
+        if(sector < 0){
+            break;
+        }
+
+        last_seq = state.sector_seq[sector];
+
+        state.head = sector;
+        state.head_offset = scan_sector(sector);
+    }
+
+    // Empty store
+    if(count_free_sectors() == KV_SECTORS){
+        return start_sector(0);
+    }
+
+    // Power was lost during compaction, before the oldest sector was erased
+    if(count_free_sectors() == 0){
+        return compact_oldest();
+    }
+
+    return KV_ERR_OK;
+}
+
+int kv_get(const char* key, void *value, uint16_t size)
+{
+    int entry = find_key(key);
+
+    if(entry < 0){
+        return KV_ERR_NOT_FOUND;
+    }
+
+    const KvRecordHeader *record = record_ptr(state.index[entry].sector, state.index[entry].offset);
+
+    memcpy(value, record_value(record), size < record->value_len ? size : record->value_len);
+
+    return record->value_len;
+}
+
+kv_err_t kv_set(const char* key, const void *value, uint16_t length)
+{
+    int entry = find_key(key);
+
+    // Skip writes that would not change anything to save flash wear
+    if(entry >= 0 && state.index[entry].value_len == length){
+        const KvRecordHeader *record = record_ptr(state.index[entry].sector, state.index[entry].offset);
+
+        if(memcmp(record_value(record), value, length) == 0){
+            return KV_ERR_OK;
+        }
+    }
+
+    return write_record(key, 0, value, length);
+}
+
+kv_err_t kv_delete(const char* key)
+{
+    if(find_key(key) < 0){
+        return KV_ERR_NOT_FOUND;
+    }
+
+    return write_record(key, KV_FLAG_DELETED, NULL, 0);
+}
+
+uint32_t kv_erase_count()
+{
+    return state.erase_count;
+}
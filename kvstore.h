@@ -0,0 +1,102 @@
+#ifndef KVSTORE_H
+#define KVSTORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+Log-structured key-value store in flash.
+
+Records are appended to the current sector and never modified in place.
+When a sector is full the log continues in the next erased sector, so all
+sectors are erased about equally often. Before the log runs out of erased
+sectors the oldest sector is compacted: its live records are copied to the
+head and the sector is erased.
+
+Every record carries a CRC. A record torn by a power loss fails the check
+and is ignored, so the previous value of the key is kept.
+*/
+
+// Number of flash sectors used by the store. At least one sector is
+// always kept erased for compaction
+#define KV_SECTORS 4
+
+// Max number of distinct keys
+#define KV_MAX_KEYS 16
+
+// Max key length excluding terminator
+#define KV_MAX_KEY_LENGTH 15
+
+// Max value size in bytes
+#define KV_MAX_VALUE_SIZE 128
+
+typedef enum{
+    KV_ERR_OK = 0,
+    KV_ERR_NOT_FOUND = -1,
+    KV_ERR_INVALID = -2,
+    KV_ERR_FULL = -3,
+    KV_ERR_FLASH = -4
+} kv_err_t;
+
+/**
+ * @brief Flash backend used by the store. Offsets are relative to the start
+ * of the store region.
+ */
+struct KvFlash{
+    // Memory mapped start of the region
+    const uint8_t *base;
+
+    uint32_t sector_size;
+    uint32_t page_size;
+
+    /**
+     * @brief Erase a sector. Returns 0 on success
+     */
+    int (*erase)(uint32_t offset);
+
+    /**
+     * @brief Program one page. Returns 0 on success
+     */
+    int (*program)(uint32_t offset, const uint8_t *page);
+};
+
+/**
+ * @brief Flash backend using the last KV_SECTORS sectors of the on-board flash
+ */
+extern const struct KvFlash kv_flash_pico;
+
+/**
+ * @brief Scan the flash region and build the in-RAM index.
+ * Must be called once before any other function.
+ *
+ * @param flash Flash backend
+ */
+kv_err_t kv_init(const struct KvFlash *flash);
+
+/**
+ * @brief Read value of key
+ *
+ * @param value Buffer for the value
+ * @param size Size of buffer. The value is truncated if longer
+ *
+ * @return Length of the stored value or a negative kv_err_t
+ */
+int kv_get(const char* key, void *value, uint16_t size);
+
+/**
+ * @brief Store value for key. Nothing is written if the value is unchanged.
+ */
+kv_err_t kv_set(const char* key, const void *value, uint16_t length);
+
+/**
+ * @brief Remove key from the store
+ */
+kv_err_t kv_delete(const char* key);
+
+/**
+ * @brief Number of sector erases since kv_init. Used to estimate flash wear
+ */
+uint32_t kv_erase_count();
+
+#endif //KVSTORE_H
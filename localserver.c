@@ -0,0 +1,626 @@
+#include "localserver.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "pico/rand.h"
+#include "lwip/altcp.h"
+#include "lwip/altcp_tcp.h"
+#include "lwip/tcp.h"
+
+#include "server_interface.h"
+#include "metrics.h"
+
+// Space in front of each body for the status line and headers
+#define LOCAL_SERVER_HEADER 192
+
+// Buffer sizes of the documents, headers included
+#define LOCAL_SERVER_LATEST_SIZE 1280
+#define LOCAL_SERVER_AGGREGATES_SIZE 2048
+#define LOCAL_SERVER_HISTORY_SIZE 4096
+
+// Max length of a request. Longer requests are cut short, which only
+// loses headers the server does not read
+#define LOCAL_SERVER_REQUEST 384
+
+// Connections are polled every 2 s and closed after 10 s without progress
+#define LOCAL_SERVER_POLL_INTERVAL 4
+#define LOCAL_SERVER_IDLE_POLLS 5
+
+static const char response_400[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char response_404[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char response_405[] = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char response_503[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+typedef struct{
+    char *p;
+    size_t left;
+    bool overflow;
+} LocalWriter;
+
+typedef struct LocalDocument{
+    const char *path;
+    void (*build)(LocalWriter *w);
+
+    char *buffer;
+    uint16_t size;
+
+    // Response 200 inside buffer. NULL until the first build and if the
+    // body did not fit
+    const char *response;
+    uint16_t length;
+
+    char etag[20];
+    char not_modified[96];
+    uint16_t not_modified_length;
+
+    // Connections sending from buffer or not_modified. Neither is
+    // rebuilt while one is in flight, as lwIP sends without copying
+    uint8_t senders;
+
+    // A reading arrived since the last build
+    bool stale;
+} LocalDocument;
+
+typedef struct{
+    bool used;
+    struct altcp_pcb *pcb;
+
+    char request[LOCAL_SERVER_REQUEST];
+    uint16_t request_length;
+
+    // Response being sent. document is set while a sender of it
+    const char *data;
+    uint16_t length;
+    uint16_t written;
+    uint16_t acked;
+    LocalDocument *document;
+
+    // Request for a document waiting to be rebuilt
+    LocalDocument *waiting;
+
+    uint8_t idle_polls;
+} LocalConnection;
+
+typedef struct{
+    uint32_t received_ms;
+    WeatherStationData data;
+} LocalReading;
+
+typedef struct{
+    LocalReading readings[LOCAL_SERVER_HISTORY];
+    uint8_t next;
+    uint8_t count;
+
+    uint32_t generation;
+} LocalHistory;
+
+static void _build_latest_(LocalWriter *w);
+static void _build_aggregates_(LocalWriter *w);
+static void _build_history_(LocalWriter *w);
+
+static char latest_buffer[LOCAL_SERVER_LATEST_SIZE];
+static char aggregates_buffer[LOCAL_SERVER_AGGREGATES_SIZE];
+static char history_buffer[LOCAL_SERVER_HISTORY_SIZE];
+
+static struct LocalServerState{
+    struct altcp_pcb *listener;
+
+    LocalDocument documents[3];
+    LocalConnection connections[LOCAL_SERVER_CONNECTIONS];
+    LocalHistory history[MAX_STATIONS];
+
+    // Part of every ETag, so tags from before a reboot do not match
+    uint32_t boot_tag;
+    uint32_t version;
+
+    LocalServerStats stats;
+} state = {
+    .documents = {
+        {.path = "/latest", .build = _build_latest_, .buffer = latest_buffer, .size = sizeof(latest_buffer), .stale = true},
+        {.path = "/aggregates", .build = _build_aggregates_, .buffer = aggregates_buffer, .size = sizeof(aggregates_buffer), .stale = true},
+        {.path = "/history", .build = _build_history_, .buffer = history_buffer, .size = sizeof(history_buffer), .stale = true}
+    }
+};
+
+#define LOCAL_SERVER_DOCUMENTS (sizeof(state.documents) / sizeof(state.documents[0]))
+
+// ===================================================================================
+// Documents
+
+static void _append_(LocalWriter *w, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(w->p, w->left, format, args);
+    va_end(args);
+
+    if(n < 0 || (size_t)n >= w->left){
+        w->overflow = true;
+        w->p += w->left;
+        w->left = 0;
+        return;
+    }
+
+    w->p += n;
+    w->left -= n;
+}
+
+// Metrics of a reading as JSON members
+static void _append_metrics_(LocalWriter *w, const WeatherStationData *data)
+{
+    for(int m = 0; m < METRICS; m++){
+        _append_(w, ",\"%s\":%.*f", metric_info[m].json_key, metric_info[m].decimals, metric_value(data, m));
+    }
+}
+
+static void _build_latest_(LocalWriter *w)
+{
+    _append_(w, "{\"uptime_ms\":%lu,\"stations\":[", (unsigned long)to_ms_since_boot(get_absolute_time()));
+
+    for(int i = 0; i < get_station_count(); i++){
+        _append_(w, "%s{\"name\":\"%s\"", i > 0 ? "," : "", get_station_name(i));
+
+        const LocalHistory *history = &state.history[i];
+
+        if(history->count > 0){
+            const LocalReading *reading = &history->readings[(history->next + LOCAL_SERVER_HISTORY - 1) % LOCAL_SERVER_HISTORY];
+
+            _append_(w, ",\"received_ms\":%lu,\"stale\":%s", (unsigned long)reading->received_ms,
+                station_data_is_stale(i) ? "true" : "false");
+            _append_metrics_(w, &reading->data);
+        }
+
+        _append_(w, "}");
+    }
+
+    _append_(w, "]}");
+}
+
+static void _build_aggregates_(LocalWriter *w)
+{
+    _append_(w, "{\"stations\":[");
+
+    for(int i = 0; i < get_station_count(); i++){
+        const LocalHistory *history = &state.history[i];
+
+        _append_(w, "%s{\"name\":\"%s\",\"readings\":%u", i > 0 ? "," : "", get_station_name(i), history->count);
+
+        for(int m = 0; history->count > 0 && m < METRICS; m++){
+            float min = metric_value(&history->readings[0].data, m);
+            float max = min;
+            float sum = 0;
+
+            for(int r = 0; r < history->count; r++){
+                float value = metric_value(&history->readings[r].data, m);
+
+                min = value < min ? value : min;
+                max = value > max ? value : max;
+                sum += value;
+            }
+
+            uint8_t decimals = metric_info[m].decimals;
+
+            _append_(w, ",\"%s\":{\"min\":%.*f,\"mean\":%.*f,\"max\":%.*f}", metric_info[m].json_key,
+                decimals, min, decimals + 1, sum / history->count, decimals, max);
+        }
+
+        _append_(w, "}");
+    }
+
+    _append_(w, "]}");
+}
+
+static void _build_history_(LocalWriter *w)
+{
+    _append_(w, "{\"stations\":[");
+
+    for(int i = 0; i < get_station_count(); i++){
+        const LocalHistory *history = &state.history[i];
+        uint8_t first = (history->next + LOCAL_SERVER_HISTORY - history->count) % LOCAL_SERVER_HISTORY;
+
+        _append_(w, "%s{\"name\":\"%s\",\"received_ms\":[", i > 0 ? "," : "", get_station_name(i));
+
+        for(int r = 0; r < history->count; r++){
+            _append_(w, "%s%lu", r > 0 ? "," : "",
+                (unsigned long)history->readings[(first + r) % LOCAL_SERVER_HISTORY].received_ms);
+        }
+
+        // One array per metric, oldest reading first
+        for(int m = 0; m < METRICS; m++){
+            _append_(w, "],\"%s\":[", metric_info[m].json_key);
+
+            for(int r = 0; r < history->count; r++){
+                const LocalReading *reading = &history->readings[(first + r) % LOCAL_SERVER_HISTORY];
+                _append_(w, "%s%.*f", r > 0 ? "," : "", metric_info[m].decimals, metric_value(&reading->data, m));
+            }
+        }
+
+        _append_(w, "]}");
+    }
+
+    _append_(w, "]}");
+}
+
+// Serialise the body behind the header space, then put the headers
+// right in front of it
+static void _build_(LocalDocument *document)
+{
+    char *body = document->buffer + LOCAL_SERVER_HEADER;
+    LocalWriter w = {.p = body, .left = document->size - LOCAL_SERVER_HEADER};
+
+    document->build(&w);
+    document->stale = false;
+    state.stats.builds++;
+
+    if(w.overflow){
+        printf("Local server: %s does not fit in %u bytes\n", document->path, document->size);
+        document->response = NULL;
+        return;
+    }
+
+    snprintf(document->etag, sizeof(document->etag), "\"%08lx%08lx\"", (unsigned long)state.boot_tag, (unsigned long)++state.version);
+
+    char headers[LOCAL_SERVER_HEADER];
+    int header_length = snprintf(headers, sizeof(headers),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %u\r\n"
+        "ETag: %s\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: close\r\n\r\n",
+        (unsigned)(w.p - body), document->etag);
+
+    memcpy(body - header_length, headers, header_length);
+
+    document->response = body - header_length;
+    document->length = w.p - document->response;
+
+    document->not_modified_length = snprintf(document->not_modified, sizeof(document->not_modified),
+        "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nConnection: close\r\n\r\n", document->etag);
+}
+
+// ===================================================================================
+// Connections
+
+static void _release_(LocalConnection *c)
+{
+    if(c->document != NULL){
+        c->document->senders--;
+        c->document = NULL;
+    }
+
+    c->used = false;
+}
+
+static void _close_(LocalConnection *c)
+{
+    struct altcp_pcb *pcb = c->pcb;
+
+    altcp_arg(pcb, NULL);
+    altcp_recv(pcb, NULL);
+    altcp_sent(pcb, NULL);
+    altcp_err(pcb, NULL);
+    altcp_poll(pcb, NULL, 0);
+
+    _release_(c);
+
+    if(altcp_close(pcb) != ERR_OK){
+        altcp_abort(pcb);
+    }
+}
+
+// Write as much of the response as the send buffer takes. The data stays
+// in place until it is acknowledged, so it is not copied
+static void _write_(LocalConnection *c)
+{
+    while(c->written < c->length){
+        uint16_t n = c->length - c->written;
+        uint16_t space = altcp_sndbuf(c->pcb);
+
+        if(space == 0){
+            break;
+        }
+
+        if(n > space){
+            n = space;
+        }
+
+        u8_t flags = c->written + n < c->length ? TCP_WRITE_FLAG_MORE : 0;
+
+        if(altcp_write(c->pcb, c->data + c->written, n, flags) != ERR_OK){
+            break;
+        }
+
+        c->written += n;
+    }
+
+    altcp_output(c->pcb);
+}
+
+static void _send_(LocalConnection *c, const char *data, uint16_t length)
+{
+    c->data = data;
+    c->length = length;
+    c->written = 0;
+    c->acked = 0;
+
+    _write_(c);
+}
+
+static void _send_error_(LocalConnection *c, const char *response, uint16_t length)
+{
+    state.stats.errors++;
+    _send_(c, response, length);
+}
+
+// Answer from a document that is up to date
+static void _serve_(LocalConnection *c, LocalDocument *document)
+{
+    c->waiting = NULL;
+
+    if(document->response == NULL){
+        _send_error_(c, response_503, sizeof(response_503) - 1);
+        return;
+    }
+
+    c->document = document;
+    document->senders++;
+
+    // The client has this version already
+    const char *match = strstr(c->request, "\r\nIf-None-Match:");
+    if(match != NULL && strstr(match, document->etag) != NULL){
+        state.stats.not_modified++;
+        _send_(c, document->not_modified, document->not_modified_length);
+        return;
+    }
+
+    _send_(c, document->response, document->length);
+}
+
+static void _handle_request_(LocalConnection *c)
+{
+    state.stats.requests++;
+
+    if(strncmp(c->request, "GET ", 4) != 0){
+        _send_error_(c, response_405, sizeof(response_405) - 1);
+        return;
+    }
+
+    char *path = &c->request[4];
+    size_t path_length = strcspn(path, " ?\r\n");
+
+    for(int i = 0; i < LOCAL_SERVER_DOCUMENTS; i++){
+        LocalDocument *document = &state.documents[i];
+
+        if(strlen(document->path) == path_length && strncmp(path, document->path, path_length) == 0){
+            if(document->stale){
+                c->waiting = document;
+            }
+            else{
+                _serve_(c, document);
+            }
+            return;
+        }
+    }
+
+    _send_error_(c, response_404, sizeof(response_404) - 1);
+}
+
+static err_t _recv_(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    LocalConnection *c = arg;
+
+    // Closed by the client
+    if(p == NULL){
+        _close_(c);
+        return ERR_OK;
+    }
+
+    // Read until the end of the headers. Anything after is ignored
+    if(c->data == NULL && c->waiting == NULL){
+        uint16_t n = pbuf_copy_partial(p, &c->request[c->request_length],
+            sizeof(c->request) - 1 - c->request_length, 0);
+
+        c->request_length += n;
+        c->request[c->request_length] = '\0';
+        c->idle_polls = 0;
+
+        if(strstr(c->request, "\r\n\r\n") != NULL){
+            _handle_request_(c);
+        }
+        else if(c->request_length == sizeof(c->request) - 1){
+            if(strstr(c->request, "\r\n") != NULL){
+                _handle_request_(c);
+            }
+            else{
+                _send_error_(c, response_400, sizeof(response_400) - 1);
+            }
+        }
+    }
+
+    altcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+
+    return ERR_OK;
+}
+
+static err_t _sent_(void *arg, struct altcp_pcb *pcb, u16_t len)
+{
+    LocalConnection *c = arg;
+
+    c->acked += len;
+    c->idle_polls = 0;
+    state.stats.bytes_sent += len;
+
+    if(c->acked == c->length){
+        _close_(c);
+        return ERR_OK;
+    }
+
+    _write_(c);
+
+    return ERR_OK;
+}
+
+// The connection is already freed by lwIP
+static void _err_(void *arg, err_t err)
+{
+    LocalConnection *c = arg;
+
+    if(c != NULL){
+        _release_(c);
+    }
+}
+
+static err_t _poll_(void *arg, struct altcp_pcb *pcb)
+{
+    LocalConnection *c = arg;
+
+    if(c->waiting != NULL || ++c->idle_polls < LOCAL_SERVER_IDLE_POLLS){
+        return ERR_OK;
+    }
+
+    // Aborting calls _err_, which frees the slot
+    altcp_abort(pcb);
+    return ERR_ABRT;
+}
+
+static err_t _accept_(void *arg, struct altcp_pcb *pcb, err_t err)
+{
+    if(err != ERR_OK || pcb == NULL){
+        return ERR_VAL;
+    }
+
+    LocalConnection *c = NULL;
+
+    for(int i = 0; i < LOCAL_SERVER_CONNECTIONS; i++){
+        if(!state.connections[i].used){
+            c = &state.connections[i];
+            break;
+        }
+    }
+
+    // lwIP aborts the connection
+    if(c == NULL){
+        state.stats.refused++;
+        return ERR_MEM;
+    }
+
+    *c = (LocalConnection){.used = true, .pcb = pcb};
+
+    altcp_arg(pcb, c);
+    altcp_recv(pcb, _recv_);
+    altcp_sent(pcb, _sent_);
+    altcp_err(pcb, _err_);
+    altcp_poll(pcb, _poll_, LOCAL_SERVER_POLL_INTERVAL);
+
+    return ERR_OK;
+}
+
+// ===================================================================================
+
+int local_server_init()
+{
+    state.boot_tag = get_rand_32();
+
+    cyw43_arch_lwip_begin();
+
+    struct altcp_pcb *pcb = altcp_tcp_new_ip_type(IPADDR_TYPE_ANY);
+
+    if(pcb == NULL || altcp_bind(pcb, IP_ANY_TYPE, LOCAL_SERVER_PORT) != ERR_OK){
+        if(pcb != NULL){
+            altcp_abort(pcb);
+        }
+        cyw43_arch_lwip_end();
+
+        printf("Local server: could not listen on port %u\n", LOCAL_SERVER_PORT);
+        return -1;
+    }
+
+    state.listener = altcp_listen(pcb);
+
+    if(state.listener == NULL){
+        altcp_abort(pcb);
+    }
+    else{
+        altcp_accept(state.listener, _accept_);
+    }
+
+    cyw43_arch_lwip_end();
+
+    return state.listener != NULL ? 0 : -1;
+}
+
+void local_server_poll()
+{
+    bool changed = false;
+
+    for(int i = 0; i < get_station_count(); i++){
+        LocalHistory *history = &state.history[i];
+
+        if(station_data_generation(i) == history->generation){
+            continue;
+        }
+
+        int32_t age_ms = get_station_data_age_ms(i);
+        if(age_ms < 0){
+            continue;
+        }
+
+        LocalReading *reading = &history->readings[history->next];
+        reading->data = read_station_data(i, &history->generation);
+        reading->received_ms = to_ms_since_boot(get_absolute_time()) - age_ms;
+
+        history->next = (history->next + 1) % LOCAL_SERVER_HISTORY;
+        if(history->count < LOCAL_SERVER_HISTORY){
+            history->count++;
+        }
+
+        changed = true;
+    }
+
+    for(int i = 0; changed && i < LOCAL_SERVER_DOCUMENTS; i++){
+        state.documents[i].stale = true;
+    }
+
+    bool pending = false;
+    for(int i = 0; i < LOCAL_SERVER_DOCUMENTS; i++){
+        pending |= state.documents[i].stale && state.documents[i].senders == 0;
+    }
+
+    if(!pending){
+        return;
+    }
+
+    cyw43_arch_lwip_begin();
+
+    for(int i = 0; i < LOCAL_SERVER_DOCUMENTS; i++){
+        LocalDocument *document = &state.documents[i];
+
+        if(!document->stale || document->senders > 0){
+            continue;
+        }
+
+        _build_(document);
+
+        for(int j = 0; j < LOCAL_SERVER_CONNECTIONS; j++){
+            LocalConnection *c = &state.connections[j];
+
+            if(c->used && c->waiting == document){
+                _serve_(c, document);
+            }
+        }
+    }
+
+    cyw43_arch_lwip_end();
+}
+
+LocalServerStats local_server_get_stats()
+{
+    return state.stats;
+}
@@ -0,0 +1,58 @@
+#ifndef LOCALSERVER_H
+#define LOCALSERVER_H
+
+#include <stdint.h>
+
+/*
+HTTP server for the LAN, so dashboards read the readings from the base
+station instead of each polling the weather server.
+
+Paths, all JSON:
+
+    /latest      Latest reading of each station
+    /aggregates  Min, mean and max of each metric over the history
+    /history     Last LOCAL_SERVER_HISTORY readings of each station
+
+Each document is serialised, headers included, into a static buffer when
+a reading arrives, not when it is requested. A request is then a single
+write from that buffer without copying. Every build gets a new ETag, and
+a request with a matching If-None-Match gets 304 Not Modified.
+
+A buffer is rebuilt only once no connection is sending from it. Requests
+arriving while a rebuild is waiting are answered after it.
+
+Times are in ms since boot of the base station, as given by uptime_ms.
+*/
+
+#define LOCAL_SERVER_PORT 80
+
+// Readings kept for /history and /aggregates, per station
+#define LOCAL_SERVER_HISTORY 16
+
+// Max number of clients served at once
+#define LOCAL_SERVER_CONNECTIONS 4
+
+typedef struct{
+    uint32_t requests;
+    uint32_t not_modified;  // 304 responses
+    uint32_t errors;        // 4xx and 5xx responses
+    uint32_t refused;       // Connections refused as all slots were in use
+    uint32_t builds;        // Documents serialised
+    uint32_t bytes_sent;
+} LocalServerStats;
+
+/**
+ * @brief Listen on LOCAL_SERVER_PORT
+ *
+ * @return 0 on success, -1 if the listening connection could not be made
+ */
+int local_server_init();
+
+/**
+ * @brief Record new readings and rebuild documents. Call from the main loop
+ */
+void local_server_poll();
+
+LocalServerStats local_server_get_stats();
+
+#endif //LOCALSERVER_H
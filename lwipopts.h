@@ -19,8 +19,16 @@
 #define MEM_LIBC_MALLOC             0
 #endif
 #define MEM_ALIGNMENT               4
+// The TLS config, the CA certificate and the state of each TLS connection
+// are allocated from this heap. mbedtls itself uses the C heap
+#if BASESTATION_USE_TLS
+#define MEM_SIZE                    8000
+#else
 #define MEM_SIZE                    4000
+#endif
 #define MEMP_NUM_TCP_SEG            32
+// One request per station, the local server's listener and its clients
+#define MEMP_NUM_TCP_PCB            10
 #define MEMP_NUM_ARP_QUEUE          10
 #define PBUF_POOL_SIZE              24
 #define LWIP_ARP                    1
@@ -35,10 +43,20 @@
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
-#define MEM_STATS                   0
+// Counters read by netstats.c. Kept on in release builds, the protocol
+// counters nothing reads are off to save RAM
+#define LWIP_STATS                  1
+#define MEM_STATS                   1
+#define MEMP_STATS                  1
+#define LINK_STATS                  1
+#define TCP_STATS                   1
+#define MIB2_STATS                  1
 #define SYS_STATS                   0
-#define MEMP_STATS                  0
-#define LINK_STATS                  0
+#define IP_STATS                    0
+#define IPFRAG_STATS                0
+#define UDP_STATS                   0
+#define ICMP_STATS                  0
+#define ETHARP_STATS                0
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM       3
 #define LWIP_DHCP                   1
@@ -46,6 +64,10 @@
 #define LWIP_TCP                    1
 #define LWIP_UDP                    1
 #define LWIP_DNS                    1
+// Peer mode joins a multicast group, see server_interface.h
+#if BASESTATION_PEERS
+#define LWIP_IGMP                   1
+#endif
 #define LWIP_TCP_KEEPALIVE          1
 #define LWIP_NETIF_TX_SINGLE_PBUF   1
 #define DHCP_DOES_ARP_CHECK         0
@@ -53,7 +75,6 @@
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
-#define LWIP_STATS                  1
 #define LWIP_STATS_DISPLAY          1
 #endif
 
@@ -96,6 +117,9 @@
 // If you don't want to use TLS (just a http request) you can avoid linking to mbedtls and remove the following
 #define LWIP_ALTCP_TLS           1
 #define LWIP_ALTCP_TLS_MBEDTLS   1
+// Fail the handshake if the server certificate does not verify.
+// lwIP's default only reports the result
+#define ALTCP_MBEDTLS_AUTHMODE   MBEDTLS_SSL_VERIFY_REQUIRED
 
 // Note bug in lwip with LWIP_ALTCP and LWIP_DEBUG
 // https://savannah.nongnu.org/bugs/index.php?62159
@@ -0,0 +1,24 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "server_interface.h"
+
+#define METRIC_INFO_(id, field, json_key, label, unit, decimals, limit, min, max, hysteresis) \
+    [METRIC_##id] = {json_key, label, unit, offsetof(WeatherStationData, field), decimals, limit, min, max, hysteresis},
+
+const MetricInfo metric_info[METRICS] = {
+    WEATHER_METRICS(METRIC_INFO_)
+};
+
+float metric_value(const WeatherStationData *data, uint8_t metric)
+{
+    float value;
+    memcpy(&value, (const uint8_t *)data + metric_info[metric].offset, sizeof(value));
+    return value;
+}
+
+void metric_set_value(WeatherStationData *data, uint8_t metric, float value)
+{
+    memcpy((uint8_t *)data + metric_info[metric].offset, &value, sizeof(value));
+}
@@ -0,0 +1,65 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Table of the metrics reported by the weather stations.
+
+Each line describes one metric:
+
+    X(id, field, json_key, label, unit, decimals, limit, min, max, hysteresis)
+
+    id          Metric name, METRIC_<id> in enum weather_metric
+    field       Field of WeatherStationData
+    json_key    Key of the value in the station response
+    label       Name on the display
+    unit        Unit on the display
+    decimals    Digits shown after the decimal point
+    limit       true if a buzzer limit can be set for the metric
+    min, max    Range of buzzer limits, which also sets the entry width
+    hysteresis  Distance below the buzzer limit at which the alarm clears
+
+WeatherStationData, the JSON parser, the data and buzzer limit pages and
+the alarm engine are all generated from the table, so a new metric is
+one line here. Readings and buzzer limits are stored in flash in table
+order, so new metrics go at the end.
+*/
+#define WEATHER_METRICS(X) \
+    X(TEMP,     temp,          "temp",       "Temp",  "C",   1, true,  0, 60,  0.5f) \
+    X(HUMID,    humidity,      "humidity",   "Humid", "%",   1, true,  0, 100, 2.0f) \
+    X(WIND_SPD, wind_spd,      "wind_speed", "W sp",  "m/s", 1, true,  0, 60,  1.0f) \
+    X(WIND_DIR, wind_dir,      "wind_dir",   "W dir", "deg", 1, false, 0, 360, 0.0f) \
+    X(PRES,     pressure,      "pressure",   "Pres",  "MPa", 1, true,  0, 200, 0.1f) \
+    X(SMOKE,    smoke,         "smoke",      "Smoke", "%",   1, true,  0, 100, 2.0f) \
+    X(LIGHT,    ambient_light, "ambient",    "Light", "%",   1, true,  0, 100, 2.0f)
+
+#define METRIC_ENUM_(id, field, json_key, label, unit, decimals, limit, min, max, hysteresis) METRIC_##id,
+
+enum weather_metric{
+    WEATHER_METRICS(METRIC_ENUM_)
+    METRICS
+};
+
+typedef struct{
+    const char *json_key;
+    const char *label;
+    const char *unit;
+    uint8_t offset;     // Offset of the field in WeatherStationData
+    uint8_t decimals;
+    bool limit;
+    float min;
+    float max;
+    float hysteresis;
+} MetricInfo;
+
+typedef struct WeatherStationData WeatherStationData;
+
+extern const MetricInfo metric_info[METRICS];
+
+float metric_value(const WeatherStationData *data, uint8_t metric);
+
+void metric_set_value(WeatherStationData *data, uint8_t metric, float value);
+
+#endif //METRICS_H
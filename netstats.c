@@ -0,0 +1,119 @@
+#include <stdio.h>
+
+#include "pico/cyw43_arch.h"
+#include "lwip/netif.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#include "netstats.h"
+#include "server_interface.h"
+
+static const struct{
+    const char *name;
+    memp_t pool;
+} pools[NET_POOLS] = {
+    [NET_POOL_HEAP] = {"heap", 0},
+    [NET_POOL_PBUF_POOL] = {"pbuf_pool", MEMP_PBUF_POOL},
+    [NET_POOL_PBUF] = {"pbuf", MEMP_PBUF},
+    [NET_POOL_TCP_PCB] = {"tcp_pcb", MEMP_TCP_PCB},
+    [NET_POOL_TCP_SEG] = {"tcp_seg", MEMP_TCP_SEG},
+    [NET_POOL_ALTCP_PCB] = {"altcp_pcb", MEMP_ALTCP_PCB},
+    [NET_POOL_UDP_PCB] = {"udp_pcb", MEMP_UDP_PCB},
+    [NET_POOL_TIMEOUT] = {"timeout", MEMP_SYS_TIMEOUT},
+};
+
+static struct NetStatsState{
+    // Driver functions wrapped to count bytes
+    netif_input_fn input;
+    netif_linkoutput_fn linkoutput;
+
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+} state;
+
+static err_t count_input(struct pbuf *p, struct netif *netif)
+{
+    state.bytes_in += p->tot_len;
+    return state.input(p, netif);
+}
+
+static err_t count_linkoutput(struct netif *netif, struct pbuf *p)
+{
+    state.bytes_out += p->tot_len;
+    return state.linkoutput(netif, p);
+}
+
+void net_stats_init()
+{
+    struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+
+    cyw43_arch_lwip_begin();
+    if(state.input == NULL){
+        state.input = netif->input;
+        state.linkoutput = netif->linkoutput;
+
+        netif->input = count_input;
+        netif->linkoutput = count_linkoutput;
+    }
+    cyw43_arch_lwip_end();
+}
+
+NetPoolStats net_stats_pool(enum net_pool pool)
+{
+    NetPoolStats result = {.name = pools[pool].name};
+
+    cyw43_arch_lwip_begin();
+    const struct stats_mem *mem = pool == NET_POOL_HEAP ? &lwip_stats.mem : lwip_stats.memp[pools[pool].pool];
+
+    result.used = mem->used;
+    result.max = mem->max;
+    result.size = mem->avail;
+    result.err = mem->err;
+    cyw43_arch_lwip_end();
+
+    return result;
+}
+
+NetTrafficStats net_stats_traffic()
+{
+    NetTrafficStats result;
+
+    cyw43_arch_lwip_begin();
+    result.bytes_in = state.bytes_in;
+    result.bytes_out = state.bytes_out;
+    result.packets_in = lwip_stats.link.recv;
+    result.packets_out = lwip_stats.link.xmit;
+    result.link_drop = lwip_stats.link.drop;
+    result.tcp_retransmits = lwip_stats.mib2.tcpretranssegs;
+
+    result.alloc_failures = lwip_stats.mem.err;
+    for(int i = 0; i < MEMP_MAX; i++){
+        result.alloc_failures += lwip_stats.memp[i]->err;
+    }
+    cyw43_arch_lwip_end();
+
+    return result;
+}
+
+void net_stats_print()
+{
+    printf("%-10s %6s %6s %6s %6s\n", "pool", "used", "max", "size", "err");
+
+    for(int i = 0; i < NET_POOLS; i++){
+        NetPoolStats pool = net_stats_pool(i);
+        printf("%-10s %6lu %6lu %6lu %6lu\n", pool.name, (unsigned long)pool.used, (unsigned long)pool.max,
+            (unsigned long)pool.size, (unsigned long)pool.err);
+    }
+
+    NetTrafficStats traffic = net_stats_traffic();
+    printf("in %lu bytes / %lu packets, out %lu bytes / %lu packets, %lu dropped\n",
+        (unsigned long)traffic.bytes_in, (unsigned long)traffic.packets_in,
+        (unsigned long)traffic.bytes_out, (unsigned long)traffic.packets_out, (unsigned long)traffic.link_drop);
+    printf("tcp retransmits %lu, allocation failures %lu\n",
+        (unsigned long)traffic.tcp_retransmits, (unsigned long)traffic.alloc_failures);
+
+    ServerStats server = get_server_stats();
+    printf("requests %lu: %lu done, %lu failed, %lu retries, %lu timeouts, %lu bytes received\n",
+        (unsigned long)server.requests, (unsigned long)server.done, (unsigned long)server.failed,
+        (unsigned long)server.retries, (unsigned long)server.timeouts, (unsigned long)server.bytes_received);
+}
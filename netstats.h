@@ -0,0 +1,62 @@
+#ifndef NETSTATS_H
+#define NETSTATS_H
+
+#include <stdint.h>
+
+/*
+Network and memory statistics.
+
+Reads the always-on lwIP counters (see lwipopts.h) and counts bytes on
+the WiFi interface. Used by the "net" console command and the diagnostics
+page to see how close the lwIP heap and pools are to running out.
+*/
+
+typedef struct{
+    const char *name;
+    uint32_t used;
+    uint32_t max;       // High-water mark
+    uint32_t size;
+    uint32_t err;       // Failed allocations
+} NetPoolStats;
+
+typedef struct{
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    uint32_t packets_in;
+    uint32_t packets_out;
+    uint32_t link_drop;
+    uint32_t tcp_retransmits;
+
+    // Failed allocations in the heap and all pools
+    uint32_t alloc_failures;
+} NetTrafficStats;
+
+// Pools reported by net_stats_pool. The lwIP heap is pool 0
+enum net_pool{
+    NET_POOL_HEAP = 0,
+    NET_POOL_PBUF_POOL,
+    NET_POOL_PBUF,
+    NET_POOL_TCP_PCB,
+    NET_POOL_TCP_SEG,
+    NET_POOL_ALTCP_PCB,
+    NET_POOL_UDP_PCB,
+    NET_POOL_TIMEOUT,
+    NET_POOLS
+};
+
+/**
+ * @brief Start counting bytes on the WiFi interface. 
+ * Must be called after the WiFi driver has been initialized.
+ */
+void net_stats_init();
+
+NetPoolStats net_stats_pool(enum net_pool pool);
+
+NetTrafficStats net_stats_traffic();
+
+/**
+ * @brief Print heap, pool, traffic and request statistics over stdio
+ */
+void net_stats_print();
+
+#endif //NETSTATS_H
@@ -0,0 +1,125 @@
+#include "profiler.h"
+
+#if BASESTATION_PROFILE
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+// SysTick is a 24 bit down counter
+#define SYSTICK_MASK 0x00FFFFFF
+
+// Zones longer than this are timed with the microsecond timer, as the
+// SysTick counter wraps after about 130 ms at 125 MHz
+#define PROF_SYSTICK_MAX_US 100000
+
+typedef struct{
+    uint32_t count;
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+    uint32_t histogram[PROF_BUCKETS];
+} ProfZone;
+
+static const char *zone_names[PROF_ZONES] = {
+    [PROF_DISPLAY_WRITE] = "_display_write_",
+    [PROF_POLL_KEYPAD] = "poll_keypad",
+    [PROF_PARSE_JSON] = "parse_weatherstation_json",
+    [PROF_RECV_FN] = "recv_fn",
+    [PROF_UI_WELCOME] = "welcome_page",
+    [PROF_UI_DATA] = "data_page",
+    [PROF_UI_SETTINGS] = "settings_page",
+    [PROF_UI_SETTINGS_WIFI] = "wifi_settings_page",
+    [PROF_UI_SETTINGS_BUZZER] = "buzzer_settings_page",
+};
+
+static struct ProfState{
+    uint32_t cycles_per_us;
+    ProfZone zones[PROF_ZONES];
+} state;
+
+void prof_init()
+{
+    state.cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+
+    // Processor clock, no interrupt, counting from the max reload value
+    systick_hw->rvr = SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+
+    prof_reset();
+}
+
+prof_mark_t prof_begin()
+{
+    return (prof_mark_t){.us = time_us_32(), .systick = systick_hw->cvr};
+}
+
+void prof_end(enum prof_zone zone, prof_mark_t start)
+{
+    uint32_t systick = systick_hw->cvr;
+    uint32_t elapsed_us = time_us_32() - start.us;
+
+    uint32_t cycles;
+    if(elapsed_us < PROF_SYSTICK_MAX_US){
+        cycles = (start.systick - systick) & SYSTICK_MASK;
+    }
+    else{
+        cycles = elapsed_us * state.cycles_per_us;
+    }
+
+    ProfZone *z = &state.zones[zone];
+
+    z->count++;
+    z->total += cycles;
+    if(cycles < z->min){
+        z->min = cycles;
+    }
+    if(cycles > z->max){
+        z->max = cycles;
+    }
+
+    uint8_t bucket = cycles == 0 ? 0 : 31 - __builtin_clz(cycles);
+    z->histogram[bucket]++;
+}
+
+void prof_reset()
+{
+    memset(state.zones, 0, sizeof(state.zones));
+
+    for(int i = 0; i < PROF_ZONES; i++){
+        state.zones[i].min = UINT32_MAX;
+    }
+}
+
+void prof_dump()
+{
+    printf("%-26s %8s %12s %10s %10s %10s  (cycles, %lu per us)\n", "zone", "count", "total", "min", "mean", "max",
+        (unsigned long)state.cycles_per_us);
+
+    for(int i = 0; i < PROF_ZONES; i++){
+        const ProfZone *z = &state.zones[i];
+
+        if(z->count == 0){
+            printf("%-26s %8u\n", zone_names[i], 0);
+            continue;
+        }
+
+        printf("%-26s %8lu %12llu %10lu %10lu %10lu\n", zone_names[i], (unsigned long)z->count,
+            (unsigned long long)z->total, (unsigned long)z->min, (unsigned long)(z->total / z->count), (unsigned long)z->max);
+
+        // Histogram as "2^n:count" for non-empty buckets
+        printf("%26s", "");
+        for(int b = 0; b < PROF_BUCKETS; b++){
+            if(z->histogram[b]){
+                printf(" 2^%d:%lu", b, (unsigned long)z->histogram[b]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+#endif //BASESTATION_PROFILE
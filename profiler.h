@@ -0,0 +1,75 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+/*
+Cycle profiler for hot paths.
+
+Zones are bracketed with PROF_BEGIN/PROF_END, or PROF_ZONE around a single
+statement. Each zone accumulates count, total, min and max cycles and a
+log2 histogram. Short zones are timed with the SysTick cycle counter and
+zones longer than the SysTick period with the microsecond timer.
+
+Only enabled when built with BASESTATION_PROFILE. Otherwise the macros
+expand to nothing and no profiler code or data is linked.
+
+Zones are timed on core 0. Each zone must only be entered from one
+context (main loop or IRQ), since statistics are updated without locking.
+*/
+
+enum prof_zone{
+    PROF_DISPLAY_WRITE = 0,
+    PROF_POLL_KEYPAD,
+    PROF_PARSE_JSON,
+    PROF_RECV_FN,
+    PROF_UI_WELCOME,
+    PROF_UI_DATA,
+    PROF_UI_SETTINGS,
+    PROF_UI_SETTINGS_WIFI,
+    PROF_UI_SETTINGS_BUZZER,
+    PROF_ZONES
+};
+
+// Number of histogram buckets. Bucket n counts zones taking [2^n, 2^(n+1)) cycles
+#define PROF_BUCKETS 32
+
+#if BASESTATION_PROFILE
+
+typedef struct{
+    uint32_t us;
+    uint32_t systick;
+} prof_mark_t;
+
+/**
+ * @brief Start SysTick as a free running cycle counter
+ */
+void prof_init();
+
+prof_mark_t prof_begin();
+
+void prof_end(enum prof_zone zone, prof_mark_t start);
+
+/**
+ * @brief Print table of all zones over stdio
+ */
+void prof_dump();
+
+/**
+ * @brief Clear all zone statistics
+ */
+void prof_reset();
+
+#define PROF_BEGIN(zone) prof_mark_t _prof_mark_##zone = prof_begin()
+#define PROF_END(zone) prof_end(zone, _prof_mark_##zone)
+#define PROF_ZONE(zone, statement) do{ PROF_BEGIN(zone); statement; PROF_END(zone); } while(0)
+
+#else
+
+#define PROF_BEGIN(zone) ((void)0)
+#define PROF_END(zone) ((void)0)
+#define PROF_ZONE(zone, statement) do{ statement; } while(0)
+
+#endif //BASESTATION_PROFILE
+
+#endif //PROFILER_H
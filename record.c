@@ -0,0 +1,100 @@
+#include "record.h"
+
+#if BASESTATION_RECORD
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+
+// Bytes of the record header
+#define RECORD_HEADER 7
+
+static struct RecordState{
+    uint8_t record[RECORD_HEADER + RECORD_MAX_PAYLOAD];
+
+    // "R ", two digits per byte, newline and terminator
+    char line[2 + 2 * (RECORD_HEADER + RECORD_MAX_PAYLOAD) + 2];
+} state;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Write the record in state.record with length bytes of payload. Must be
+// called with the lwIP lock held, which keeps records from the main loop
+// and the network callbacks apart
+static void _write_(enum record_type type, uint16_t length)
+{
+    uint32_t time_ms = to_ms_since_boot(get_absolute_time());
+
+    state.record[0] = time_ms;
+    state.record[1] = time_ms >> 8;
+    state.record[2] = time_ms >> 16;
+    state.record[3] = time_ms >> 24;
+    state.record[4] = type;
+    state.record[5] = length;
+    state.record[6] = length >> 8;
+
+    char *c = state.line;
+    *c++ = 'R';
+    *c++ = ' ';
+
+    for(int i = 0; i < RECORD_HEADER + length; i++){
+        *c++ = hex_digits[state.record[i] >> 4];
+        *c++ = hex_digits[state.record[i] & 0xf];
+    }
+
+    *c++ = '\n';
+    *c = '\0';
+
+    // One write per record so other output does not split it
+    fputs(state.line, stdout);
+}
+
+void record_start()
+{
+    printf("RECORD %d\n", RECORD_VERSION);
+}
+
+void record_key(char key)
+{
+    cyw43_arch_lwip_begin();
+    state.record[RECORD_HEADER] = key;
+    _write_(RECORD_KEY, 1);
+    cyw43_arch_lwip_end();
+}
+
+void record_wifi(uint8_t event)
+{
+    cyw43_arch_lwip_begin();
+    state.record[RECORD_HEADER] = event;
+    _write_(RECORD_WIFI, 1);
+    cyw43_arch_lwip_end();
+}
+
+void record_http_body(uint8_t station, const char *body, uint16_t length)
+{
+    if(length > RECORD_MAX_PAYLOAD - 1){
+        length = RECORD_MAX_PAYLOAD - 1;
+    }
+
+    state.record[RECORD_HEADER] = station;
+    memcpy(&state.record[RECORD_HEADER + 1], body, length);
+
+    _write_(RECORD_HTTP_BODY, 1 + length);
+}
+
+void record_http_result(uint8_t station, uint8_t result, uint16_t srv_res, int8_t err)
+{
+    uint8_t *payload = &state.record[RECORD_HEADER];
+
+    payload[0] = station;
+    payload[1] = result;
+    payload[2] = err;
+    payload[3] = srv_res;
+    payload[4] = srv_res >> 8;
+
+    _write_(RECORD_HTTP_RESULT, 5);
+}
+
+#endif //BASESTATION_RECORD
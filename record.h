@@ -0,0 +1,68 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+
+/*
+Recording of the inputs of a session for deterministic replay.
+
+Every HTTP response, WiFi event and key press is written to stdio as it
+happens, one record per line, between the other output. Capture the USB
+serial output of a session to a file, for example
+
+    cat /dev/ttyACM0 > session.txt
+
+and feed it through the host build with host/replay, which reproduces
+the session under the virtual clock.
+
+The log is line based: a "RECORD <version>" header at boot, then one
+"R <hex>" line per record. A record is little endian: uint32 time_ms,
+uint8 type, uint16 length and length bytes of payload.
+
+Only enabled when built with BASESTATION_RECORD. Otherwise the macros
+expand to nothing.
+*/
+
+// Version of the log format
+#define RECORD_VERSION 1
+
+// Longest payload recorded. Longer response bodies are cut
+#define RECORD_MAX_PAYLOAD 512
+
+enum record_type{
+    RECORD_KEY = 0,         // uint8 key
+    RECORD_WIFI,            // uint8 enum wifi_event
+    RECORD_HTTP_BODY,       // uint8 station, body bytes. Written whole before the result
+    RECORD_HTTP_RESULT,     // uint8 station, uint8 httpc result, int8 err, uint16 HTTP status
+    RECORD_TYPES
+};
+
+#if BASESTATION_RECORD
+
+/**
+ * @brief Print the log header. Call once stdio is up
+ */
+void record_start();
+
+void record_key(char key);
+void record_wifi(uint8_t event);
+void record_http_body(uint8_t station, const char *body, uint16_t length);
+void record_http_result(uint8_t station, uint8_t result, uint16_t srv_res, int8_t err);
+
+#define RECORD_START() record_start()
+#define RECORD_KEY(key) record_key(key)
+#define RECORD_WIFI(event) record_wifi(event)
+#define RECORD_HTTP_BODY(station, body, length) record_http_body(station, body, length)
+#define RECORD_HTTP_RESULT(station, result, srv_res, err) record_http_result(station, result, srv_res, err)
+
+#else
+
+#define RECORD_START() ((void)0)
+#define RECORD_KEY(key) ((void)0)
+#define RECORD_WIFI(event) ((void)0)
+#define RECORD_HTTP_BODY(station, body, length) ((void)0)
+#define RECORD_HTTP_RESULT(station, result, srv_res, err) ((void)0)
+
+#endif //BASESTATION_RECORD
+
+#endif //RECORD_H
@@ -0,0 +1,48 @@
+#include <string.h>
+
+#include "seqlock.h"
+
+void seqlock_write(seqlock_t *lock, void *dst, const void *src, size_t size)
+{
+    // Only one writer, so no read-modify-write is needed. The RP2040
+    // has no atomic read-modify-write instructions
+    uint32_t sequence = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&lock->sequence, sequence + 1, memory_order_relaxed);
+
+    // Odd sequence must be visible before the data changes
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(dst, src, size);
+
+    atomic_store_explicit(&lock->sequence, sequence + 2, memory_order_release);
+}
+
+uint32_t seqlock_read(seqlock_t *lock, void *dst, const void *src, size_t size)
+{
+    uint32_t start;
+    uint32_t end;
+
+    do{
+        start = atomic_load_explicit(&lock->sequence, memory_order_acquire);
+
+        // Write in progress
+        if(start & 1){
+            continue;
+        }
+
+        memcpy(dst, src, size);
+
+        // Data must be copied before the sequence is checked again
+        atomic_thread_fence(memory_order_acquire);
+
+        end = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+    } while((start & 1) || start != end);
+
+    return start / 2;
+}
+
+uint32_t seqlock_generation(seqlock_t *lock)
+{
+    return atomic_load_explicit(&lock->sequence, memory_order_acquire) / 2;
+}
@@ -0,0 +1,44 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Sequence lock for publishing snapshots from one writer to any number of
+readers without locks or masking interrupts.
+
+The writer makes the sequence odd, copies the data and makes it even
+again. A reader copies the data and retries if the sequence was odd or
+changed during the copy. The sequence divided by two is the generation
+of the snapshot, so readers can check if it changed since the last read.
+
+There must only be one writer at a time. Readers never block the writer,
+but a reader must not run in an interrupt that can preempt the writer on
+the same core, as it would wait for a write that cannot finish.
+*/
+
+typedef struct{
+    atomic_uint_least32_t sequence;
+} seqlock_t;
+
+/**
+ * @brief Copy size bytes from src to the protected data at dst
+ * and advance the generation
+ */
+void seqlock_write(seqlock_t *lock, void *dst, const void *src, size_t size);
+
+/**
+ * @brief Copy a consistent snapshot of the protected data at src to dst
+ *
+ * @return Generation of the snapshot
+ */
+uint32_t seqlock_read(seqlock_t *lock, void *dst, const void *src, size_t size);
+
+/**
+ * @brief Generation of the last completed write. Starts at 0
+ */
+uint32_t seqlock_generation(seqlock_t *lock);
+
+#endif //SEQLOCK_H
@@ -1,74 +1,1338 @@
 #include "lwip/apps/http_client.h"
+#include "lwip/altcp_tcp.h"
+#include "lwip/dns.h"
+#include "lwip/tcp.h"
 #include "pico/cyw43_arch.h"
 #include "pico/lwip_nosys.h"
+#include "pico/rand.h"
+#include <string.h>
 
 #include "server_interface.h"
 #include "json.h"
+#include "seqlock.h"
+#include "boot.h"
+#include "profiler.h"
+#include "trace.h"
+#include "record.h"
 
+#if BASESTATION_PEERS
+#include "lwip/udp.h"
+#include "lwip/igmp.h"
+#include "siphash.h"
+#endif
 
+#if BASESTATION_USE_TLS
+#include <stdlib.h>
+#include "lwip/altcp_tls.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/platform.h"
+#include "tls_ca.h"
+#endif
 
-bool _new_data = false;
+#define HTTPS_DEFAULT_PORT 443
 
-static WeatherStationData last_data = {0};
+// Time from a lookup to the next one. lwIP does not
+// pass the record TTL to the callback, but answers from its own TTL-respecting
+// cache, so a refresh only goes out on the network once the record has expired
+#define DNS_CACHE_TTL_MS (5 * 60 * 1000)
+
+// Refresh addresses this much early so polls never wait on DNS
+#define DNS_REFRESH_MARGIN_MS (30 * 1000)
+
+// Retry interval for failed lookups
+#define DNS_RETRY_MS (10 * 1000)
+
+// Time allowed in each request phase before the request is aborted.
+// The TLS handshake is part of waiting for headers, as the TCP
+// connection is established before the handshake starts
+#define REQUEST_RESOLVE_TIMEOUT_MS 5000
+#define REQUEST_CONNECT_TIMEOUT_MS 5000
+#define REQUEST_HEADERS_TIMEOUT_MS 8000
+#define REQUEST_RECEIVE_TIMEOUT_MS 5000
+
+// Default retry policy, see ServerPolicy. Failed requests are retried this
+// many times before giving up until the next scheduled request
+#define REQUEST_MAX_RETRIES 3
+
+// Default backoff before retrying a failed request. Doubled after every
+// failure and reset when a request succeeds
+#define REQUEST_BACKOFF_MIN_MS 1000
+#define REQUEST_BACKOFF_MAX_MS 30000
+
+static const uint32_t request_timeout_ms[REQUEST_PHASES] = {
+    [REQUEST_RESOLVING] = REQUEST_RESOLVE_TIMEOUT_MS,
+    [REQUEST_CONNECTING] = REQUEST_CONNECT_TIMEOUT_MS,
+    [REQUEST_AWAIT_HEADERS] = REQUEST_HEADERS_TIMEOUT_MS,
+    [REQUEST_RECEIVING] = REQUEST_RECEIVE_TIMEOUT_MS,
+};
+
+static const char *request_phase_names[REQUEST_PHASES] = {
+    [REQUEST_RESOLVING] = "resolve",
+    [REQUEST_CONNECTING] = "connect",
+    [REQUEST_AWAIT_HEADERS] = "headers",
+    [REQUEST_RECEIVING] = "receive",
+};
+
+// Weatherstation server endpoints in order of priority. If a request to one
+// endpoint fails the next endpoint with a resolved address is used. All
+// endpoints of a build use one protocol, so a failing TLS connection never
+// falls back to plain HTTP. The fallback host is set with the
+// BASESTATION_FALLBACK_HOST CMake option
+static const ServerEndpoint endpoints[] = {
+#if BASESTATION_USE_TLS
+    {.hostname = BASESTATION_TLS_HOST, .port = HTTPS_DEFAULT_PORT, .path = "/WeatherStation/", .protocol = SERVER_HTTPS},
+#ifdef BASESTATION_FALLBACK_HOST
+    {.hostname = BASESTATION_FALLBACK_HOST, .port = HTTPS_DEFAULT_PORT, .path = "/WeatherStation/", .protocol = SERVER_HTTPS},
+#endif
+#else
+    {.hostname = "217.160.149.219", .port = HTTP_DEFAULT_PORT, .path = "/WeatherStation/", .protocol = SERVER_HTTP},
+#ifdef BASESTATION_FALLBACK_HOST
+    {.hostname = BASESTATION_FALLBACK_HOST, .port = HTTP_DEFAULT_PORT, .path = "/WeatherStation/", .protocol = SERVER_HTTP},
+#endif
+#endif
+};
+
+#define N_ENDPOINTS (sizeof(endpoints) / sizeof(endpoints[0]))
+
+// Resolved address of an endpoint. The last good address is used until
+// a refresh succeeds
+struct EndpointCache{
+    ip_addr_t addr;
+    absolute_time_t next_lookup;
+    bool resolved;
+    bool resolving;
+};
+
+#if BASESTATION_PEERS
+#define PEER_MAGIC 0x53425057
+#define PEER_VERSION 2
+
+enum peer_packet_type{PEER_HELLO, PEER_DATA};
+
+// Set while the sender cannot reach the server
+#define PEER_FLAG_UPSTREAM_DOWN 0x01
+
+// Datagram exchanged by base stations, in the byte order of the RP2040,
+// which the host build shares. Announcements leave the reading empty
+typedef struct{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint8_t station;        // Station index of the reading
+    uint8_t n_metrics;
+    uint32_t node;
+    uint32_t seq;           // Sequence number of the reading
+    uint8_t flags;
+    uint8_t reserved[3];
+    float values[METRICS];
+    uint64_t mac;           // SipHash-2-4 of the fields above under the peer key
+} PeerPacket;
+
+// Peer mode state, see server_interface.h
+struct PeerState{
+    struct udp_pcb *pcb;
+    ip_addr_t group;
+
+    // Next announcement, or next attempt to open the pcb
+    absolute_time_t next_hello;
+
+    // When the leader was last heard from, and when it last sent a
+    // reading or was elected
+    absolute_time_t leader_seen;
+    absolute_time_t leader_data;
+
+    // Whether the leader reaches the server, from its last datagram
+    bool leader_upstream;
+
+    // Failed attempts in a row, reset by a response
+    uint32_t upstream_failures;
+
+    // Last sequence number sent, and last one accepted from the leader
+    uint32_t seq;
+    uint32_t leader_seq;
+
+    // Role last printed, and whether a stale leader was last reported
+    bool following;
+    bool stale;
+
+    uint8_t key[SIPHASH_KEY_LENGTH];
+
+    PeerStats stats;
+};
+#endif
+
+// Max length of a request URI (endpoint path + station path)
+#define URI_LENGTH 64
+
+// Max length of a response body. Longer responses are failed
+#define BODY_LENGTH 512
+
+// Station data published from the lwIP callbacks to the main loop
+typedef struct{
+    WeatherStationData data;
+    absolute_time_t received;
+    bool valid;
+    bool stale;
+} StationSnapshot;
+
+// Per-station data slot and request context. The context is passed as the
+// callback argument so concurrent requests each update their own slot
+typedef struct{
+    const char* name;
+    const char* path;
+
+    // Written only from lwIP context and read with seqlock_read
+    StationSnapshot snapshot;
+    seqlock_t lock;
+
+    // Generation last returned by get_station_data. Main loop only
+    uint32_t read_generation;
+
+    // Request state. Only changed with the lwIP lock held
+    enum request_state request;
+    const ServerEndpoint *endpoint;
+    char uri[URI_LENGTH];
+    struct altcp_pcb *pcb;
+    absolute_time_t request_start;
+    absolute_time_t phase_start;
+    bool first_byte_received;
+#if BASESTATION_USE_TLS
+    // Whether the connection offered the saved TLS session
+    bool offered_session;
+#endif
+
+    // Response body as received so far. Parsed once the request completed
+    // with status 200, so error pages and partial bodies are never published
+    char body[BODY_LENGTH + 1];
+    uint16_t body_length;
+    bool body_truncated;
+
+    // Time spent in each phase of the last request
+    uint32_t phase_ms[REQUEST_PHASES];
+
+    // Retries of a failed request
+    uint8_t attempt;
+    bool retry_pending;
+    absolute_time_t retry_at;
+    uint32_t backoff_ms;
+
+    // Completion not yet reported by server_poll
+    enum server_event event;
+} WeatherStation;
+
+// Request state of the base station. Kept in one struct so the host fleet
+// simulator can run many base stations on one copy of the module
+static struct ServerState{
+    // Resolved address cache for each endpoint
+    struct EndpointCache endpoint_cache[N_ENDPOINTS];
+
+    // Index of the endpoint currently used for requests
+    uint8_t active_endpoint;
+
+    // Station registry. Stations are requested from the active endpoint
+    // with the station path appended to the endpoint path
+    WeatherStation stations[MAX_STATIONS];
+    uint8_t n_stations;
+
+    ServerPolicy policy;
+
+    // Updated only with the lwIP lock held
+    ServerStats stats;
+
+#if BASESTATION_PEERS
+    // Changed only with the lwIP lock held
+    struct PeerState peer;
+#endif
+} state = {
+    .stations = {
+        {.name = "Station", .path = "latest/"},
+    },
+    .n_stations = 1,
+    .policy = {
+        .poll_interval_ms = SERVER_POLL_INTERVAL_MS,
+        .poll_jitter_ms = 0,
+        .max_retries = REQUEST_MAX_RETRIES,
+        .backoff_min_ms = REQUEST_BACKOFF_MIN_MS,
+        .backoff_max_ms = REQUEST_BACKOFF_MAX_MS
+    }
+};
+
+#if BASESTATION_USE_TLS
+static struct TlsState{
+    struct altcp_tls_config *config;
+
+    // Session saved from the last successful handshake. Offered to the server
+    // on the next connect so only the first connection pays for a full handshake
+    mbedtls_ssl_session session;
+    bool session_valid;
+
+    // mbedtls heap usage in bytes
+    size_t heap_used;
+    size_t heap_high_water;
+} tls;
+
+// mbedtls allocation wrappers keeping track of the heap high-water mark.
+// Each block is prefixed with its size so it can be subtracted on free
+static void *tls_calloc(size_t n, size_t size)
+{
+    size_t total = n * size;
+    size_t *block = calloc(1, total + sizeof(size_t) * 2);
+
+    if(block == NULL){
+        return NULL;
+    }
+
+    block[0] = total;
+
+    tls.heap_used += total;
+    if(tls.heap_used > tls.heap_high_water){
+        tls.heap_high_water = tls.heap_used;
+    }
+
+    return &block[2];
+}
+
+static void tls_free(void *ptr)
+{
+    if(ptr == NULL){
+        return;
+    }
+
+    size_t *block = (size_t *)ptr - 2;
+    tls.heap_used -= block[0];
+
+    free(block);
+}
+
+// Allocates a TLS connection for the http client and offers the saved session.
+// arg points to the station being requested
+static struct altcp_pcb *tls_alloc_fn(void *arg, u8_t ip_type)
+{
+    WeatherStation *station = arg;
+    const ServerEndpoint *endpoint = station->endpoint;
+    struct altcp_pcb *pcb = altcp_tls_new(tls.config, ip_type);
+
+    station->pcb = pcb;
+
+    if(pcb == NULL){
+        return NULL;
+    }
+
+    // Sent as SNI and checked against the server certificate
+    mbedtls_ssl_context *ssl = altcp_tls_context(pcb);
+    mbedtls_ssl_set_hostname(ssl, endpoint->hostname);
+
+    station->offered_session = tls.session_valid && mbedtls_ssl_set_session(ssl, &tls.session) == 0;
+
+    return pcb;
+}
+
+static altcp_allocator_t tls_allocator = {
+    .alloc = tls_alloc_fn,
+    .arg = NULL
+};
+
+static int init_tls()
+{
+    if(tls.config != NULL){
+        return 0;
+    }
+
+    mbedtls_ssl_session_init(&tls.session);
+
+    // The server certificate must verify against the CA given at build
+    // time. The length of a PEM certificate includes the terminator
+    tls.config = altcp_tls_create_config_client((const u8_t *)tls_ca_pem, sizeof(tls_ca_pem));
+
+    if(tls.config == NULL){
+        printf("Failed to create TLS config\n");
+        return -1;
+    }
+
+    // Creating the config points mbedtls at lwIP's own allocator, so the
+    // hooks go in afterwards. The CA certificate parsed meanwhile stays in
+    // the lwIP heap. The config is never freed, so tls_free never sees it
+    mbedtls_platform_set_calloc_free(tls_calloc, tls_free);
+
+    return 0;
+}
+
+// Save the negotiated session so the next connection can resume it.
+// mbedtls only allows fetching the session once per connection, so this
+// is called on the first data received
+static void tls_save_session(struct altcp_pcb *tpcb)
+{
+    if(mbedtls_ssl_get_session(altcp_tls_context(tpcb), &tls.session) == 0){
+        tls.session_valid = true;
+    }
+}
+#endif
+
+static void dns_found_fn(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    struct EndpointCache *cache = arg;
+
+    cache->resolving = false;
+
+    if(ipaddr == NULL){
+        // Keep using the old address, if any, until the lookup succeeds
+        printf("DNS lookup of %s failed\n", name);
+        cache->next_lookup = make_timeout_time_ms(DNS_RETRY_MS);
+        return;
+    }
+
+    cache->addr = *ipaddr;
+    cache->resolved = true;
+    cache->next_lookup = make_timeout_time_ms(DNS_CACHE_TTL_MS - DNS_REFRESH_MARGIN_MS);
+}
+
+// Start a lookup of endpoint address. Must be called with the lwIP lock held
+static void resolve_endpoint(uint8_t endpoint)
+{
+    struct EndpointCache *cache = &state.endpoint_cache[endpoint];
+
+    if(cache->resolving){
+        return;
+    }
+
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(endpoints[endpoint].hostname, &addr, dns_found_fn, cache);
+
+    if(err == ERR_OK){
+        // Address literal or still in the lwIP DNS cache
+        dns_found_fn(endpoints[endpoint].hostname, &addr, cache);
+    }
+    else if(err == ERR_INPROGRESS){
+        cache->resolving = true;
+    }
+    else{
+        cache->next_lookup = make_timeout_time_ms(DNS_RETRY_MS);
+    }
+}
+
+// Finds the first endpoint, starting at the active one, with an address.
+// A failed refresh keeps the old address, so a DNS outage does not stop
+// requests to a server that is still up
+static int select_endpoint()
+{
+    for(int i = 0; i < N_ENDPOINTS; i++){
+        uint8_t endpoint = (state.active_endpoint + i) % N_ENDPOINTS;
+
+        if(state.endpoint_cache[endpoint].resolved){
+            return endpoint;
+        }
+    }
+
+    return -1;
+}
+
+// Allocates a plain TCP connection for the http client. The connection is kept
+// in the station so the request can follow the connection state and abort it
+static struct altcp_pcb *tcp_alloc_fn(void *arg, u8_t ip_type)
+{
+    WeatherStation *station = arg;
+    station->pcb = altcp_tcp_new_ip_type(ip_type);
+    return station->pcb;
+}
+
+static altcp_allocator_t tcp_allocator = {
+    .alloc = tcp_alloc_fn,
+    .arg = NULL
+};
+
+// Returns true once the TCP connection below any TLS layer is established
+static bool connection_established(struct altcp_pcb *pcb)
+{
+    while(pcb->inner_conn != NULL){
+        pcb = pcb->inner_conn;
+    }
+
+    // The innermost altcp layer keeps its tcp_pcb in state
+    struct tcp_pcb *tpcb = pcb->state;
+
+    return tpcb != NULL && tpcb->state == ESTABLISHED;
+}
+
+// Move request to the next phase and record time spent in the current one
+static void request_enter(WeatherStation *station, enum request_state next)
+{
+    absolute_time_t now = get_absolute_time();
+
+    if(station->request >= REQUEST_RESOLVING && station->request < REQUEST_PHASES){
+        station->phase_ms[station->request] = absolute_time_diff_us(station->phase_start, now) / 1000;
+        TRACE_END(TRACE_HTTP_RESOLVING + station->request - REQUEST_RESOLVING, station - state.stations);
+    }
+
+    if(next >= REQUEST_RESOLVING && next < REQUEST_PHASES){
+        TRACE_BEGIN(TRACE_HTTP_RESOLVING + next - REQUEST_RESOLVING, station - state.stations);
+    }
+    else if(next == REQUEST_DONE){
+        TRACE_INSTANT(TRACE_HTTP_DONE, station - state.stations);
+    }
+    else if(next == REQUEST_FAILED){
+        TRACE_INSTANT(TRACE_HTTP_FAILED, station - state.stations);
+    }
+
+    station->request = next;
+    station->phase_start = now;
+}
+
+static void print_request_latency(WeatherStation *station)
+{
+    printf("%s: %s in %ld ms (", station->name, station->request == REQUEST_DONE ? "done" : "failed",
+        (long)(absolute_time_diff_us(station->request_start, get_absolute_time()) / 1000));
+
+    for(int i = REQUEST_RESOLVING; i < REQUEST_PHASES; i++){
+        printf("%s%s %lu", i == REQUEST_RESOLVING ? "" : ", ", request_phase_names[i], (unsigned long)station->phase_ms[i]);
+    }
+    printf(")\n");
+}
+
+// Request failed. Schedules a retry with capped exponential backoff. The delay
+// is jittered so stations and base stations do not retry in lockstep
+static void request_fail(WeatherStation *station)
+{
+    request_enter(station, REQUEST_FAILED);
+    station->pcb = NULL;
+    state.stats.failed++;
+
+    print_request_latency(station);
+
+    if(station->backoff_ms == 0){
+        station->backoff_ms = state.policy.backoff_min_ms;
+    }
+
+    uint32_t delay_ms = station->backoff_ms / 2 + get_rand_32() % (station->backoff_ms / 2 + 1);
+    station->retry_at = make_timeout_time_ms(delay_ms);
+
+    station->backoff_ms *= 2;
+    if(station->backoff_ms > state.policy.backoff_max_ms){
+        station->backoff_ms = state.policy.backoff_max_ms;
+    }
+
+    // Retry until the attempts are used up. The backoff still applies to
+    // the next scheduled request
+    station->retry_pending = station->attempt < state.policy.max_retries;
+
+    if(!station->retry_pending){
+        station->event = SERVER_EVENT_FAILED;
+    }
+
+#if BASESTATION_PEERS
+    state.peer.upstream_failures++;
+#endif
+}
+
+#if BASESTATION_PEERS
+static bool peer_upstream_up()
+{
+    return state.peer.upstream_failures < PEER_UPSTREAM_FAILURES;
+}
+
+// Election order: nodes reaching the server first, then the lowest id
+static bool peer_precedes(uint32_t node, bool upstream, uint32_t other, bool other_upstream)
+{
+    if(upstream != other_upstream){
+        return upstream;
+    }
+
+    return node < other;
+}
+
+static uint64_t peer_mac(const PeerPacket *packet)
+{
+    return siphash24(state.peer.key, packet, offsetof(PeerPacket, mac));
+}
+
+static void peer_send(enum peer_packet_type type, uint8_t station, const WeatherStationData *data)
+{
+    PeerPacket packet = {
+        .magic = PEER_MAGIC,
+        .version = PEER_VERSION,
+        .type = type,
+        .station = station,
+        .n_metrics = METRICS,
+        .node = state.peer.stats.node,
+        .flags = peer_upstream_up() ? 0 : PEER_FLAG_UPSTREAM_DOWN
+    };
+
+    if(type == PEER_DATA){
+        packet.seq = ++state.peer.seq;
+
+        for(int metric = 0; metric < METRICS; metric++){
+            packet.values[metric] = metric_value(data, metric);
+        }
+    }
+
+    packet.mac = peer_mac(&packet);
+
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(packet), PBUF_RAM);
+    if(p == NULL){
+        return;
+    }
+
+    memcpy(p->payload, &packet, sizeof(packet));
+    udp_sendto(state.peer.pcb, p, &state.peer.group, PEER_PORT);
+    pbuf_free(p);
+}
+
+// Share a reading received from the server while leading
+static void peer_publish(WeatherStation *station)
+{
+    if(state.peer.pcb == NULL || state.peer.stats.leader != 0){
+        return;
+    }
+
+    peer_send(PEER_DATA, station - state.stations, &station->snapshot.data);
+    state.peer.stats.sent++;
+}
+
+// Elect the lowest node id heard among those reaching the server, or the
+// lowest of all if none does. Returns true if node is the leader
+static bool peer_hear(uint32_t node, bool upstream)
+{
+    struct PeerState *peer = &state.peer;
+    PeerStats *stats = &peer->stats;
+    absolute_time_t now = get_absolute_time();
+
+    if(node == stats->leader){
+        peer->leader_upstream = upstream;
+        peer->leader_seen = now;
+
+        if(peer_precedes(node, upstream, stats->node, peer_upstream_up())){
+            return true;
+        }
+
+        // The leader lost the server while this base station did not.
+        // Lead until a better placed node is heard
+        printf("Peer: Leader %08lx cannot reach the server\n", (unsigned long)node);
+        stats->leader = 0;
+        stats->step_downs++;
+        return false;
+    }
+
+    if(!peer_precedes(node, upstream, stats->node, peer_upstream_up())){
+        return false;
+    }
+
+    if(stats->leader != 0 && !peer_precedes(node, upstream, stats->leader, peer->leader_upstream)){
+        return false;
+    }
+
+    stats->leader = node;
+    peer->leader_upstream = upstream;
+    peer->leader_seq = 0;
+    peer->leader_seen = now;
+    peer->leader_data = now;
+
+    return true;
+}
+
+// Following, and the leader's readings are recent. A leader that keeps
+// announcing itself but gets no responses leaves the readings stale
+static bool peer_following(absolute_time_t now)
+{
+    struct PeerState *peer = &state.peer;
+
+    if(peer->stats.leader == 0){
+        return false;
+    }
+
+    uint32_t stale_ms = PEER_STALE_POLLS * (state.policy.poll_interval_ms + state.policy.poll_jitter_ms) + PEER_TIMEOUT_MS;
+    bool stale = absolute_time_diff_us(peer->leader_data, now) / 1000 > stale_ms;
+
+    if(stale != peer->stale){
+        peer->stale = stale;
+
+        if(stale){
+            printf("Peer: No readings from %08lx, polling the server\n", (unsigned long)peer->stats.leader);
+        }
+    }
+
+    return !stale;
+}
+
+static void peer_recv_fn(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    PeerPacket packet;
+    bool valid = p->tot_len == sizeof(packet) && pbuf_copy_partial(p, &packet, sizeof(packet), 0) == sizeof(packet) &&
+        packet.magic == PEER_MAGIC && packet.version == PEER_VERSION && packet.n_metrics == METRICS;
+
+    pbuf_free(p);
+
+    if(valid && packet.mac != peer_mac(&packet)){
+        state.peer.stats.rejected++;
+        return;
+    }
+
+    // Own datagrams come back where the network loops the group back
+    if(!valid || packet.node == state.peer.stats.node){
+        return;
+    }
+
+    bool from_leader = peer_hear(packet.node, !(packet.flags & PEER_FLAG_UPSTREAM_DOWN));
+
+    if(packet.type != PEER_DATA){
+        return;
+    }
+
+    if(!from_leader || packet.seq <= state.peer.leader_seq || packet.station >= state.n_stations){
+        state.peer.stats.dropped++;
+        return;
+    }
+
+    state.peer.leader_seq = packet.seq;
+    state.peer.leader_data = get_absolute_time();
+    state.peer.stats.received++;
+
+    // Delivered as a response from the server would be
+    WeatherStation *station = &state.stations[packet.station];
+
+    StationSnapshot snapshot = {
+        .received = get_absolute_time(),
+        .valid = true,
+        .stale = false
+    };
+
+    for(int metric = 0; metric < METRICS; metric++){
+        metric_set_value(&snapshot.data, metric, packet.values[metric]);
+    }
+
+    seqlock_write(&station->lock, &station->snapshot, &snapshot, sizeof(snapshot));
+    station->event = SERVER_EVENT_DATA;
+
+    if(boot_mark(BOOT_FIRST_RESPONSE)){
+        boot_print_timing();
+    }
+}
+
+static int peer_start()
+{
+    if(siphash_parse_key(BASESTATION_PEER_KEY, state.peer.key) != 0){
+        return -1;
+    }
+
+    struct udp_pcb *pcb = udp_new();
+    if(pcb == NULL){
+        return -1;
+    }
+
+    if(udp_bind(pcb, IP_ANY_TYPE, PEER_PORT) != ERR_OK){
+        udp_remove(pcb);
+        return -1;
+    }
+
+    ipaddr_aton(PEER_GROUP, &state.peer.group);
+
+    if(igmp_joingroup(IP4_ADDR_ANY4, ip_2_ip4(&state.peer.group)) != ERR_OK){
+        udp_remove(pcb);
+        return -1;
+    }
+
+    udp_recv(pcb, peer_recv_fn, NULL);
+    state.peer.pcb = pcb;
+
+    // 0 stands for no leader
+    do{
+        state.peer.stats.node = get_rand_32();
+    }while(state.peer.stats.node == 0);
+
+    printf("Peer: Node %08lx, leading\n", (unsigned long)state.peer.stats.node);
+
+    return 0;
+}
+
+// Open the pcb once WiFi is up, announce this base station and
+// notice a leader that went silent
+static void peer_poll(absolute_time_t now)
+{
+    struct PeerState *peer = &state.peer;
+
+    if(peer->pcb == NULL){
+        if(now < peer->next_hello || cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_UP){
+            return;
+        }
+
+        if(peer_start() != 0){
+            printf("Peer: Could not join %s\n", PEER_GROUP);
+            peer->next_hello = make_timeout_time_ms(PEER_TIMEOUT_MS);
+            return;
+        }
+    }
+
+    if(peer->stats.leader != 0 && absolute_time_diff_us(peer->leader_seen, now) / 1000 > PEER_TIMEOUT_MS){
+        printf("Peer: Leader %08lx silent\n", (unsigned long)peer->stats.leader);
+        peer->stats.leader = 0;
+        peer->stats.takeovers++;
+    }
+
+    bool following = peer->stats.leader != 0;
+
+    if(following != peer->following){
+        peer->following = following;
+
+        if(following){
+            printf("Peer: Following %08lx\n", (unsigned long)peer->stats.leader);
+        }
+        else{
+            printf("Peer: Leading\n");
+        }
+    }
+
+    if(now >= peer->next_hello){
+        peer_send(PEER_HELLO, 0, NULL);
+        peer->next_hello = make_timeout_time_ms(PEER_HELLO_MS);
+    }
+}
+#endif
 
 static err_t headers_done_fn(httpc_state_t *connection, void *arg,
                              struct pbuf *hdr, u16_t hdr_len, u32_t content_len)
 {
+    WeatherStation *station = arg;
+
+#if BASESTATION_USE_TLS
+    // lwIP releases without ALTCP_MBEDTLS_AUTHMODE only report a failed
+    // verification, so never accept a response from such a server
+    if(station->endpoint->protocol == SERVER_HTTPS && mbedtls_ssl_get_verify_result(altcp_tls_context(station->pcb)) != 0){
+        printf("%s: Server certificate not valid for %s\n", station->name, station->endpoint->hostname);
+        return ERR_ABRT;
+    }
+#endif
+
+    request_enter(station, REQUEST_RECEIVING);
+
     return ERR_OK;
 }
 
+// Parse the complete body of a successful response into the station data
+static void publish_body(WeatherStation *station)
+{
+    station->body[station->body_length] = '\0';
+
+    StationSnapshot snapshot = {
+        .data = parse_weatherstation_json(station->body),
+        .received = get_absolute_time(),
+        .valid = true,
+        .stale = false
+    };
+
+    seqlock_write(&station->lock, &station->snapshot, &snapshot, sizeof(snapshot));
+
+    if(boot_mark(BOOT_FIRST_RESPONSE)){
+        boot_print_timing();
+    }
+}
+
 static void result_fn(void *arg, httpc_result_t httpc_result, u32_t rx_content_len, u32_t srv_res, err_t err)
 {
+    WeatherStation *station = arg;
+    const ServerEndpoint *endpoint = station->endpoint;
+
+    // The connection is freed after this callback
+    station->pcb = NULL;
+
+    RECORD_HTTP_BODY(station - state.stations, station->body, station->body_length);
+    RECORD_HTTP_RESULT(station - state.stations, httpc_result, srv_res, err);
+
+    if(httpc_result == HTTPC_RESULT_OK && srv_res == 200 && station->body_truncated){
+        printf("%s: Response longer than %u bytes\n", station->name, BODY_LENGTH);
+        request_fail(station);
+    }
+    else if(httpc_result == HTTPC_RESULT_OK && srv_res == 200){
+        publish_body(station);
+
+        request_enter(station, REQUEST_DONE);
+        print_request_latency(station);
+        state.stats.done++;
+
+        station->attempt = 0;
+        station->backoff_ms = 0;
+        station->retry_pending = false;
+        station->event = SERVER_EVENT_DATA;
 
-    printf("err: %d\n\n", err);
-    printf("Server response: %d\n", srv_res);
+#if BASESTATION_PEERS
+        state.peer.upstream_failures = 0;
+        peer_publish(station);
+#endif
+    }
+    else{
+        printf("%s: result %d, server response %lu, err %d\n", station->name, httpc_result, (unsigned long)srv_res, err);
+        request_fail(station);
+
+        // Fail over to the next endpoint. Its address is already cached
+        // so the next request does not stall on a lookup
+        if(N_ENDPOINTS > 1 && httpc_result != HTTPC_RESULT_OK && endpoint == &endpoints[state.active_endpoint]){
+            state.active_endpoint = (state.active_endpoint + 1) % N_ENDPOINTS;
+            printf("Request to %s:%u failed, switching to %s:%u\n", endpoint->hostname, endpoint->port,
+                endpoints[state.active_endpoint].hostname, endpoints[state.active_endpoint].port);
+        }
+    }
+
+#if BASESTATION_USE_TLS
+    // Forget the session if the server rejected the connection so the
+    // next attempt starts from a full handshake
+    if(httpc_result != HTTPC_RESULT_OK){
+        tls.session_valid = false;
+    }
+
+    printf("TLS heap: %zu bytes in use, %zu bytes high-water\n", tls.heap_used, tls.heap_high_water);
+#endif
 }
 
 static err_t recv_fn(void *arg, struct altcp_pcb *tpcb, struct pbuf *p, err_t err)
 {
-    last_data = parse_weatherstation_json(p->payload);
+    PROF_BEGIN(PROF_RECV_FN);
+
+    WeatherStation *station = arg;
+
+#if BASESTATION_USE_TLS
+    if(station->endpoint->protocol == SERVER_HTTPS){
+        if(!station->first_byte_received){
+            int64_t handshake_us = absolute_time_diff_us(station->request_start, get_absolute_time());
+            printf("TLS first byte after %ld ms (%s)\n", (long)(handshake_us / 1000), station->offered_session ? "session offered" : "full handshake");
+
+            tls_save_session(tpcb);
+        }
+    }
+#endif
+
+    station->first_byte_received = true;
+
+    if(station->request == REQUEST_AWAIT_HEADERS){
+        request_enter(station, REQUEST_RECEIVING);
+    }
+
+    // The body may arrive in several pbufs
+    if(p->tot_len > BODY_LENGTH - station->body_length){
+        station->body_truncated = true;
+    }
+    else{
+        station->body_length += pbuf_copy_partial(p, &station->body[station->body_length], p->tot_len, 0);
+    }
+
+    state.stats.bytes_received += p->tot_len;
+
+    // The application owns the pbuf
+    altcp_recved(tpcb, p->tot_len);
+    pbuf_free(p);
 
-    _new_data = true;
+    PROF_END(PROF_RECV_FN);
 
     return ERR_OK;
 }
 
 static httpc_connection_t settings = {
     .use_proxy = 0,
+    .altcp_allocator = &tcp_allocator,
     .headers_done_fn = headers_done_fn,
     .result_fn = result_fn
 };
 
+#if BASESTATION_USE_TLS
+static httpc_connection_t tls_settings = {
+    .use_proxy = 0,
+    .altcp_allocator = &tls_allocator,
+    .headers_done_fn = headers_done_fn,
+    .result_fn = result_fn
+};
+#endif
+
+// Read consistent snapshot of station
+static StationSnapshot read_snapshot(uint8_t station, uint32_t *generation)
+{
+    StationSnapshot snapshot;
+    uint32_t snapshot_generation = seqlock_read(&state.stations[station].lock, &snapshot, &state.stations[station].snapshot, sizeof(snapshot));
+
+    if(generation != NULL){
+        *generation = snapshot_generation;
+    }
+
+    return snapshot;
+}
+
 bool new_data()
 {
-    return _new_data;
+    for(int i = 0; i < state.n_stations; i++){
+        if(station_new_data(i)){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool station_new_data(uint8_t station)
+{
+    return seqlock_generation(&state.stations[station].lock) != state.stations[station].read_generation;
+}
+
+uint32_t station_data_generation(uint8_t station)
+{
+    return seqlock_generation(&state.stations[station].lock);
+}
+
+WeatherStationData read_station_data(uint8_t station, uint32_t *generation)
+{
+    return read_snapshot(station, generation).data;
+}
+
+int add_station(const char* name, const char* path)
+{
+    if(state.n_stations == MAX_STATIONS){
+        return -1;
+    }
+
+    state.stations[state.n_stations] = (WeatherStation){.name = name, .path = path};
+
+    return state.n_stations++;
+}
+
+uint8_t get_station_count()
+{
+    return state.n_stations;
+}
+
+const char* get_station_name(uint8_t station)
+{
+    return state.stations[station].name;
+}
+
+bool station_data_is_stale(uint8_t station)
+{
+    return read_snapshot(station, NULL).stale;
+}
+
+void restore_station_data(uint8_t station, WeatherStationData data)
+{
+    StationSnapshot snapshot = {
+        .data = data,
+        .valid = true,
+        .stale = true
+    };
+
+    // Keep lwIP callbacks out so there is only one writer
+    cyw43_arch_lwip_begin();
+    seqlock_write(&state.stations[station].lock, &state.stations[station].snapshot, &snapshot, sizeof(snapshot));
+    cyw43_arch_lwip_end();
+
+    // Restored data is not new
+    state.stations[station].read_generation = seqlock_generation(&state.stations[station].lock);
+}
+
+int32_t get_station_data_age_ms(uint8_t station)
+{
+    StationSnapshot snapshot = read_snapshot(station, NULL);
+
+    if(!snapshot.valid || snapshot.stale){
+        return -1;
+    }
+
+    return absolute_time_diff_us(snapshot.received, get_absolute_time()) / 1000;
+}
+
+void server_warm_dns()
+{
+    cyw43_arch_lwip_begin();
+    for(int i = 0; i < N_ENDPOINTS; i++){
+        resolve_endpoint(i);
+    }
+    cyw43_arch_lwip_end();
+}
+
+void server_refresh_dns()
+{
+    absolute_time_t now = get_absolute_time();
+
+    for(int i = 0; i < N_ENDPOINTS; i++){
+        if(!state.endpoint_cache[i].resolving && state.endpoint_cache[i].next_lookup < now){
+            cyw43_arch_lwip_begin();
+            resolve_endpoint(i);
+            cyw43_arch_lwip_end();
+        }
+    }
+}
+
+// Issue the request for a single station. Must be called with the lwIP lock held
+static void request_issue(WeatherStation *station, const ServerEndpoint *endpoint, const ip_addr_t *addr)
+{
+    httpc_state_t *connection = NULL;
+    altcp_allocator_t *allocator = &tcp_allocator;
+    const httpc_connection_t *connection_settings = &settings;
+
+#if BASESTATION_USE_TLS
+    if(endpoint->protocol == SERVER_HTTPS){
+        if(init_tls() != 0){
+            request_fail(station);
+            return;
+        }
+
+        allocator = &tls_allocator;
+        connection_settings = &tls_settings;
+    }
+#endif
+
+    snprintf(station->uri, URI_LENGTH, "%s%s", endpoint->path, station->path);
+
+    station->endpoint = endpoint;
+    station->first_byte_received = false;
+    station->body_length = 0;
+    station->body_truncated = false;
+    station->pcb = NULL;
+
+    request_enter(station, REQUEST_CONNECTING);
+
+    // The connection is allocated during the call
+    allocator->arg = station;
+
+    err_t err = httpc_get_file(addr, endpoint->port, station->uri, connection_settings, recv_fn, station, &connection);
+
+    if(err != ERR_OK){
+        printf("%s: Server request error code %d\n", station->name, err);
+        request_fail(station);
+    }
+}
+
+// Start a new attempt. Must be called with the lwIP lock held
+static void request_start(WeatherStation *station)
+{
+    station->request_start = get_absolute_time();
+    memset(station->phase_ms, 0, sizeof(station->phase_ms));
+    station->retry_pending = false;
+    state.stats.requests++;
+
+    // Never wait for DNS here. If no address is cached yet the request
+    // waits in the resolving phase and server_poll issues it later
+    request_enter(station, REQUEST_RESOLVING);
+
+    int endpoint_no = select_endpoint();
+
+    if(endpoint_no < 0){
+        resolve_endpoint(state.active_endpoint);
+        return;
+    }
+
+    state.active_endpoint = endpoint_no;
+    request_issue(station, &endpoints[endpoint_no], &state.endpoint_cache[endpoint_no].addr);
+}
+
+// Returns true while a request is between start and completion
+static bool request_in_progress(const WeatherStation *station)
+{
+    return station->request >= REQUEST_RESOLVING && station->request <= REQUEST_RECEIVING;
+}
+
+bool server_requests_pending()
+{
+    bool pending = false;
+
+    cyw43_arch_lwip_begin();
+    for(int i = 0; i < state.n_stations && !pending; i++){
+        const WeatherStation *station = &state.stations[i];
+
+        pending = request_in_progress(station) || (station->request == REQUEST_FAILED && station->retry_pending);
+    }
+    cyw43_arch_lwip_end();
+
+    return pending;
 }
 
-// Based on https://www.unshiu.com/posts/pico-http-client-part-i-simple-client/
 int request_last_data()
 {
     // Check WiFi status
+    if(cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_UP){
+        return -1;
+    }
 
-    printf("Requesting data from server\n");
+    absolute_time_t now = get_absolute_time();
 
-    // Connect to server
+    // Issue requests for all stations at once. Each runs on its own
+    // connection, so the total refresh time is about one round trip
+    cyw43_arch_lwip_begin();
 
-    httpc_state_t *connection = NULL;
+#if BASESTATION_PEERS
+    // The leader polls for all base stations while it is heard from
+    // and its readings keep coming
+    if(peer_following(now)){
+        cyw43_arch_lwip_end();
+        return 0;
+    }
+
+    if(state.peer.stats.leader != 0){
+        state.peer.stats.fallbacks++;
+    }
+#endif
+
+    for(int i = 0; i < state.n_stations; i++){
+        WeatherStation *station = &state.stations[i];
+
+        // Skip stations still waiting for the previous response
+        // or backing off after failures
+        if(request_in_progress(station) || (station->request == REQUEST_FAILED && now < station->retry_at)){
+            continue;
+        }
+
+        station->attempt = 0;
+        request_start(station);
+    }
+    cyw43_arch_lwip_end();
+
+    return 0;
+}
+
+enum server_event server_poll()
+{
+    enum server_event result = SERVER_EVENT_NONE;
+    absolute_time_t now = get_absolute_time();
 
     cyw43_arch_lwip_begin();
-    err_t err = httpc_get_file_dns("217.160.149.219", HTTP_DEFAULT_PORT, "/WeatherStation/latest/", &settings, recv_fn, NULL, &connection);
-    cyw43_arch_lwip_end(); 
+    for(int i = 0; i < state.n_stations; i++){
+        WeatherStation *station = &state.stations[i];
+
+        if(request_in_progress(station)){
+            bool timed_out = absolute_time_diff_us(station->phase_start, now) / 1000 > request_timeout_ms[station->request];
 
-    sleep_ms(500);
-    printf("Server request error code %d\n", err);
+            if(station->request == REQUEST_RESOLVING){
+                int endpoint_no = select_endpoint();
 
-    WeatherStationData data = {0};
+                if(endpoint_no >= 0){
+                    state.active_endpoint = endpoint_no;
+                    request_issue(station, &endpoints[endpoint_no], &state.endpoint_cache[endpoint_no].addr);
+                }
+                else if(timed_out){
+                    printf("%s: No server address resolved\n", station->name);
+                    state.stats.timeouts++;
+                    request_fail(station);
+                }
+            }
+            else if(station->request == REQUEST_CONNECTING && station->pcb != NULL && connection_established(station->pcb)){
+                request_enter(station, REQUEST_AWAIT_HEADERS);
+            }
+            else if(timed_out){
+                printf("%s: Timeout in %s phase\n", station->name, request_phase_names[station->request]);
+                state.stats.timeouts++;
 
-    return err;
+                // The http client reports the abort through result_fn
+                if(station->pcb != NULL){
+                    altcp_abort(station->pcb);
+                }
+                else{
+                    request_fail(station);
+                }
+            }
+        }
+        else if(station->request == REQUEST_FAILED && station->retry_pending && now > station->retry_at){
+            station->attempt++;
+            state.stats.retries++;
+            printf("%s: Retry %u\n", station->name, station->attempt);
+            request_start(station);
+        }
+
+        // Report completions. Data takes priority over failures
+        if(station->event != SERVER_EVENT_NONE){
+            if(result != SERVER_EVENT_DATA){
+                result = station->event;
+            }
+            station->event = SERVER_EVENT_NONE;
+        }
+    }
+
+#if BASESTATION_PEERS
+    peer_poll(now);
+#endif
+    cyw43_arch_lwip_end();
+
+    return result;
+}
+
+void server_set_policy(const ServerPolicy *policy)
+{
+    cyw43_arch_lwip_begin();
+    state.policy = *policy;
+    cyw43_arch_lwip_end();
+}
+
+ServerPolicy server_get_policy()
+{
+    return state.policy;
+}
+
+uint32_t server_next_poll_ms()
+{
+    uint32_t jitter_ms = state.policy.poll_jitter_ms > 0 ? get_rand_32() % (state.policy.poll_jitter_ms + 1) : 0;
+
+    return state.policy.poll_interval_ms + jitter_ms;
+}
+
+#if BASESTATION_HOST_BUILD
+void *server_state(size_t *size)
+{
+    *size = sizeof(state);
+    return &state;
+}
+#endif
+
+ServerStats get_server_stats()
+{
+    cyw43_arch_lwip_begin();
+    ServerStats result = state.stats;
+    cyw43_arch_lwip_end();
+
+    return result;
+}
+
+#if BASESTATION_PEERS
+PeerStats get_peer_stats()
+{
+    cyw43_arch_lwip_begin();
+    PeerStats result = state.peer.stats;
+    cyw43_arch_lwip_end();
+
+    return result;
+}
+
+void peer_print_stats()
+{
+    PeerStats stats = get_peer_stats();
+
+    if(stats.leader == 0){
+        printf("Peer %08lx: leading\n", (unsigned long)stats.node);
+    }
+    else{
+        printf("Peer %08lx: following %08lx\n", (unsigned long)stats.node, (unsigned long)stats.leader);
+    }
+
+    printf("Readings: %lu sent, %lu received, %lu dropped. Leader lost %lu times\n", (unsigned long)stats.sent,
+        (unsigned long)stats.received, (unsigned long)stats.dropped, (unsigned long)stats.takeovers);
+    printf("Leader off the server %lu times, %lu polls for a stale leader, %lu datagrams with a bad MAC\n",
+        (unsigned long)stats.step_downs, (unsigned long)stats.fallbacks, (unsigned long)stats.rejected);
+}
+#endif
+
+enum request_state get_request_state(uint8_t station)
+{
+    return state.stations[station].request;
+}
+
+uint32_t get_request_phase_ms(uint8_t station, enum request_state phase)
+{
+    if(phase < REQUEST_RESOLVING || phase >= REQUEST_PHASES){
+        return 0;
+    }
+
+    return state.stations[station].phase_ms[phase];
 }
 
 WeatherStationData get_weather_station_data()
 {
-    _new_data = false;
-    return last_data;
+    return get_station_data(0);
+}
+
+WeatherStationData get_station_data(uint8_t station)
+{
+    return read_station_data(station, &state.stations[station].read_generation);
+}
+
+WeatherStationData peek_station_data(uint8_t station)
+{
+    return read_station_data(station, NULL);
 }
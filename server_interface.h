@@ -2,26 +2,273 @@
 #define SERVER_INTERFACE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "metrics.h"
+
+enum server_protocol{SERVER_HTTP, SERVER_HTTPS};
 
 typedef struct {
-    float temp;
-    float humidity;
-    float wind_spd;
-    float wind_dir;
-    float pressure;
-    float smoke;
-    float ambient_light;
-} WeatherStationData;
+    const char* hostname;
+    uint16_t port;
+    const char* path;
+    enum server_protocol protocol;
+} ServerEndpoint;
+
+#define METRIC_FIELD_(id, field, json_key, label, unit, decimals, limit, min, max, hysteresis) float field;
+
+// One float per metric in metrics.h
+struct WeatherStationData{
+    WEATHER_METRICS(METRIC_FIELD_)
+};
+
+// Request phases. A request goes through the phases in order
+// and ends in REQUEST_DONE or REQUEST_FAILED
+enum request_state{
+    REQUEST_IDLE = 0,
+    REQUEST_RESOLVING,      // Waiting for a server address
+    REQUEST_CONNECTING,     // Waiting for the TCP connection
+    REQUEST_AWAIT_HEADERS,  // Waiting for the response headers, including any TLS handshake
+    REQUEST_RECEIVING,      // Receiving the response body
+    REQUEST_DONE,
+    REQUEST_FAILED
+};
+
+// Number of request phases with a timeout and recorded latency
+#define REQUEST_PHASES (REQUEST_RECEIVING + 1)
+
+enum server_event{
+    SERVER_EVENT_NONE,
+    SERVER_EVENT_DATA,      // A request completed with new data
+    SERVER_EVENT_FAILED     // A request failed and will not be retried
+};
+
+// Request counters since boot
+typedef struct{
+    uint32_t requests;      // Attempts started, including retries
+    uint32_t done;
+    uint32_t failed;        // Failed attempts
+    uint32_t retries;
+    uint32_t timeouts;      // Attempts aborted by a phase timeout
+    uint32_t bytes_received;
+} ServerStats;
+
+// Default time between scheduled requests for new data
+#define SERVER_POLL_INTERVAL_MS 10000
 
+// When to request data and how to retry. Defaults poll every
+// SERVER_POLL_INTERVAL_MS without jitter
+typedef struct{
+    uint32_t poll_interval_ms;
+    uint32_t poll_jitter_ms;    // Random delay of up to this much added to each interval
+    uint8_t max_retries;        // Retries of a failed request before the next scheduled one
+    uint32_t backoff_min_ms;    // Backoff before the first retry, doubled after each failure
+    uint32_t backoff_max_ms;
+} ServerPolicy;
+
+// Max number of weather stations in the station registry. Each station
+// needs its own TCP connection while a request is in flight
+#define MAX_STATIONS 4
+
+/**
+ * @brief Returns true if any station has data that has not been read yet
+ */
 bool new_data();
 
+/**
+ * @brief Returns true if station has data that has not been read yet
+ */
+bool station_new_data(uint8_t station);
+
 /**
 * @brief Send request for latest data to weatherstation server.
-* Saves response in internal state which
-* can be retrieved by calling @ref get_weather_station_data()
+* Requests for all stations are issued concurrently. Never blocks. Stations with
+* a request in progress or backing off after failures are skipped. 
+* Responses are saved in internal state which can be retrieved by calling @ref get_station_data()
+* 
+* @return 0 if requests were started, -1 if WiFi is not connected
 */
 int request_last_data();
 
+/**
+ * @brief Advance requests: issue requests waiting for an address, abort requests
+ * that exceed the timeout of their phase and retry failed requests after a
+ * capped exponential backoff. Never blocks. Should be called from the main loop.
+ * 
+ * @return Returns SERVER_EVENT_DATA if a request completed since the last call and 
+ * SERVER_EVENT_FAILED if a request failed and will not be retried
+ */
+enum server_event server_poll();
+
+enum request_state get_request_state(uint8_t station);
+
+/**
+ * @brief Returns true while any station has a request in flight or a
+ * retry waiting for its backoff
+ */
+bool server_requests_pending();
+
+/**
+ * @brief Time spent in a phase of the last request to station
+ */
+uint32_t get_request_phase_ms(uint8_t station, enum request_state phase);
+
+void server_set_policy(const ServerPolicy *policy);
+
+ServerPolicy server_get_policy();
+
+/**
+ * @brief Delay from a scheduled request to the next one: the poll interval
+ * plus a random part of the jitter
+ */
+uint32_t server_next_poll_ms();
+
+/**
+ * @brief Request counters for all stations since boot
+ */
+ServerStats get_server_stats();
+
+/**
+ * @brief Get data from the first station
+ */
 WeatherStationData get_weather_station_data();
 
+/**
+ * @brief Get last data received from station and clear its new data flag
+ */
+WeatherStationData get_station_data(uint8_t station);
+
+/**
+ * @brief Get last data received from station without clearing its new data flag
+ */
+WeatherStationData peek_station_data(uint8_t station);
+
+/**
+ * @brief Generation of the station data. Incremented every time new data
+ * is received, so readers can check if data changed since they last read it.
+ * Safe to call from either core without locking.
+ */
+uint32_t station_data_generation(uint8_t station);
+
+/**
+ * @brief Get a consistent copy of the last data received from station. 
+ * Safe to call from either core without locking.
+ * 
+ * @param generation Set to the generation of the returned data. May be NULL
+ */
+WeatherStationData read_station_data(uint8_t station, uint32_t *generation);
+
+/**
+ * @brief Restore station data saved before the last reset. 
+ * The data is marked stale until a new response is received.
+ */
+void restore_station_data(uint8_t station, WeatherStationData data);
+
+/**
+ * @brief Returns true if the station data was restored from before the last
+ * reset and no new data has been received since
+ */
+bool station_data_is_stale(uint8_t station);
+
+/**
+ * @brief Add station to the station registry
+ * 
+ * @param name Name shown on the display
+ * @param path Path of the station data relative to the endpoint path
+ * 
+ * @return Index of the station or -1 if the registry is full
+ */
+int add_station(const char* name, const char* path);
+
+uint8_t get_station_count();
+
+const char* get_station_name(uint8_t station);
+
+/**
+ * @brief Time since the last data was received from station
+ * 
+ * @return Age in ms or -1 if no data has been received since reset
+ */
+int32_t get_station_data_age_ms(uint8_t station);
+
+/**
+ * @brief Start address lookups for all server endpoints.
+ * Should be called when a WiFi connection has been established
+ * so the first request does not have to wait for DNS.
+ */
+void server_warm_dns();
+
+/**
+ * @brief Refresh cached server addresses that are about to expire.
+ * Lookups run in the background, so this never blocks.
+ */
+void server_refresh_dns();
+
+#if BASESTATION_PEERS
+/*
+Peer mode: base stations on one LAN share a single poll of the server.
+
+Each base station picks a random node id and announces it to the group
+PEER_GROUP every PEER_HELLO_MS. The lowest id heard leads: it polls the
+server as usual and multicasts every reading it receives, numbered with
+a sequence number. The others stop polling and take the leader's
+readings as if they were responses, dropping repeated and out of order
+ones. If the leader is not heard from for PEER_TIMEOUT_MS they fall back
+to polling the server, until the next lowest id takes over.
+
+Base stations that had PEER_UPSTREAM_FAILURES failed attempts in a row
+announce that they cannot reach the server. They are only elected
+when no other base station reaches it, so a leader that loses the server
+steps down for the next one that still does. A follower that gets no
+reading from a leader for PEER_STALE_POLLS poll intervals polls the
+server itself until readings come again.
+
+Every datagram carries a SipHash-2-4 MAC under the key set with the
+BASESTATION_PEER_KEY CMake option, and datagrams that fail it are
+ignored. The MAC proves the datagram came from a base station holding
+the key, while the sequence numbers only keep a leader's readings from
+being replayed within one election.
+
+Readings are matched to stations by index, so the base stations must
+register the same stations in the same order.
+*/
+
+#define PEER_GROUP "239.255.70.1"
+#define PEER_PORT 4210
+
+#define PEER_HELLO_MS 1000
+#define PEER_TIMEOUT_MS 3500
+
+#define PEER_UPSTREAM_FAILURES 3
+#define PEER_STALE_POLLS 2
+
+typedef struct{
+    uint32_t node;          // Own node id
+    uint32_t leader;        // Node id of the leader, 0 while leading
+    uint32_t sent;          // Readings multicast while leading
+    uint32_t received;      // Readings accepted from the leader
+    uint32_t dropped;       // Readings repeated, out of order or not from the leader
+    uint32_t takeovers;     // Times the leader went silent
+    uint32_t step_downs;    // Times the leader could not reach the server
+    uint32_t fallbacks;     // Polls made while following a leader with stale readings
+    uint32_t rejected;      // Datagrams failing the MAC check
+} PeerStats;
+
+PeerStats get_peer_stats();
+
+/**
+ * @brief Print the role of this base station and the peer counters
+ */
+void peer_print_stats();
+#endif
+
+#if BASESTATION_HOST_BUILD
+/**
+ * @brief State of the module. The host fleet simulator swaps the state of
+ * many base stations in and out of it
+ */
+void *server_state(size_t *size);
+#endif
+
 #endif //SERVER_INTERFACE_H
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "siphash.h"
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+// Little endian load, independent of the byte order of the machine
+static uint64_t _load_(const uint8_t *p, size_t n)
+{
+    uint64_t value = 0;
+
+    for(size_t i = 0; i < n; i++){
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+
+    return value;
+}
+
+static void _rounds_(uint64_t v[4], int n)
+{
+    for(int i = 0; i < n; i++){
+        v[0] += v[1]; v[1] = ROTL(v[1], 13); v[1] ^= v[0]; v[0] = ROTL(v[0], 32);
+        v[2] += v[3]; v[3] = ROTL(v[3], 16); v[3] ^= v[2];
+        v[0] += v[3]; v[3] = ROTL(v[3], 21); v[3] ^= v[0];
+        v[2] += v[1]; v[1] = ROTL(v[1], 17); v[1] ^= v[2]; v[2] = ROTL(v[2], 32);
+    }
+}
+
+uint64_t siphash24(const uint8_t key[SIPHASH_KEY_LENGTH], const void *data, size_t length)
+{
+    const uint8_t *in = data;
+    uint64_t k0 = _load_(key, 8);
+    uint64_t k1 = _load_(key + 8, 8);
+
+    uint64_t v[4] = {
+        k0 ^ 0x736f6d6570736575ULL,
+        k1 ^ 0x646f72616e646f6dULL,
+        k0 ^ 0x6c7967656e657261ULL,
+        k1 ^ 0x7465646279746573ULL
+    };
+
+    size_t blocks = length / 8;
+
+    for(size_t i = 0; i < blocks; i++){
+        uint64_t m = _load_(in + 8 * i, 8);
+
+        v[3] ^= m;
+        _rounds_(v, 2);
+        v[0] ^= m;
+    }
+
+    // Last block holds the remaining bytes and the length
+    uint64_t m = _load_(in + 8 * blocks, length % 8) | ((uint64_t)length << 56);
+
+    v[3] ^= m;
+    _rounds_(v, 2);
+    v[0] ^= m;
+
+    v[2] ^= 0xff;
+    _rounds_(v, 4);
+
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+static int _hex_digit_(char c)
+{
+    if(c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    else if(c >= 'a' && c <= 'f'){
+        return c - 'a' + 10;
+    }
+    else if(c >= 'A' && c <= 'F'){
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+int siphash_parse_key(const char *hex, uint8_t key[SIPHASH_KEY_LENGTH])
+{
+    for(int i = 0; i < SIPHASH_KEY_LENGTH; i++){
+        int high = _hex_digit_(hex[2 * i]);
+        int low = high < 0 ? -1 : _hex_digit_(hex[2 * i + 1]);
+
+        if(low < 0){
+            return -1;
+        }
+
+        key[i] = high << 4 | low;
+    }
+
+    return hex[2 * SIPHASH_KEY_LENGTH] == '\0' ? 0 : -1;
+}
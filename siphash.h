@@ -0,0 +1,27 @@
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+SipHash-2-4, a keyed hash for short messages. Used as a message
+authentication code where pulling in mbedtls for an HMAC would cost more
+than the message is worth, and where the host build has no mbedtls.
+*/
+
+#define SIPHASH_KEY_LENGTH 16
+
+/**
+ * @brief 64 bit SipHash-2-4 of length bytes at data under key
+ */
+uint64_t siphash24(const uint8_t key[SIPHASH_KEY_LENGTH], const void *data, size_t length);
+
+/**
+ * @brief Parse a key of 2 * SIPHASH_KEY_LENGTH hex digits
+ *
+ * @return 0 on success, -1 if hex is not a key
+ */
+int siphash_parse_key(const char *hex, uint8_t key[SIPHASH_KEY_LENGTH]);
+
+#endif //SIPHASH_H
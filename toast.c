@@ -0,0 +1,151 @@
+#include "toast.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "view.h"
+
+typedef struct{
+    char top[TOAST_LINE + 1];
+    char bottom[TOAST_LINE + 1];
+    uint8_t priority;       // enum toast_priority
+    uint32_t sequence;      // Order of arrival
+    uint32_t remaining_ms;  // Time left to show
+} Toast;
+
+static struct ToastState{
+    // Unordered. The toast shown is kept out of the queue
+    Toast queue[TOAST_QUEUE_SIZE];
+    uint8_t n_queued;
+
+    Toast current;
+    bool active;
+    absolute_time_t expires;
+
+    uint32_t sequence;
+} state;
+
+// Returns true if a goes before b
+static bool _before_(const Toast *a, const Toast *b)
+{
+    return a->priority > b->priority || (a->priority == b->priority && a->sequence < b->sequence);
+}
+
+// Index of the next toast to show, or -1 if the queue is empty
+static int _next_()
+{
+    int next = -1;
+
+    for(int i = 0; i < state.n_queued; i++){
+        if(next < 0 || _before_(&state.queue[i], &state.queue[next])){
+            next = i;
+        }
+    }
+
+    return next;
+}
+
+static void _remove_(int index)
+{
+    state.queue[index] = state.queue[--state.n_queued];
+}
+
+static void _show_(const Toast *toast)
+{
+    state.current = *toast;
+    state.active = true;
+    state.expires = make_timeout_time_ms(toast->remaining_ms);
+
+    view_overlay(toast->top, toast->bottom);
+}
+
+// Put the toast shown back in the queue with the time it has left
+static void _requeue_current_()
+{
+    int64_t left_us = absolute_time_diff_us(get_absolute_time(), state.expires);
+
+    state.current.remaining_ms = left_us > 0 ? left_us / 1000 : 0;
+    state.queue[state.n_queued++] = state.current;
+    state.active = false;
+}
+
+int toast_show(const char *top, const char *bottom, uint32_t duration_ms, enum toast_priority priority)
+{
+    Toast toast = {
+        .priority = priority,
+        .sequence = state.sequence++,
+        .remaining_ms = duration_ms
+    };
+
+    snprintf(toast.top, sizeof(toast.top), "%s", top);
+    snprintf(toast.bottom, sizeof(toast.bottom), "%s", bottom != NULL ? bottom : "");
+
+    if(state.n_queued == TOAST_QUEUE_SIZE){
+        // Make room by dropping the last waiting toast of lower priority
+        int last = 0;
+        for(int i = 1; i < state.n_queued; i++){
+            if(_before_(&state.queue[last], &state.queue[i])){
+                last = i;
+            }
+        }
+
+        if(state.queue[last].priority >= priority){
+            return -1;
+        }
+
+        _remove_(last);
+    }
+
+    state.queue[state.n_queued++] = toast;
+
+    // Preempt a toast of lower priority right away. It is dropped if
+    // there is no room to put it back
+    if(state.active && priority > state.current.priority){
+        if(state.n_queued < TOAST_QUEUE_SIZE){
+            _requeue_current_();
+        }
+        else{
+            state.active = false;
+        }
+    }
+
+    toast_poll();
+
+    return 0;
+}
+
+void toast_poll()
+{
+    if(state.active){
+        if(absolute_time_diff_us(get_absolute_time(), state.expires) > 0){
+            return;
+        }
+
+        state.active = false;
+    }
+
+    int next = _next_();
+
+    if(next < 0){
+        view_overlay_clear();
+        return;
+    }
+
+    Toast toast = state.queue[next];
+    _remove_(next);
+    _show_(&toast);
+}
+
+bool toast_active()
+{
+    return state.active;
+}
+
+void toast_clear()
+{
+    state.n_queued = 0;
+    state.active = false;
+    view_overlay_clear();
+}
@@ -0,0 +1,56 @@
+#ifndef TOAST_H
+#define TOAST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Timed notifications shown over the current page.
+
+A toast is shown as a view overlay for its duration, after which the
+page underneath is shown again. Toasts waiting to be shown are queued by
+priority and in order of arrival within a priority. A toast of higher
+priority than the one shown takes its place, and the one it replaced
+goes back to the queue with the time it had left.
+
+Nothing blocks: toast_poll, called from the main loop, moves to the next
+toast when the time of the current one is up.
+*/
+
+// Max number of toasts waiting to be shown
+#define TOAST_QUEUE_SIZE 4
+
+// Max length of a toast line
+#define TOAST_LINE 16
+
+enum toast_priority{
+    TOAST_INFO = 0,
+    TOAST_WARNING,
+    TOAST_ALARM
+};
+
+/**
+ * @brief Queue a toast. bottom may be NULL
+ *
+ * @return 0 on success, -1 if the queue is full of toasts of the same
+ * or higher priority
+ */
+int toast_show(const char *top, const char *bottom, uint32_t duration_ms, enum toast_priority priority);
+
+/**
+ * @brief Show the next toast when the time of the current one is up.
+ * Call from the main loop before view_render
+ */
+void toast_poll();
+
+/**
+ * @brief Returns true if a toast is shown
+ */
+bool toast_active();
+
+/**
+ * @brief Remove all toasts
+ */
+void toast_clear();
+
+#endif //TOAST_H
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Compare host benchmark results against a baseline.
+
+Run the benchmarks of the host build and compare them with
+
+    build/bench build/bench_results.json
+    tools/bench_compare.py host/bench_baseline.json build/bench_results.json
+
+or build the bench_check target, which does both. Lower is better for
+every metric. A metric more than the threshold percent above the baseline
+is a regression and the script exits with 1.
+
+Simulated metrics (cycles, GPIO accesses, display writes, virtual time)
+only change when the code changes, so the default threshold is tight.
+Host timed metrics depend on the machine and its load and get a wide
+threshold of their own.
+
+After an intended change, copy the results over the baseline and commit
+them with the change.
+
+Options:
+    --threshold PERCENT       limit for simulated metrics (default 5)
+    --host-threshold PERCENT  limit for host timed metrics (default 50)
+"""
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        results = json.load(f)["results"]
+
+    return {(r["bench"], r["metric"]): r for r in results}
+
+
+def main():
+    args = sys.argv[1:]
+    thresholds = {"--threshold": 5.0, "--host-threshold": 50.0}
+    paths = []
+
+    while args:
+        arg = args.pop(0)
+        if arg in thresholds and args:
+            thresholds[arg] = float(args.pop(0))
+        elif arg.startswith("-"):
+            print(__doc__, file=sys.stderr)
+            return 2
+        else:
+            paths.append(arg)
+
+    if len(paths) != 2:
+        print(__doc__, file=sys.stderr)
+        return 2
+
+    baseline = load(paths[0])
+    results = load(paths[1])
+    regressions = 0
+
+    for key in sorted(baseline.keys() | results.keys()):
+        name = "%s.%s" % key
+
+        if key not in results:
+            print("%-40s missing from results" % name)
+            regressions += 1
+            continue
+
+        if key not in baseline:
+            print("%-40s %12.1f  new" % (name, results[key]["value"]))
+            continue
+
+        old = baseline[key]["value"]
+        new = results[key]["value"]
+        host_timed = results[key]["host_timed"]
+        limit = thresholds["--host-threshold" if host_timed else "--threshold"]
+
+        change = (new - old) * 100 / old if old else (0.0 if new == old else float("inf"))
+        status = ""
+        if change > limit:
+            status = "REGRESSION"
+            regressions += 1
+        elif change < -limit:
+            status = "improved"
+
+        print("%-40s %12.1f %12.1f %+7.1f%%  %s%s" % (name, old, new, change, status,
+                                                   " (host)" if host_timed else ""))
+
+    if regressions:
+        print("%d regression(s)" % regressions)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
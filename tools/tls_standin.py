@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Stand-in HTTPS weather server for testing a BASESTATION_USE_TLS build.
+
+    tools/tls_standin.py weather.lan [--port 443] [--dir tls_standin]
+
+The first run creates a CA and a P-256 server certificate for the given
+host name in --dir. Build the firmware against them with
+
+    cmake -DBASESTATION_USE_TLS=ON -DBASESTATION_TLS_HOST=weather.lan \\
+          -DBASESTATION_TLS_CA_FILE=tls_standin/ca.pem ...
+
+and point weather.lan at this machine in the DNS server of the LAN.
+
+Every GET is answered with a fixed reading. Each connection is logged
+with the server side handshake time and whether the session was resumed,
+next to the "TLS first byte" lines the base station prints. The server
+speaks TLS 1.2 only, like the minimal mbedtls profile, and issues session
+tickets, so every connection after the first should resume.
+
+A certificate for another name (--wrong-name) checks that the base
+station refuses a server it cannot verify.
+"""
+
+import argparse
+import http.server
+import os
+import socket
+import ssl
+import subprocess
+import sys
+import time
+
+READING = (b'{"temp":21.5,"humidity":45.0,"wind_speed":3.2,"wind_dir":180.0,'
+           b'"pressure":101.3,"smoke":0.0,"ambient":60.0}')
+
+
+def openssl(*args):
+    subprocess.run(["openssl", *args], check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def make_certificates(directory, name):
+    """Create ca.pem and a server certificate for name signed by it"""
+    os.makedirs(directory, exist_ok=True)
+    ca_key = os.path.join(directory, "ca.key")
+    ca = os.path.join(directory, "ca.pem")
+    key = os.path.join(directory, name + ".key")
+    csr = os.path.join(directory, name + ".csr")
+    cert = os.path.join(directory, name + ".pem")
+    ext = os.path.join(directory, name + ".ext")
+
+    if not os.path.exists(ca):
+        openssl("req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:P-256", "-nodes",
+                "-keyout", ca_key, "-out", ca, "-days", "3650", "-subj", "/CN=BaseStation test CA")
+
+    if not os.path.exists(cert):
+        with open(ext, "w") as f:
+            f.write("subjectAltName=DNS:%s\n" % name)
+        openssl("req", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:P-256", "-nodes",
+                "-keyout", key, "-out", csr, "-subj", "/CN=" + name)
+        openssl("x509", "-req", "-in", csr, "-CA", ca, "-CAkey", ca_key, "-CAcreateserial",
+                "-out", cert, "-days", "825", "-extfile", ext)
+
+    return ca, cert, key
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(READING)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(READING)
+
+    def log_message(self, format, *args):
+        sys.stderr.write("%s %s\n" % (self.client_address[0], format % args))
+
+
+class Server(http.server.HTTPServer):
+    def __init__(self, address, context):
+        super().__init__(address, Handler)
+        self.context = context
+        self.handshakes = 0
+        self.resumed = 0
+
+    def get_request(self):
+        sock, address = self.socket.accept()
+        tls = self.context.wrap_socket(sock, server_side=True, do_handshake_on_connect=False)
+
+        start = time.monotonic()
+        try:
+            tls.do_handshake()
+        except (ssl.SSLError, OSError) as e:
+            print("%s handshake failed: %s" % (address[0], e))
+            tls.close()
+            raise
+
+        self.handshakes += 1
+        self.resumed += tls.session_reused
+        print("%s %s %s, %s in %.1f ms (%d of %d resumed)" % (
+            address[0], tls.version(), tls.cipher()[0], "resumed" if tls.session_reused else "full handshake",
+            (time.monotonic() - start) * 1000, self.resumed, self.handshakes), flush=True)
+
+        return tls, address
+
+    def handle_error(self, request, client_address):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("name", help="host name the base station is built with")
+    parser.add_argument("--port", type=int, default=443)
+    parser.add_argument("--dir", default="tls_standin")
+    parser.add_argument("--wrong-name", action="store_true", help="serve a certificate for another name")
+    args = parser.parse_args()
+
+    ca, cert, key = make_certificates(args.dir, "wrong." + args.name if args.wrong_name else args.name)
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.minimum_version = ssl.TLSVersion.TLSv1_2
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    context.load_cert_chain(cert, key)
+
+    server = Server(("", args.port), context)
+    print("Serving %s on port %d, CA certificate in %s" % (args.name, args.port, ca), flush=True)
+
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Convert a BaseStation trace dump to Chrome trace JSON.
+
+Capture the output of the "trace" console command to a file, for example
+
+    echo trace > /dev/ttyACM0; cat /dev/ttyACM0 > trace.txt
+
+and convert it with
+
+    tools/trace2json.py trace.txt > trace.json
+
+Open trace.json in https://ui.perfetto.dev or chrome://tracing.
+
+Instant events are shown on the thread of the core that recorded them.
+Begin/end pairs are shown as async slices keyed by event and argument, so
+overlapping requests for different stations get their own tracks.
+"""
+
+import json
+import struct
+import sys
+
+RECORD = struct.Struct("<IBBH")
+
+TYPE_BEGIN = 0
+TYPE_END = 1
+TYPE_INSTANT = 2
+
+
+def parse(lines):
+    names = {}
+    records = []
+    in_trace = False
+
+    for line in lines:
+        fields = line.strip().split()
+        if not fields:
+            continue
+
+        if fields[0] == "TRACE":
+            if fields[1] != "1":
+                raise ValueError("unsupported trace version " + fields[1])
+            in_trace = True
+            names.clear()
+            records.clear()
+        elif not in_trace:
+            # Other console output before the dump
+            continue
+        elif fields[0] == "N":
+            names[int(fields[1])] = fields[2]
+        elif fields[0] == "C":
+            core = int(fields[1])
+            data = bytes.fromhex(fields[2])
+            for offset in range(0, len(data), RECORD.size):
+                time_us, event_id, event_type, arg = RECORD.unpack_from(data, offset)
+                records.append((core, time_us, event_id, event_type, arg))
+        elif fields[0] == "END":
+            in_trace = False
+
+    return names, records
+
+
+def unwrap(records):
+    """Make the 32 bit microsecond timestamps monotonic per core."""
+    result = []
+    for core in sorted({r[0] for r in records}):
+        offset = 0
+        previous = None
+        for record in (r for r in records if r[0] == core):
+            time_us = record[1]
+            if previous is not None and time_us + offset < previous:
+                offset += 1 << 32
+            previous = time_us + offset
+            result.append((core, previous) + record[2:])
+    return result
+
+
+def convert(names, records):
+    events = []
+
+    for core in sorted({r[0] for r in records}):
+        events.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": core,
+                       "args": {"name": "core %d" % core}})
+
+    for core, time_us, event_id, event_type, arg in unwrap(records):
+        name = names.get(event_id, "event_%d" % event_id)
+        event = {"name": name, "cat": name.split("_")[0], "ts": time_us, "pid": 0, "tid": core,
+                 "args": {"arg": arg}}
+
+        if event_type == TYPE_INSTANT:
+            event["ph"] = "i"
+            event["s"] = "t"
+        else:
+            event["ph"] = "b" if event_type == TYPE_BEGIN else "e"
+            event["id"] = "%s-%d" % (name, arg)
+
+        events.append(event)
+
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) > 2:
+        print(__doc__, file=sys.stderr)
+        return 1
+
+    source = open(sys.argv[1]) if len(sys.argv) == 2 else sys.stdin
+    with source:
+        names, records = parse(source)
+
+    json.dump(convert(names, records), sys.stdout, indent=1)
+    print()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
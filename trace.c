@@ -0,0 +1,119 @@
+#include "trace.h"
+
+#if BASESTATION_TRACE
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+// Version of the dump format
+#define TRACE_VERSION 1
+
+// Records per dump line
+#define TRACE_RECORDS_PER_LINE 16
+
+#define TRACE_CORES 2
+
+typedef struct{
+    uint32_t time_us;
+    uint8_t id;
+    uint8_t type;
+    uint16_t arg;
+} TraceRecord;
+
+static const char *event_names[TRACE_EVENT_IDS] = {
+    [TRACE_KEY] = "key",
+    [TRACE_PAGE] = "page",
+    [TRACE_HTTP_RESOLVING] = "http_resolving",
+    [TRACE_HTTP_CONNECTING] = "http_connecting",
+    [TRACE_HTTP_AWAIT_HEADERS] = "http_await_headers",
+    [TRACE_HTTP_RECEIVING] = "http_receiving",
+    [TRACE_HTTP_DONE] = "http_done",
+    [TRACE_HTTP_FAILED] = "http_failed",
+    [TRACE_WIFI_JOIN] = "wifi_join",
+    [TRACE_WIFI_LINK] = "wifi_link",
+    [TRACE_BUZZER] = "buzzer",
+};
+
+static struct TraceState{
+    TraceRecord ring[TRACE_CORES][TRACE_EVENTS];
+
+    // Total events written to each ring. Only written by its own core
+    uint32_t head[TRACE_CORES];
+
+    volatile bool paused;
+} state;
+
+void trace_record(enum trace_event id, enum trace_type type, uint16_t arg)
+{
+    if(state.paused){
+        return;
+    }
+
+    uint core = get_core_num();
+
+    // Masking interrupts makes the slot reservation safe against IRQ handlers
+    // on this core. The other core has its own ring
+    uint32_t irq = save_and_disable_interrupts();
+
+    TraceRecord *record = &state.ring[core][state.head[core] & (TRACE_EVENTS - 1)];
+    state.head[core]++;
+
+    record->time_us = time_us_32();
+    record->id = id;
+    record->type = type;
+    record->arg = arg;
+
+    restore_interrupts(irq);
+}
+
+void trace_clear()
+{
+    state.paused = true;
+
+    for(int core = 0; core < TRACE_CORES; core++){
+        state.head[core] = 0;
+    }
+
+    state.paused = false;
+}
+
+void trace_dump()
+{
+    state.paused = true;
+
+    printf("TRACE %d %lu\n", TRACE_VERSION, (unsigned long)time_us_32());
+
+    for(int i = 0; i < TRACE_EVENT_IDS; i++){
+        printf("N %d %s\n", i, event_names[i]);
+    }
+
+    for(int core = 0; core < TRACE_CORES; core++){
+        uint32_t head = state.head[core];
+        uint32_t count = head < TRACE_EVENTS ? head : TRACE_EVENTS;
+
+        // Oldest event first
+        for(uint32_t i = 0; i < count; i++){
+            if(i % TRACE_RECORDS_PER_LINE == 0){
+                printf("%sC %d ", i == 0 ? "" : "\n", core);
+            }
+
+            const uint8_t *bytes = (const uint8_t *)&state.ring[core][(head - count + i) & (TRACE_EVENTS - 1)];
+            for(int b = 0; b < sizeof(TraceRecord); b++){
+                printf("%02x", bytes[b]);
+            }
+        }
+
+        if(count > 0){
+            printf("\n");
+        }
+    }
+
+    printf("END\n");
+
+    state.paused = false;
+}
+
+#endif //BASESTATION_TRACE
@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+Event trace ring buffer.
+
+Timestamped begin, end and instant events are recorded in one ring per
+core, so both cores can trace without sharing state. An event is 8 bytes
+and is written with interrupts masked for a few instructions, so it can
+be recorded from IRQ handlers too. When a ring is full the oldest events
+are overwritten.
+
+The "trace" console command dumps the rings. tools/trace2json.py converts
+the dump to Chrome trace JSON that can be opened in Perfetto or
+chrome://tracing.
+
+Only enabled when built with BASESTATION_TRACE. Otherwise the macros
+expand to nothing.
+*/
+
+// Events per core. Must be a power of two
+#define TRACE_EVENTS 512
+
+enum trace_event{
+    TRACE_KEY = 0,          // Instant, arg is the key
+    TRACE_PAGE,             // Instant, arg is the new UI state
+    TRACE_HTTP_RESOLVING,   // Begin/end, arg is the station
+    TRACE_HTTP_CONNECTING,
+    TRACE_HTTP_AWAIT_HEADERS,
+    TRACE_HTTP_RECEIVING,
+    TRACE_HTTP_DONE,        // Instant, arg is the station
+    TRACE_HTTP_FAILED,      // Instant, arg is the station
+    TRACE_WIFI_JOIN,        // Begin/end
+    TRACE_WIFI_LINK,        // Instant, arg is 1 when the link is up
+    TRACE_BUZZER,           // Instant, arg is the pattern
+    TRACE_EVENT_IDS
+};
+
+enum trace_type{
+    TRACE_TYPE_BEGIN = 0,
+    TRACE_TYPE_END,
+    TRACE_TYPE_INSTANT
+};
+
+#if BASESTATION_TRACE
+
+void trace_record(enum trace_event id, enum trace_type type, uint16_t arg);
+
+/**
+ * @brief Print both rings over stdio. Recording is paused during the dump.
+ *
+ * The dump is line based:
+ * "TRACE <version> <time_us>" header, "N <id> <name>" for each event id,
+ * "C <core> <hex>" lines with records and "END". Each record is 8 bytes,
+ * little endian: uint32 time_us, uint8 id, uint8 type, uint16 arg.
+ */
+void trace_dump();
+
+/**
+ * @brief Discard all recorded events
+ */
+void trace_clear();
+
+#define TRACE_BEGIN(id, arg) trace_record(id, TRACE_TYPE_BEGIN, arg)
+#define TRACE_END(id, arg) trace_record(id, TRACE_TYPE_END, arg)
+#define TRACE_INSTANT(id, arg) trace_record(id, TRACE_TYPE_INSTANT, arg)
+
+#else
+
+#define TRACE_BEGIN(id, arg) ((void)0)
+#define TRACE_END(id, arg) ((void)0)
+#define TRACE_INSTANT(id, arg) ((void)0)
+
+#endif //BASESTATION_TRACE
+
+#endif //TRACE_H
@@ -7,52 +7,51 @@
 
 #include "userinterface.h"
 #include "display.h"
+#include "view.h"
+#include "entry.h"
+#include "toast.h"
 #include "wifi.h"
 #include "server_interface.h"
 #include "keypad.h"
 #include "buzzer.h"
+#include "netstats.h"
 
 #include "pico/time.h"
 
 static bool muted = 0;
 
-static WeatherStationData weather_station_data;
+// A join started on the WiFi page has not finished yet
+static bool wifi_joining = false;
 
-// Number of text lines on data page
-#define DATA_LINES 7
-
-// Type definition for function printing each data line
-typedef void (*PrintFunc)(uint8_t);
-
-// Data print functions
-PrintFunc data_print_funcs[DATA_LINES] = {
-    _print_temp_,
-    _print_humid_,
-    _print_wind_speed_,
-    _print_wind_dir_,
-    _print_pressure_,
-    _print_smoke_,
-    _print_light_
-};
+static WeatherStationData weather_station_data;
 
 // Number of lines on settings page
-#define SETTING_LINES 2
-
-// Number of lines on settings/buzzer page
-#define BUZZER_SETTING_LINES 6
-
-// Number of times the system should attempt to contact server
-// When first gaining WiFi connection
-#define SERVER_REQUEST_ATTEMPTS 3
-
-// Array for saving buzzer limit settings
-_BuzzerSetting_ buzzer_setting_buffer[BUZZER_SETTING_LINES] ={
-    {.name = "Temp", .unit = "C", .value = 0, .is_initialized = false},
-    {.name = "Humid", .unit = "%", .value = 0, .is_initialized = false},
-    {.name = "Wind", .unit = "m/s", .value = 0, .is_initialized = false},
-    {.name = "Pres", .unit = "MPa", .value = 0, .is_initialized = false},
-    {.name = "Light", .unit = "%", .value = 0, .is_initialized = false},
-    {.name = "Smoke", .unit = "%", .value = 0, .is_initialized = false},
+#define SETTING_LINES 3
+
+// Number of lines on diagnostics page
+#define DIAGNOSTIC_LINES 8
+
+// Longest diagnostic value: two 32-bit counters with units and a separator.
+// A value too long for the line is printed over its name
+#define DIAGNOSTIC_VALUE_LENGTH (2 * 10 + 3)
+
+// Buzzer limits, indexed by metric
+_BuzzerSetting_ buzzer_setting_buffer[METRICS];
+
+// Severity of the alarm rules made from buzzer limits
+#define BUZZER_SEVERITY ALARM_WARNING
+
+// Time status and alarm toasts are shown
+#define STATUS_TOAST_MS 5000
+#define JOIN_TOAST_MS 2000
+#define ALARM_TOAST_MS 5000
+
+// Buzzer pattern for each alarm severity
+static const enum buzzer_pattern severity_pattern[] = {
+    [ALARM_NONE] = BUZZER_PATTERN_NONE,
+    [ALARM_INFO] = BUZZER_PATTERN_INFO,
+    [ALARM_WARNING] = BUZZER_PATTERN_WARNING,
+    [ALARM_CRITICAL] = BUZZER_PATTERN_CRITICAL
 };
 
 // Initialization function for UI
@@ -69,35 +68,120 @@ enum InterfaceState welcome_page(enum Button input)
         return data_page(NO_INPUT);
     }
 
-    display_clear();
-    display_set_cursor(0, 4);
-    display_print_string("Welcome");
-    display_set_cursor(1, 4);
-    display_print_string("Pro+ 25");    
+    view_clear();
+    view_set_cursor(0, 4);
+    view_print_string("Welcome");
+    view_set_cursor(1, 4);
+    view_print_string("Pro+ 25");    
 
 
     return UI_WELCOME;
 }
 
-enum InterfaceState data_page(enum Button input)
+// Play the pattern of the highest active alarm. The buzzer keeps playing
+// on its own, so this only has to be called when the alarms change
+static void update_buzzer()
 {
-    static uint8_t data_line_no = 0;
+    buzzer_play(muted ? BUZZER_PATTERN_NONE : severity_pattern[alarm_severity()]);
+}
 
-    bool new_data_v = new_data();
+// Tell which limit was exceeded when the alarm severity rises
+static void _toast_alarm_()
+{
+    for(int i = 0; i < get_station_count(); i++){
+        for(int m = 0; m < METRICS; m++){
+            if(is_buzzer_limit_set(m) && alarm_rule_active(i, m)){
+                char line[TOAST_LINE + 1];
+                snprintf(line, sizeof(line), "%s over limit", metric_info[m].label);
+
+                toast_show(get_station_name(i), line, ALARM_TOAST_MS, TOAST_ALARM);
+                return;
+            }
+        }
+    }
+}
 
-    // Get last data
-    weather_station_data = get_weather_station_data();
+void ui_wifi_event(enum wifi_event event)
+{
+    if(!wifi_joining || event == WIFI_EVENT_NONE){
+        return;
+    }
 
-    if(new_data_v){
-        bool start_buzzer = compare_limit();
-        buzzer_put(start_buzzer && !muted);
+    wifi_joining = false;
+
+    if(event == WIFI_EVENT_CONNECTED){
+        toast_show("Connected", NULL, STATUS_TOAST_MS, TOAST_INFO);
+    }
+    else{
+        toast_show("Failed to", "connect", STATUS_TOAST_MS, TOAST_WARNING);
     }
+}
 
-    if(input == INPUT_UP){
-        data_line_no = (data_line_no + DATA_LINES - 1) % DATA_LINES;
+void ui_update_alarms()
+{
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    enum alarm_severity previous = alarm_severity();
+
+    for(int i = 0; i < get_station_count(); i++){
+        if(station_new_data(i)){
+            WeatherStationData data = get_station_data(i);
+            alarm_update(i, &data, now_ms);
+        }
+    }
+
+    // Hold-off and stale readings are timed between readings too
+    alarm_tick(now_ms);
+
+    if(alarm_severity() > previous){
+        _toast_alarm_();
+    }
+
+    update_buzzer();
+}
+
+// Buzzer limits are alarm rules in the slot with the same index as the metric
+static void _apply_buzzer_limit_(enum weather_metric metric)
+{
+    AlarmRule rule = {
+        .metric = metric,
+        .op = ALARM_ABOVE,
+        .severity = BUZZER_SEVERITY,
+        .threshold = buzzer_setting_buffer[metric].value,
+        .hysteresis = metric_info[metric].hysteresis,
+        .holdoff_ms = 0
+    };
+
+    alarm_set_rule(metric, &rule);
+}
+
+// Next metric after metric in direction step that has a buzzer limit
+static uint8_t _next_limit_(uint8_t metric, int step)
+{
+    do{
+        metric = (metric + METRICS + step) % METRICS;
+    } while(!metric_info[metric].limit);
+
+    return metric;
+}
+
+enum InterfaceState data_page(enum Button input)
+{
+    static uint8_t data_line_no = 0;
+    static uint8_t station_no = 0;
+
+    uint8_t n_stations = get_station_count();
+
+    if(input == INPUT_LEFT){
+        station_no = (station_no + n_stations - 1) % n_stations;
+    }
+    else if(input == INPUT_RIGHT){
+        station_no = (station_no + 1) % n_stations;
+    }
+    else if(input == INPUT_UP){
+        data_line_no = (data_line_no + METRICS - 1) % METRICS;
     }
     else if(input == INPUT_DOWN){
-        data_line_no = (data_line_no + 1) % DATA_LINES;
+        data_line_no = (data_line_no + 1) % METRICS;
     }
     else if(input == INPUT_SELECT){
         // Goto settings
@@ -106,15 +190,24 @@ enum InterfaceState data_page(enum Button input)
     else if(input == INPUT_MUTE){
         muted = !muted;
 
-        bool start_buzzer = compare_limit();
-        buzzer_put(start_buzzer && !muted);
+        update_buzzer();
     }
 
+    // Last data of the selected station. Only ui_update_alarms takes
+    // readings, so none is used up here before the alarms see it
+    weather_station_data = peek_station_data(station_no);
 
-    display_clear();
+    view_clear();
 
-    data_print_funcs[data_line_no % DATA_LINES](0);
-    data_print_funcs[(data_line_no + 1) % DATA_LINES](1);
+    if(n_stations > 1 || station_data_is_stale(station_no)){
+        // Station name and data age on first line, data on second line
+        _print_station_(station_no, 0);
+        _print_metric_(data_line_no % METRICS, 1);
+    }
+    else{
+        _print_metric_(data_line_no % METRICS, 0);
+        _print_metric_((data_line_no + 1) % METRICS, 1);
+    }
 
     return UI_DATA;
 }
@@ -138,6 +231,9 @@ enum InterfaceState settings_page(enum Button input)
             // Go to wifi settings page
             return wifi_settings_page(NO_INPUT);
         }
+        else if(line_no == 2){
+            return diagnostics_page(NO_INPUT);
+        }
 
         return 0;
     }
@@ -146,19 +242,22 @@ enum InterfaceState settings_page(enum Button input)
     }
 
     // Clear display
-    display_clear();
+    view_clear();
 
     // Print buzzer settings
-    display_set_cursor(0, 4);
-    display_print_string("Settings");
+    view_set_cursor(0, 4);
+    view_print_string("Settings");
 
-    display_set_cursor(1, 0);
+    view_set_cursor(1, 0);
     
     if(line_no == 0){
-        display_print_string("Buzzer");
+        view_print_string("Buzzer");
     }
     else if(line_no == 1){
-        display_print_string("WiFi");
+        view_print_string("WiFi");
+    }
+    else if(line_no == 2){
+        view_print_string("Diagnostics");
     }
     // Print wifi setting
 
@@ -168,12 +267,8 @@ enum InterfaceState settings_page(enum Button input)
 
 uint8_t scan_wifi()
 {
-    display_clear();
-    display_print_string("Scanning for");
-    display_set_cursor(1, 0);
-    display_print_string("WiFi networks");
-
-    scan_for_networks();
+    // Results are shown as they arrive, see wifi_settings_page
+    wifi_scan_start();
 
     return get_network_buffer_size();
     
@@ -184,7 +279,19 @@ enum InterfaceState wifi_settings_page(enum Button input)
     static uint8_t no_networks = 0;
     static uint8_t line_no = 0;
 
-    if(input == INPUT_UP){
+    // SSID on the display. The list is re-sorted as results arrive, so
+    // select joins the network that was shown rather than the one now at line_no
+    static char ssid[WIFI_SSID_SIZE];
+
+    // Scan results may have arrived since last call
+    if(input != NO_INPUT){
+        no_networks = get_network_buffer_size();
+    }
+
+    if(no_networks == 0 && (input == INPUT_UP || input == INPUT_DOWN || input == INPUT_SELECT)){
+        // Nothing to select yet
+    }
+    else if(input == INPUT_UP){
         line_no = (line_no + no_networks - 1) % no_networks;
     }
     else if(input == INPUT_DOWN){
@@ -192,41 +299,21 @@ enum InterfaceState wifi_settings_page(enum Button input)
     }
     else if(input == INPUT_SELECT){
 
-        // Connect to network
-        if(connect_to_network(line_no) == 0){
-            display_clear();
-            display_set_cursor(0, 3);
-            display_print_string("Connected");
-
-            sleep_ms(5000);
-            for(int i = 0; i < SERVER_REQUEST_ATTEMPTS; i++){
-                if(request_last_data() == 0){
-                    break;
-                }
-                sleep_ms(1000);
-
-            }
-            
-            sleep_ms(500);
+        // The join goes on in the background. The main loop requests
+        // data once it is up, see ui_wifi_event for the result
+        if(connect_to_network(ssid) == 0){
+            toast_show("Connecting", NULL, JOIN_TOAST_MS, TOAST_INFO);
+            wifi_joining = true;
 
             line_no = 0;
             return data_page(NO_INPUT);
         }
         else{
-            display_clear();
-            display_set_cursor(0, 3);
-            display_print_string("Failed to");
-            display_set_cursor(1, 4);
-            display_print_string("connect");
-            
-
-            sleep_ms(5000);
+            toast_show("Failed to", "connect", STATUS_TOAST_MS, TOAST_WARNING);
 
             line_no = 0;
             return settings_page(NO_INPUT);
         }
-
-        
     }
     else if(input == INPUT_BACK){
         return settings_page(0);
@@ -237,209 +324,234 @@ enum InterfaceState wifi_settings_page(enum Button input)
     }
 
     // Clear display
-    display_clear();
+    view_clear();
 
-    display_set_cursor(0, 0);
-    display_print_string("Choose network");
+    view_set_cursor(0, 0);
+    view_print_string("Choose network");
 
-    display_set_cursor(1, 0);
-    display_print_string(get_network_ssid(line_no));
+    view_set_cursor(1, 0);
+
+    if(no_networks == 0 || get_network_ssid(line_no, ssid) != 0){
+        ssid[0] = '\0';
+        view_print_string(wifi_scan_active() ? "Scanning..." : "None found");
+    }
+    else{
+        view_print_string(ssid);
+    }
 
     return UI_SETTINGS_WIFI;
 }
 
-int settings_enter_value(uint8_t precision, _BuzzerSetting_ * setting){
-    char buffer[16] = {0};
-    buffer[precision - 1] = '.';
+enum InterfaceState buzzer_settings_page(enum Button input){
+    static uint8_t metric = METRIC_TEMP;
 
-    // Show cursor
-    //_display_on_off_control_(DISPLAY_ON, DISPLAY_CURSOR_ON, DISPLAY_CURSOR_BLINKING_ON);
-    display_show_cursor(DISPLAY_CURSOR_ON);
+    const MetricInfo *info = &metric_info[metric];
 
-    // Move cursor to position so the given precision (+ comma) 
-    // fits to the right of cursor (including cursor)
-    display_set_cursor(1, 16-(precision + 1 + strlen(setting->unit)));
-    
-    uint8_t index = 0;
+    // While a limit is entered all keys go to the entry
+    if(entry_active()){
+        if(input != NO_INPUT && entry_input(input) == ENTRY_DONE){
+            set_buzzer_limit(metric, entry_value());
+        }
+    }
+    else if(input == INPUT_UP){
+        metric = _next_limit_(metric, -1);
+    }
+    else if(input == INPUT_DOWN){
+        metric = _next_limit_(metric, 1);
+    }
+    else if(input == INPUT_SELECT){
+        entry_start(info->decimals, info->min, info->max);
+    }
+    else if(input == INPUT_BACK){
+        return settings_page(0);
+    }
 
-    while (true) {
-        // Poll keypad
-        char key = poll_keypad();
+    info = &metric_info[metric];
 
-        // If no key is pressed, continue loop
-        if(key == 0 || key == '#' || key == '*'){
-            continue;
-        }
-        
-        display_print_character(key);
-        buffer[index] = key;
+    // Clear display
+    view_clear();
 
-        index++;
+    view_set_cursor(0, 0);
 
-        if(index == precision + 1){
-            break;
+    if(entry_active()){
+        char buffer[16];
+
+        // Range of the limit, or a warning after an out of range value
+        if(entry_invalid()){
+            view_print_string("Out of range");
         }
-        else if(index == precision - 1){
-            display_print_character('.');
-            index++;
+        else{
+            snprintf(buffer, 16, "%.*f-%.*f", info->decimals, info->min, info->decimals, info->max);
+            view_print_string(buffer);
         }
-    }
 
-    display_show_cursor(DISPLAY_CURSOR_OFF);
+        view_set_cursor(1, 0);
+        view_print_string(info->label);
+        view_print_character(':');
 
-    setting->value = strtof(buffer, NULL);
-    setting->is_initialized = true;
+        entry_format(buffer, 16 - strlen(info->unit));
+        strcat(buffer, info->unit);
+        view_print_string_rj(buffer, 1);
+    }
+    else{
+        view_print_string("Buzzer limits");
 
-    printf("Value: %f = %f\n", setting->value, strtof(buffer, NULL));
+        view_set_cursor(1, 0);
+        _print_buzzer_limit_(metric);
+    }
 
-    return 0;
+    return UI_SETTING_BUZZER;
 }
 
-enum InterfaceState buzzer_settings_page(enum Button input){
+enum InterfaceState diagnostics_page(enum Button input)
+{
     static uint8_t line_no = 0;
 
     if(input == INPUT_UP){
-        line_no = (line_no + BUZZER_SETTING_LINES - 1) % BUZZER_SETTING_LINES;
+        line_no = (line_no + DIAGNOSTIC_LINES - 1) % DIAGNOSTIC_LINES;
     }
     else if(input == INPUT_DOWN){
-        line_no = (line_no + 1) % BUZZER_SETTING_LINES;
-    }
-    else if(input == INPUT_SELECT){
-        settings_enter_value(3, &buzzer_setting_buffer[line_no]);
+        line_no = (line_no + 1) % DIAGNOSTIC_LINES;
     }
     else if(input == INPUT_BACK){
         return settings_page(0);
     }
+    else if(input == NO_INPUT){
+        line_no = 0;
+    }
 
-    // Clear display
-    display_clear();
-
-    display_set_cursor(0, 0);
-    display_print_string("Buzzer limits");
+    view_clear();
 
-    display_set_cursor(1, 0);
-    _print_buzzer_limit_(buzzer_setting_buffer[line_no]);
+    _print_diagnostic_(line_no, 0);
+    _print_diagnostic_((line_no + 1) % DIAGNOSTIC_LINES, 1);
 
-    return UI_SETTING_BUZZER;
+    return UI_DIAGNOSTICS;
 }
 
-bool compare_limit()
-{
-    if(weather_station_data.temp > buzzer_setting_buffer[BUZZER_TEMP].value && buzzer_setting_buffer[BUZZER_TEMP].is_initialized){
-        return true;
-    }
-    else if(weather_station_data.humidity > buzzer_setting_buffer[BUZZER_HUMID].value && buzzer_setting_buffer[BUZZER_HUMID].is_initialized){
-        return true;
-    }
-    else if(weather_station_data.wind_spd > buzzer_setting_buffer[BUZZER_WIND].value && buzzer_setting_buffer[BUZZER_WIND].is_initialized){
-        return true;
-    }
-    else if(weather_station_data.pressure > buzzer_setting_buffer[BUZZER_PRES].value && buzzer_setting_buffer[BUZZER_PRES].is_initialized){
-        return true;
-    }
-    else if(weather_station_data.ambient_light > buzzer_setting_buffer[BUZZER_LIGHT].value && buzzer_setting_buffer[BUZZER_LIGHT].is_initialized){
-        return true;
-    }
-    else if(weather_station_data.smoke > buzzer_setting_buffer[BUZZER_SMOKE].value && buzzer_setting_buffer[BUZZER_SMOKE].is_initialized){
-        return true;
-    }
-
-    return false;
+float get_buzzer_limit(enum weather_metric metric){
+    return buzzer_setting_buffer[metric].value;
 }
 
-float get_buzzer_limit(enum buzzer_setting setting){
-    return buzzer_setting_buffer[setting].value;
+bool is_buzzer_limit_set(enum weather_metric metric){
+    return buzzer_setting_buffer[metric].is_initialized;
 }
 
+void set_buzzer_limit(enum weather_metric metric, float value){
+    buzzer_setting_buffer[metric].value = value;
+    buzzer_setting_buffer[metric].is_initialized = true;
 
-
-void _print_temp_(uint8_t line)
-{
-    display_set_cursor(line, 0);
-    display_print_string("Temp: ");
-
-    char buffer[16];
-    snprintf(buffer, 16, "%3.1f", weather_station_data.temp);
-
-    display_print_string_rj(buffer, line);
+    _apply_buzzer_limit_(metric);
 }
 
-void _print_humid_(uint8_t line)
-{
-    display_set_cursor(line, 0);
-    display_print_string("Humid: ");
-
-    char buffer[16];
-    snprintf(buffer, 16, "%3.1f", weather_station_data.humidity);
 
-    display_print_string_rj(buffer, line);
-}
 
-void _print_wind_speed_(uint8_t line)
+void _print_metric_(uint8_t metric, const uint8_t line)
 {
-    display_set_cursor(line, 0);
-    display_print_string("W sp: ");
-
-    char buffer[16];
-    snprintf(buffer, 16, "%3.1f", weather_station_data.wind_spd);
+    const MetricInfo *info = &metric_info[metric];
 
-    display_print_string_rj(buffer, line);
-}
+    view_set_cursor(line, 0);
+    view_print_string(info->label);
+    view_print_string(": ");
 
-void _print_wind_dir_(uint8_t line)
-{
-    display_set_cursor(line, 0);
-    display_print_string("W dir: ");
-    
     char buffer[16];
-    snprintf(buffer, 16, "%3.1f", weather_station_data.wind_dir);
+    snprintf(buffer, 16, "%3.*f", info->decimals, metric_value(&weather_station_data, metric));
 
-    display_print_string_rj(buffer, line);
+    view_print_string_rj(buffer, line);
 }
 
-void _print_pressure_(uint8_t line)
+void _print_station_(uint8_t station, const uint8_t line)
 {
-    display_set_cursor(line, 0);
-    display_print_string("Pres: ");
+    view_set_cursor(line, 0);
+    view_print_string(get_station_name(station));
+
+    int32_t age_ms = get_station_data_age_ms(station);
 
     char buffer[16];
-    snprintf(buffer, 16, "%3.1f", weather_station_data.pressure);
+    if(station_data_is_stale(station)){
+        // Cached from before last reset
+        snprintf(buffer, 16, "old");
+    }
+    else if(age_ms < 0){
+        snprintf(buffer, 16, "--");
+    }
+    else{
+        snprintf(buffer, 16, "%lds", (long)(age_ms / 1000));
+    }
 
-    display_print_string_rj(buffer, line);
+    view_print_string_rj(buffer, line);
 }
 
-void _print_smoke_(uint8_t line)
+void _print_buzzer_limit_(uint8_t metric)
 {
-    display_set_cursor(line, 0);
-    display_print_string("Smoke: ");
-
+    const MetricInfo *info = &metric_info[metric];
     char buffer[16];
-    snprintf(buffer, 16, "%3.1f", weather_station_data.smoke);
 
-    display_print_string_rj(buffer, line);
-}
+    view_set_cursor(1, 0);
+    view_print_string(info->label);
+    view_print_character(':');
 
-void _print_light_(uint8_t line)
-{
-    display_set_cursor(line, 0);
-    display_print_string("Light: ");
+    snprintf(buffer, 16, "%2.*f%s", info->decimals, buzzer_setting_buffer[metric].value, info->unit);
 
-    char buffer[16];
-    snprintf(buffer, 16, "%3.1f", weather_station_data.ambient_light);
+    view_print_string_rj(buffer, 1);
 
-    display_print_string_rj(buffer, line);
 }
 
-void _print_buzzer_limit_(const _BuzzerSetting_ setting)
+void _print_diagnostic_(uint8_t item, const uint8_t line)
 {
-    char buffer[16];
-
-    display_set_cursor(1, 0);
-    display_print_string(setting.name);
-    display_print_character(':');
-
-    snprintf(buffer, 16, "%2.1f%s", setting.value, setting.unit);
+    NetPoolStats pool;
+    NetTrafficStats traffic;
+    ServerStats server;
+
+    const char *name = "";
+    char buffer[DIAGNOSTIC_VALUE_LENGTH + 1];
+
+    switch(item){
+    case 0:
+        // High-water mark of the lwIP heap
+        pool = net_stats_pool(NET_POOL_HEAP);
+        name = "Heap";
+        snprintf(buffer, sizeof(buffer), "%lu/%lu", (unsigned long)pool.max, (unsigned long)pool.size);
+        break;
+    case 1:
+        pool = net_stats_pool(NET_POOL_PBUF_POOL);
+        name = "Pbuf";
+        snprintf(buffer, sizeof(buffer), "%lu/%lu", (unsigned long)pool.max, (unsigned long)pool.size);
+        break;
+    case 2:
+        pool = net_stats_pool(NET_POOL_TCP_SEG);
+        name = "Seg";
+        snprintf(buffer, sizeof(buffer), "%lu/%lu", (unsigned long)pool.max, (unsigned long)pool.size);
+        break;
+    case 3:
+        traffic = net_stats_traffic();
+        name = "Alloc err";
+        snprintf(buffer, sizeof(buffer), "%lu", (unsigned long)traffic.alloc_failures);
+        break;
+    case 4:
+        traffic = net_stats_traffic();
+        name = "Retx";
+        snprintf(buffer, sizeof(buffer), "%lu", (unsigned long)traffic.tcp_retransmits);
+        break;
+    case 5:
+        traffic = net_stats_traffic();
+        name = "Rx/Tx";
+        snprintf(buffer, sizeof(buffer), "%luk/%luk", (unsigned long)traffic.bytes_in / 1024, (unsigned long)traffic.bytes_out / 1024);
+        break;
+    case 6:
+        server = get_server_stats();
+        name = "Req";
+        snprintf(buffer, sizeof(buffer), "%lu/%lu", (unsigned long)server.done, (unsigned long)server.requests);
+        break;
+    default:
+        server = get_server_stats();
+        name = "Fail";
+        snprintf(buffer, sizeof(buffer), "%lu/%lu", (unsigned long)server.failed, (unsigned long)server.timeouts);
+        break;
+    }
 
-    display_print_string_rj(buffer, 1);
+    view_set_cursor(line, 0);
+    view_print_string(name);
+    view_print_character(':');
 
+    view_print_string_rj(buffer, line);
 }
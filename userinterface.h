@@ -1,33 +1,41 @@
 #ifndef USERINTERFACE_H
 #define USERINTERFACE_H
 
+#include "server_interface.h"
+#include "alarm.h"
+#include "wifi.h"
+
 enum InterfaceState{
     UI_WELCOME, 
     UI_DATA,
     UI_SETTINGS, 
     UI_SETTINGS_WIFI, 
     UI_SETTING_BUZZER, 
+    UI_DIAGNOSTICS,
 };
 
-enum buzzer_setting{
-    BUZZER_TEMP = 0,
-    BUZZER_HUMID,
-    BUZZER_WIND,
-    BUZZER_PRES,
-    BUZZER_LIGHT,
-    BUZZER_SMOKE
-};
-
+// Buzzer limit of a metric
 typedef struct{
-    const char* name;
-    const char* unit;
     float value;
     bool is_initialized;
 }  _BuzzerSetting_;
 
-enum Button{INPUT_UP = '2', INPUT_DOWN = '8', INPUT_SELECT = '#', INPUT_BACK = '*', INPUT_MUTE = '3', NO_INPUT = 0};
+enum Button{INPUT_UP = '2', INPUT_DOWN = '8', INPUT_LEFT = '4', INPUT_RIGHT = '6', INPUT_SELECT = '#', INPUT_BACK = '*', INPUT_MUTE = '3', INPUT_REFRESH = 1, NO_INPUT = 0};
 
 
+/**
+ * @brief Evaluate alarm rules on new readings, advance their timers and
+ * update the buzzer. Called on every pass of the main loop whatever page
+ * is shown
+ */
+void ui_update_alarms();
+
+/**
+ * @brief Tell the user how a join started on the WiFi page went.
+ * Called from the main loop with every event from wifi_poll
+ */
+void ui_wifi_event(enum wifi_event event);
+
 /**
  * @brief Initializes UI and prints welcome page
  * 
@@ -45,7 +53,8 @@ enum InterfaceState init_ui();
 enum InterfaceState welcome_page(enum Button input);
 
 /**
- * @brief Prints temperature page. If input is # go to settings
+ * @brief Prints data page. If input is # go to settings.
+ * Up/down scrolls through data lines and left/right switches station
  * 
  * @param input Page to print
  * 
@@ -58,31 +67,40 @@ enum InterfaceState settings_page(enum Button input);
 
 uint8_t scan_wifi();
 
+/**
+ * @brief Prints network list. NO_INPUT starts a new scan and INPUT_REFRESH 
+ * redraws the list with the results found so far
+ */
 enum InterfaceState wifi_settings_page(enum Button input);
 
 /**
- * @brief Allow user to enter value with a given precision 
- * and returns resulting floating point number
- * 
- * @param precision Number of digits to be entered. A comma is
- * placed before the last digit.
+ * @brief Prints buzzer limits. Select starts entering the limit shown,
+ * after which digits, * and # go to the entry until it is done
  */
-int settings_enter_value(uint8_t precision, _BuzzerSetting_ * setting);
-
 enum InterfaceState buzzer_settings_page(enum Button input);
 
-bool compare_limit();
+/**
+ * @brief Prints network and memory statistics two lines at a time.
+ * Up/down scrolls and INPUT_REFRESH redraws with current values
+ */
+enum InterfaceState diagnostics_page(enum Button input);
+
+float get_buzzer_limit(enum weather_metric metric);
+
+bool is_buzzer_limit_set(enum weather_metric metric);
+
+/**
+ * @brief Set buzzer limit. The limit is added as an alarm rule
+ * in the slot with the same index as the metric
+ */
+void set_buzzer_limit(enum weather_metric metric, float value);
+
+void _print_metric_(uint8_t metric, const uint8_t line);
 
-float get_buzzer_limit(enum buzzer_setting setting);
+void _print_station_(uint8_t station, const uint8_t line);
 
-void _print_temp_(const uint8_t line);
-void _print_humid_(const uint8_t line);
-void _print_wind_speed_(const uint8_t line);
-void _print_wind_dir_(const uint8_t line);
-void _print_pressure_(const uint8_t line);
-void _print_smoke_(const uint8_t line);
-void _print_light_(const uint8_t line);
+void _print_buzzer_limit_(uint8_t metric);
 
-void _print_buzzer_limit_(const _BuzzerSetting_ setting);
+void _print_diagnostic_(uint8_t item, const uint8_t line);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "view.h"
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "display.h"
+
+// Unchanged characters between two changes are rewritten rather than
+// moving the cursor, if there are at most this many
+#define VIEW_MAX_GAP 2
+
+static struct ViewState{
+    // Frame composed by the pages, and what the display shows
+    char frame[VIEW_ROWS][VIEW_COLUMNS];
+    char shown[VIEW_ROWS][VIEW_COLUMNS];
+
+    // Shown instead of the frame while overlay_active
+    char overlay[VIEW_ROWS][VIEW_COLUMNS];
+    bool overlay_active;
+
+    uint8_t row;
+    uint8_t column;
+
+    // Display content is unknown
+    bool invalid;
+
+    absolute_time_t next_frame;
+    uint32_t renders;
+} state;
+
+void view_init()
+{
+    memset(state.frame, ' ', sizeof(state.frame));
+    memset(state.shown, ' ', sizeof(state.shown));
+
+    state.row = 0;
+    state.column = 0;
+    state.invalid = false;
+    state.overlay_active = false;
+    state.next_frame = get_absolute_time();
+}
+
+void view_clear()
+{
+    memset(state.frame, ' ', sizeof(state.frame));
+
+    state.row = 0;
+    state.column = 0;
+}
+
+void view_set_cursor(uint8_t row, uint8_t column)
+{
+    state.row = row % VIEW_ROWS;
+    state.column = column;
+}
+
+void view_print_character(char character)
+{
+    if(state.column < VIEW_COLUMNS){
+        state.frame[state.row][state.column] = character;
+    }
+
+    state.column++;
+}
+
+void view_print_string(const char *string)
+{
+    while(*string != '\0'){
+        view_print_character(*string++);
+    }
+}
+
+void view_print_string_rj(const char *string, uint8_t row)
+{
+    size_t length = strlen(string);
+
+    view_set_cursor(row, length < VIEW_COLUMNS ? VIEW_COLUMNS - length : 0);
+    view_print_string(string);
+}
+
+void view_overlay(const char *top, const char *bottom)
+{
+    const char *lines[VIEW_ROWS] = {top, bottom};
+
+    memset(state.overlay, ' ', sizeof(state.overlay));
+
+    for(uint8_t row = 0; row < VIEW_ROWS; row++){
+        size_t length = strlen(lines[row]);
+        if(length > VIEW_COLUMNS){
+            length = VIEW_COLUMNS;
+        }
+
+        memcpy(&state.overlay[row][(VIEW_COLUMNS - length) / 2], lines[row], length);
+    }
+
+    state.overlay_active = true;
+}
+
+void view_overlay_clear()
+{
+    state.overlay_active = false;
+}
+
+bool view_dirty()
+{
+    const void *source = state.overlay_active ? state.overlay : state.frame;
+
+    return state.invalid || memcmp(source, state.shown, sizeof(state.shown)) != 0;
+}
+
+// Write the changed runs of a row
+static void _render_row_(uint8_t row)
+{
+    const char *frame = state.overlay_active ? state.overlay[row] : state.frame[row];
+    char *shown = state.shown[row];
+
+    uint8_t column = 0;
+
+    while(column < VIEW_COLUMNS){
+        if(!state.invalid && frame[column] == shown[column]){
+            column++;
+            continue;
+        }
+
+        // Extend the run over short gaps of unchanged characters
+        uint8_t end = column + 1;
+        uint8_t last = column;
+
+        while(end < VIEW_COLUMNS && end - last <= VIEW_MAX_GAP + 1){
+            if(state.invalid || frame[end] != shown[end]){
+                last = end;
+            }
+            end++;
+        }
+
+        display_set_cursor(row, column);
+
+        for(uint8_t i = column; i <= last; i++){
+            display_print_character(frame[i]);
+            shown[i] = frame[i];
+        }
+
+        column = last + 1;
+    }
+}
+
+void view_flush()
+{
+    if(!view_dirty()){
+        return;
+    }
+
+    for(uint8_t row = 0; row < VIEW_ROWS; row++){
+        _render_row_(row);
+    }
+
+    state.invalid = false;
+    state.renders++;
+    state.next_frame = make_timeout_time_ms(VIEW_FRAME_MS);
+}
+
+bool view_render()
+{
+    if(!view_dirty() || absolute_time_diff_us(get_absolute_time(), state.next_frame) > 0){
+        return false;
+    }
+
+    view_flush();
+    return true;
+}
+
+void view_invalidate()
+{
+    state.invalid = true;
+}
+
+uint32_t view_renders()
+{
+    return state.renders;
+}
@@ -0,0 +1,90 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+View model of the display.
+
+Pages compose their screen in a frame in RAM with the view functions,
+which work like the display print functions. Only characters that
+differ from what the display shows are marked dirty. view_render writes
+the dirty characters at most once per VIEW_FRAME_MS, so a burst of key
+presses and data updates ends in one minimal update, and a page that is
+composed again with the same content costs no display writes.
+
+An overlay can be shown over the frame. Pages keep composing the frame
+underneath, and the display returns to it when the overlay is cleared.
+
+Code that writes to the display directly must call view_flush before
+and view_invalidate after.
+*/
+
+#define VIEW_ROWS 2
+#define VIEW_COLUMNS 16
+
+// Minimum time between renders
+#define VIEW_FRAME_MS 50
+
+/**
+ * @brief Start with a blank frame. The display must have been cleared,
+ * as init_display does
+ */
+void view_init();
+
+void view_clear();
+
+void view_set_cursor(uint8_t row, uint8_t column);
+
+/**
+ * @brief Put character at the cursor and advance it. Characters past the
+ * end of the row are dropped
+ */
+void view_print_character(char character);
+
+void view_print_string(const char *string);
+
+/**
+ * @brief Put string right justified on row
+ */
+void view_print_string_rj(const char *string, uint8_t row);
+
+/**
+ * @brief Show top and bottom centered over the frame until
+ * view_overlay_clear. Replaces any overlay shown
+ */
+void view_overlay(const char *top, const char *bottom);
+
+void view_overlay_clear();
+
+/**
+ * @brief Returns true if the frame, or the overlay while one is shown,
+ * differs from the display
+ */
+bool view_dirty();
+
+/**
+ * @brief Write dirty characters to the display if a frame interval has
+ * passed since the last render. Call from the main loop
+ *
+ * @return true if the display was written
+ */
+bool view_render();
+
+/**
+ * @brief Write dirty characters now, regardless of the frame interval
+ */
+void view_flush();
+
+/**
+ * @brief The display content is unknown. The next render rewrites all of it
+ */
+void view_invalidate();
+
+/**
+ * @brief Number of renders that wrote to the display since boot
+ */
+uint32_t view_renders();
+
+#endif //VIEW_H
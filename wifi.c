@@ -3,63 +3,415 @@
 #include "string.h"
 
 #include "lwip/apps/http_client.h"
+#include "lwip/netif.h"
 #include "wifi.h"
+#include "kvstore.h"
+#include "trace.h"
 
 #define NETWORK_BUFFER_SIZE 16
 
+// Size of SSID hash table. Must be a power of two and at least twice the buffer size
+#define NETWORK_HASH_SIZE 32
+#define NETWORK_HASH_EMPTY 0xFF
+
+// Credentials stored on first boot when none are saved in flash
+#define WIFI_DEFAULT_SSID "Chrillbob's Hotspot"
+#define WIFI_DEFAULT_PASSWORD "NotPassword"
+#define WIFI_DEFAULT_AUTH CYW43_AUTH_WPA2_AES_PSK
+
+// Credentials are stored under the keys "wifi0" to "wifi<N-1>"
+#define WIFI_CREDENTIAL_KEY "wifi%u"
+
+typedef struct{
+    uint8_t ssid_len;
+    char ssid[32];
+    char password[64];
+    uint32_t auth_mode;
+} wifi_credential;
+
+// Last network joined, stored under this key
+#define WIFI_LAST_NETWORK_KEY "wifi_last"
+
+// Time allowed for a single join attempt, including DHCP
+#define WIFI_JOIN_TIMEOUT_MS 10000
+
+// Backoff between rounds of join attempts
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 60000
+
+// Candidate index of the last joined network
+#define WIFI_CANDIDATE_LAST (-1)
+
+// Network joined last time, so it can be joined again without a scan
 typedef struct{
-    cyw43_ev_scan_result_t scan_result;
-    bool empty;
-} wifi_network;
+    uint8_t ssid_len;
+    char ssid[32];
+    uint8_t bssid[6];
+    bool bssid_valid;
+    uint32_t channel;
+    uint32_t auth_mode;
+} wifi_last_network;
+
+enum wifi_supervisor_state{
+    // Until wifi_start_auto_connect
+    WIFI_STATE_IDLE,
+    WIFI_STATE_JOINING,
+    WIFI_STATE_CONNECTED,
+    WIFI_STATE_BACKOFF
+};
+
+static struct WifiSupervisor{
+    enum wifi_supervisor_state state;
+
+    // Candidate being joined. Starts with the last network and
+    // continues through the saved credentials in slot order
+    int candidate;
+    wifi_last_network joining;
+    absolute_time_t deadline;
+
+    // The network being joined was picked on the wifi page
+    bool manual;
+
+    uint32_t backoff_ms;
+
+    // Set from the lwIP link callback
+    volatile bool link_changed;
+} supervisor = {.backoff_ms = WIFI_BACKOFF_MIN_MS};
+
+static void start_join_round();
+
+// Power save is left this long before a scheduled request
+#define WIFI_PM_LEAD_MS 100
+
+// Performance mode is kept this long after a request is sent so the
+// response is not delayed by the radio sleeping
+#define WIFI_PM_HOLD_MS 3000
+
+static struct WifiPower{
+    enum wifi_power_mode mode;
+    bool mode_set;
+
+    // Next scheduled request, and end of the hold after the last one
+    absolute_time_t request_at;
+    absolute_time_t hold_until;
+
+    // Requests in flight or retries waiting, from the server module
+    bool requests_pending;
+
+    uint64_t mode_since_us;
+    struct WifiPowerStats stats;
+} power;
 
 static bool muted = 0;
 
-static wifi_network networks_buffer[NETWORK_BUFFER_SIZE];
+// Scan results. Each SSID is stored once with its strongest BSSID, and
+// results are kept sorted by RSSI so the UI can show them while scanning
+static struct ScanStore{
+    cyw43_ev_scan_result_t networks[NETWORK_BUFFER_SIZE];
+    uint32_t ssid_hash[NETWORK_BUFFER_SIZE];
+    uint8_t count;
 
-static bool cmp_network_ssid(char* ssid1, char* ssid2, uint8_t ssid1_len, uint8_t ssid2_len){
+    // Network indices sorted by descending RSSI
+    uint8_t sorted[NETWORK_BUFFER_SIZE];
+
+    // Open addressing hash table from SSID hash to network index
+    uint8_t table[NETWORK_HASH_SIZE];
+
+    // Incremented whenever the results change
+    volatile uint32_t generation;
+} scan_store;
+
+// FNV-1a hash of SSID
+static uint32_t hash_ssid(const uint8_t *ssid, uint8_t ssid_len)
+{
+    uint32_t hash = 2166136261u;
+
+    for(int i = 0; i < ssid_len; i++){
+        hash ^= ssid[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool cmp_network_ssid(const uint8_t* ssid1, const uint8_t* ssid2, uint8_t ssid1_len, uint8_t ssid2_len){
     if(ssid1_len != ssid2_len){
         return false;
     }
     
-    return strncmp(ssid1, ssid2, ssid1_len) == 0;
+    return memcmp(ssid1, ssid2, ssid1_len) == 0;
 }
 
+// Returns the hash table slot holding the SSID, or the empty slot it would be inserted in
+static uint8_t find_slot(const uint8_t *ssid, uint8_t ssid_len, uint32_t hash)
+{
+    uint8_t slot = hash & (NETWORK_HASH_SIZE - 1);
+
+    while(scan_store.table[slot] != NETWORK_HASH_EMPTY){
+        uint8_t network = scan_store.table[slot];
 
-static void empty_network_buffer(){
-    for(int i = 0; i < NETWORK_BUFFER_SIZE; i++){
-        networks_buffer[i].empty = true;
+        if(scan_store.ssid_hash[network] == hash && 
+           cmp_network_ssid(scan_store.networks[network].ssid, ssid, scan_store.networks[network].ssid_len, ssid_len)){
+            break;
+        }
+
+        slot = (slot + 1) & (NETWORK_HASH_SIZE - 1);
+    }
+
+    return slot;
+}
+
+static void rebuild_hash_table()
+{
+    memset(scan_store.table, NETWORK_HASH_EMPTY, sizeof(scan_store.table));
+
+    for(int i = 0; i < scan_store.count; i++){
+        uint8_t slot = find_slot(scan_store.networks[i].ssid, scan_store.networks[i].ssid_len, scan_store.ssid_hash[i]);
+        scan_store.table[slot] = i;
     }
 }
 
+// Move network to its place in the RSSI order. Position is its current
+// position in the sorted array
+static void sort_network(uint8_t position)
+{
+    uint8_t network = scan_store.sorted[position];
+    int16_t rssi = scan_store.networks[network].rssi;
+
+    // Move up past weaker networks
+    while(position > 0 && scan_store.networks[scan_store.sorted[position - 1]].rssi < rssi){
+        scan_store.sorted[position] = scan_store.sorted[position - 1];
+        position--;
+    }
+
+    // Move down past stronger networks
+    while(position + 1 < scan_store.count && scan_store.networks[scan_store.sorted[position + 1]].rssi > rssi){
+        scan_store.sorted[position] = scan_store.sorted[position + 1];
+        position++;
+    }
+
+    scan_store.sorted[position] = network;
+}
+
+static void empty_network_buffer(){
+    scan_store.count = 0;
+    memset(scan_store.table, NETWORK_HASH_EMPTY, sizeof(scan_store.table));
+    scan_store.generation++;
+}
+
+// Called from the cyw43 driver for every BSSID found
 static int save_wifi_result(void *env, const cyw43_ev_scan_result_t* result){
     // Check that SSID length is not 0
-    if(strlen(result->ssid) == 0 || result->ssid_len == 0){
+    if(result->ssid_len == 0 || result->ssid[0] == '\0'){
         return -1;
     }
-    
-    for(int i = 0; i < NETWORK_BUFFER_SIZE; i++){
-        // Discard network duplicates
-        if(cmp_network_ssid(networks_buffer[i].scan_result.ssid, result->ssid, networks_buffer[i].scan_result.ssid_len, result->ssid_len)){
-            break;
+
+    uint32_t hash = hash_ssid(result->ssid, result->ssid_len);
+    uint8_t slot = find_slot(result->ssid, result->ssid_len, hash);
+    uint8_t network = scan_store.table[slot];
+
+    if(network != NETWORK_HASH_EMPTY){
+        // Known SSID, keep the strongest BSSID
+        if(result->rssi <= scan_store.networks[network].rssi){
+            return 0;
         }
 
-        if(networks_buffer[i].empty == false){
-            continue;
+        scan_store.networks[network] = *result;
+    }
+    else if(scan_store.count < NETWORK_BUFFER_SIZE){
+        network = scan_store.count;
+        scan_store.count++;
+
+        scan_store.networks[network] = *result;
+        scan_store.ssid_hash[network] = hash;
+        scan_store.sorted[scan_store.count - 1] = network;
+        scan_store.table[slot] = network;
+
+        printf("id: %-3d ssid: %-32s auth: %u\n", network, scan_store.networks[network].ssid, scan_store.networks[network].auth_mode);
+    }
+    else{
+        // Buffer is full, replace the weakest network if this one is stronger
+        network = scan_store.sorted[scan_store.count - 1];
+
+        if(result->rssi <= scan_store.networks[network].rssi){
+            return 0;
         }
-        else{
-            networks_buffer[i].scan_result = *result;
-            networks_buffer[i].empty = false;
 
-            printf("id: %-3d ssid: %-32s auth: %u\n", i, networks_buffer[i].scan_result.ssid, networks_buffer[i].scan_result.auth_mode);
+        scan_store.networks[network] = *result;
+        scan_store.ssid_hash[network] = hash;
+        rebuild_hash_table();
+    }
+
+    // Find position of network and move it to its place in the RSSI order
+    for(int i = 0; i < scan_store.count; i++){
+        if(scan_store.sorted[i] == network){
+            sort_network(i);
             break;
         }
     }
 
+    scan_store.generation++;
+
     return 0;
 }
 
+static const cyw43_ev_scan_result_t *get_scan_result(uint8_t network)
+{
+    return &scan_store.networks[scan_store.sorted[network]];
+}
+
+// Look up saved credentials for network
+static bool find_credential(const uint8_t *ssid, uint8_t ssid_len, wifi_credential *credential)
+{
+    char key[KV_MAX_KEY_LENGTH + 1];
+
+    for(int i = 0; i < WIFI_MAX_CREDENTIALS; i++){
+        snprintf(key, sizeof(key), WIFI_CREDENTIAL_KEY, i);
+
+        if(kv_get(key, credential, sizeof(wifi_credential)) != sizeof(wifi_credential)){
+            continue;
+        }
+
+        if(credential->ssid_len == ssid_len && memcmp(credential->ssid, ssid, ssid_len) == 0){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int wifi_save_credential(const char* ssid, const char* password, uint32_t auth_mode)
+{
+    wifi_credential credential = {0};
+    wifi_credential existing;
+    char key[KV_MAX_KEY_LENGTH + 1];
+    int free_slot = -1;
+
+    size_t ssid_len = strlen(ssid);
+
+    if(ssid_len > sizeof(credential.ssid) || strlen(password) >= sizeof(credential.password)){
+        return -1;
+    }
+
+    credential.ssid_len = ssid_len;
+    memcpy(credential.ssid, ssid, ssid_len);
+    strcpy(credential.password, password);
+    credential.auth_mode = auth_mode;
+
+    // Overwrite credentials for the same network or use the first free slot
+    for(int i = 0; i < WIFI_MAX_CREDENTIALS; i++){
+        snprintf(key, sizeof(key), WIFI_CREDENTIAL_KEY, i);
+
+        if(kv_get(key, &existing, sizeof(existing)) != sizeof(existing)){
+            if(free_slot < 0){
+                free_slot = i;
+            }
+            continue;
+        }
+
+        if(existing.ssid_len == ssid_len && memcmp(existing.ssid, ssid, ssid_len) == 0){
+            return kv_set(key, &credential, sizeof(credential)) == KV_ERR_OK ? 0 : -1;
+        }
+    }
+
+    if(free_slot < 0){
+        return -1;
+    }
+
+    snprintf(key, sizeof(key), WIFI_CREDENTIAL_KEY, free_slot);
+    return kv_set(key, &credential, sizeof(credential)) == KV_ERR_OK ? 0 : -1;
+}
+
+static void account_power_mode()
+{
+    uint64_t now = time_us_64();
+
+    if(power.mode_set){
+        power.stats.time_us[power.mode] += now - power.mode_since_us;
+    }
+    power.mode_since_us = now;
+}
+
+static void set_power_mode(enum wifi_power_mode mode)
+{
+    if(power.mode_set && power.mode == mode){
+        return;
+    }
+
+    uint32_t pm = mode == WIFI_POWER_PERFORMANCE ? CYW43_PERFORMANCE_PM : CYW43_AGGRESSIVE_PM;
+
+    cyw43_arch_lwip_begin();
+    int status = cyw43_wifi_pm(&cyw43_state, pm);
+    cyw43_arch_lwip_end();
+
+    if(status != 0){
+        printf("Failed to set power mode: %d\n", status);
+        return;
+    }
+
+    account_power_mode();
+    power.mode = mode;
+    power.mode_set = true;
+    power.stats.switches++;
+}
+
+// Choose power mode from what the radio is about to do
+static void update_power_mode()
+{
+    absolute_time_t now = get_absolute_time();
+
+    bool busy = supervisor.state == WIFI_STATE_JOINING || cyw43_wifi_scan_active(&cyw43_state);
+
+    // Waking up for the next request, or waiting for responses to the last
+    int64_t until_request_us = absolute_time_diff_us(now, power.request_at);
+
+    bool request_window = (until_request_us <= WIFI_PM_LEAD_MS * 1000 && until_request_us >= -WIFI_PM_HOLD_MS * 1000) ||
+        now < power.hold_until || power.requests_pending;
+
+    set_power_mode(busy || request_window ? WIFI_POWER_PERFORMANCE : WIFI_POWER_SAVE);
+}
+
+void wifi_power_schedule_request(absolute_time_t request_at)
+{
+    power.request_at = request_at;
+    power.hold_until = make_timeout_time_ms(WIFI_PM_HOLD_MS);
+}
+
+void wifi_power_set_requests_pending(bool pending)
+{
+    power.requests_pending = pending;
+}
+
+struct WifiPowerStats wifi_power_stats()
+{
+    account_power_mode();
+    return power.stats;
+}
+
+void wifi_power_print_stats()
+{
+    struct WifiPowerStats stats = wifi_power_stats();
+    uint64_t total_us = stats.time_us[WIFI_POWER_SAVE] + stats.time_us[WIFI_POWER_PERFORMANCE];
+
+    if(total_us == 0){
+        return;
+    }
+
+    printf("wifi pm: save %llu ms (%u%%), performance %llu ms, %lu switches\n",
+        (unsigned long long)(stats.time_us[WIFI_POWER_SAVE] / 1000),
+        (unsigned)(stats.time_us[WIFI_POWER_SAVE] * 100 / total_us),
+        (unsigned long long)(stats.time_us[WIFI_POWER_PERFORMANCE] / 1000),
+        (unsigned long)stats.switches);
+}
+
 int init_wifi()
 {
+    // Make sure the default network can be joined on a fresh device
+    wifi_credential credential;
+    if(!find_credential((const uint8_t *)WIFI_DEFAULT_SSID, strlen(WIFI_DEFAULT_SSID), &credential)){
+        wifi_save_credential(WIFI_DEFAULT_SSID, WIFI_DEFAULT_PASSWORD, WIFI_DEFAULT_AUTH);
+    }
+
     // Initialise the Wi-Fi chip
     if (cyw43_arch_init()) {
         printf("Wi-Fi init failed\n");
@@ -82,85 +434,355 @@ int init_wifi()
 
 uint8_t get_network_buffer_size()
 {
-    for(int i = 0; i < NETWORK_BUFFER_SIZE; i++){
-        if(networks_buffer[i].empty){
-            return i;
-        }
+    return scan_store.count;
+}
+
+int get_network_ssid(uint8_t network, char *ssid)
+{
+    int err = -1;
+
+    // The scan callback rewrites and re-sorts the results
+    cyw43_arch_lwip_begin();
+
+    if(network < scan_store.count){
+        const cyw43_ev_scan_result_t *scan_result = get_scan_result(network);
+
+        memcpy(ssid, scan_result->ssid, scan_result->ssid_len);
+        ssid[scan_result->ssid_len] = '\0';
+        err = 0;
     }
-    return 8;
+
+    cyw43_arch_lwip_end();
+
+    return err;
 }
 
-char *get_network_ssid(uint8_t network)
+uint32_t wifi_scan_generation()
 {
-    return networks_buffer[network].scan_result.ssid;
+    return scan_store.generation;
 }
 
-int connect_to_network(uint8_t network)
+int connect_to_network(const char *ssid)
 {
-    printf("Joining wifi %.3u: %-32s\n", network, networks_buffer[network].scan_result.ssid);
+    size_t ssid_len = strlen(ssid);
 
-    // Connect if Chrillbob's Hotspot
-    if(strcmp(networks_buffer[network].scan_result.ssid, "Chrillbob's Hotspot") == 0){
-        printf("Joining Chrillbob's Hotspot\n");
-        
-        cyw43_wifi_join(&cyw43_state, 
-            networks_buffer[network].scan_result.ssid_len, 
-            networks_buffer[network].scan_result.ssid,
-            12,
-            "NotPassword",
-            CYW43_AUTH_WPA2_AES_PSK,
-            NULL, 0);
+    if(ssid_len > WIFI_SSID_SIZE - 1){
+        return -1;
     }
-    else if(networks_buffer[network].scan_result.auth_mode != 0){
+
+    // Copy the result so a scan still running cannot change it
+    cyw43_ev_scan_result_t result;
+
+    cyw43_arch_lwip_begin();
+
+    uint8_t network = scan_store.table[find_slot((const uint8_t *)ssid, ssid_len, hash_ssid((const uint8_t *)ssid, ssid_len))];
+
+    if(network != NETWORK_HASH_EMPTY){
+        result = scan_store.networks[network];
+    }
+
+    cyw43_arch_lwip_end();
+
+    if(network == NETWORK_HASH_EMPTY){
+        printf("Network %s is no longer in the scan results\n", ssid);
+        return -1;
+    }
+
+    printf("Joining wifi: %-32s\n", ssid);
+
+    wifi_credential credential = {0};
+    bool credential_found = find_credential(result.ssid, result.ssid_len, &credential);
+
+    if(!credential_found && result.auth_mode != 0){
         printf("Failed to connect to network as only open networks are supported\n");
         return -1;
     }
-    else{
-        cyw43_wifi_join(&cyw43_state, 
-            networks_buffer[network].scan_result.ssid_len, 
-            networks_buffer[network].scan_result.ssid,
-            0,
-            0,
-            networks_buffer[network].scan_result.auth_mode,
-            NULL, 0);
-            
-    }
-
-    if(cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_JOIN){
-        for(int i = 0; i < 5 && cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_JOIN; i++){
-            sleep_ms(5000);
-        }
+
+    if(credential_found){
+        printf("Joining with saved credentials\n");
     }
 
-    if(cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_JOIN){
+    wifi_last_network joining = {
+        .ssid_len = result.ssid_len,
+        .bssid_valid = true,
+        .channel = result.channel,
+        .auth_mode = credential_found ? credential.auth_mode : CYW43_AUTH_OPEN
+    };
+    memcpy(joining.ssid, result.ssid, joining.ssid_len);
+    memcpy(joining.bssid, result.bssid, sizeof(joining.bssid));
+
+    // Leave the current network so its link is not taken for the new one
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+
+    int err = cyw43_wifi_join(&cyw43_state,
+        joining.ssid_len,
+        (const uint8_t *)joining.ssid,
+        strlen(credential.password),
+        (const uint8_t *)credential.password,
+        joining.auth_mode,
+        NULL, 0);
+
+    if(err != 0){
+        printf("Failed to start join: %d\n", err);
+        start_join_round();
         return -1;
     }
 
+    TRACE_BEGIN(TRACE_WIFI_JOIN, 0);
+
+    // The supervisor follows the join from here. The network is saved as
+    // the last network once it is up, and if the join fails the saved
+    // networks are joined again
+    supervisor.state = WIFI_STATE_JOINING;
+    supervisor.joining = joining;
+    supervisor.candidate = WIFI_CANDIDATE_LAST;
+    supervisor.deadline = make_timeout_time_ms(WIFI_JOIN_TIMEOUT_MS);
+    supervisor.manual = true;
+
+    set_power_mode(WIFI_POWER_PERFORMANCE);
+
     return 0;
 }
 
-void scan_for_networks()
+int wifi_scan_start()
 {
+    // Results arrive faster with the radio awake
+    set_power_mode(WIFI_POWER_PERFORMANCE);
+
+    cyw43_arch_lwip_begin();
     empty_network_buffer();
 
     cyw43_wifi_scan_options_t scan_options = {0};
 
-    
     printf("Scanning for WiFi networks\n");
     int status = cyw43_wifi_scan(&cyw43_state, &scan_options, NULL, &save_wifi_result);
+    cyw43_arch_lwip_end();
 
     if(status != 0){
         printf("Failed to start scan: %i", status);
-        return;
+        return -1;
     }
 
     printf("Scan started succesfully\n");
 
-    
-    while(cyw43_wifi_scan_active(&cyw43_state)){
-        sleep_ms(5000);
-        printf(".");
+    return 0;
+}
+
+bool wifi_scan_active()
+{
+    return cyw43_wifi_scan_active(&cyw43_state);
+}
+
+void scan_for_networks()
+{
+    if(wifi_scan_start() != 0){
+        return;
+    }
+
+    while(wifi_scan_active()){
+        sleep_ms(10);
     }
     printf("Scan complete\n");
 
 }
+
+// Called by lwIP from the cyw43 driver context when the link goes up or down
+static void link_callback(struct netif *netif)
+{
+    supervisor.link_changed = true;
+}
+
+// Load candidate network into supervisor.joining. Returns false if there is no
+// such candidate
+static bool load_candidate(int candidate)
+{
+    wifi_last_network *joining = &supervisor.joining;
+
+    if(candidate == WIFI_CANDIDATE_LAST){
+        return kv_get(WIFI_LAST_NETWORK_KEY, joining, sizeof(wifi_last_network)) == sizeof(wifi_last_network);
+    }
+
+    char key[KV_MAX_KEY_LENGTH + 1];
+    wifi_credential credential;
+
+    snprintf(key, sizeof(key), WIFI_CREDENTIAL_KEY, candidate);
+
+    if(kv_get(key, &credential, sizeof(credential)) != sizeof(credential)){
+        return false;
+    }
+
+    // Already tried as the last network
+    wifi_last_network last;
+    if(kv_get(WIFI_LAST_NETWORK_KEY, &last, sizeof(last)) == sizeof(last) &&
+       last.ssid_len == credential.ssid_len && memcmp(last.ssid, credential.ssid, last.ssid_len) == 0){
+        return false;
+    }
+
+    *joining = (wifi_last_network){
+        .ssid_len = credential.ssid_len,
+        .bssid_valid = false,
+        .channel = CYW43_CHANNEL_NONE,
+        .auth_mode = credential.auth_mode
+    };
+    memcpy(joining->ssid, credential.ssid, credential.ssid_len);
+
+    return true;
+}
+
+// Start joining the next candidate without scanning. Returns false when
+// all candidates have been tried
+static bool join_next_candidate()
+{
+    while(supervisor.candidate < WIFI_MAX_CREDENTIALS){
+        int candidate = supervisor.candidate++;
+
+        if(!load_candidate(candidate)){
+            continue;
+        }
+
+        wifi_last_network *joining = &supervisor.joining;
+        wifi_credential credential = {0};
+
+        if(joining->auth_mode != CYW43_AUTH_OPEN && !find_credential((const uint8_t *)joining->ssid, joining->ssid_len, &credential)){
+            continue;
+        }
+
+        printf("Joining %.*s directly\n", joining->ssid_len, joining->ssid);
+
+        // With a known BSSID and channel the driver skips the scan
+        int err = cyw43_wifi_join(&cyw43_state,
+            joining->ssid_len,
+            (const uint8_t *)joining->ssid,
+            strlen(credential.password),
+            (const uint8_t *)credential.password,
+            joining->auth_mode,
+            joining->bssid_valid ? joining->bssid : NULL,
+            joining->bssid_valid ? joining->channel : CYW43_CHANNEL_NONE);
+
+        if(err != 0){
+            continue;
+        }
+
+        TRACE_BEGIN(TRACE_WIFI_JOIN, 0);
+
+        supervisor.state = WIFI_STATE_JOINING;
+        supervisor.deadline = make_timeout_time_ms(WIFI_JOIN_TIMEOUT_MS);
+        return true;
+    }
+
+    return false;
+}
+
+// Wait before the next round of join attempts, longer after each round
+static void start_backoff()
+{
+    supervisor.state = WIFI_STATE_BACKOFF;
+    supervisor.deadline = make_timeout_time_ms(supervisor.backoff_ms);
+
+    supervisor.backoff_ms *= 2;
+    if(supervisor.backoff_ms > WIFI_BACKOFF_MAX_MS){
+        supervisor.backoff_ms = WIFI_BACKOFF_MAX_MS;
+    }
+}
+
+static void start_join_round()
+{
+    supervisor.candidate = WIFI_CANDIDATE_LAST;
+
+    // With no network to join, try again later. Credentials may be saved
+    // or the access point may come back in the meantime
+    if(!join_next_candidate()){
+        start_backoff();
+    }
+}
+
+void wifi_start_auto_connect()
+{
+    cyw43_arch_lwip_begin();
+    netif_set_link_callback(&cyw43_state.netif[CYW43_ITF_STA], link_callback);
+    cyw43_arch_lwip_end();
+
+    supervisor.backoff_ms = WIFI_BACKOFF_MIN_MS;
+    start_join_round();
+
+    set_power_mode(WIFI_POWER_PERFORMANCE);
+}
+
+bool wifi_is_connected()
+{
+    return cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP;
+}
+
+enum wifi_event wifi_poll()
+{
+    int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+
+    // A drop reported by the link callback is acted on right away, even
+    // if the driver status has not caught up yet
+    bool link_lost = supervisor.link_changed && !netif_is_link_up(&cyw43_state.netif[CYW43_ITF_STA]);
+    supervisor.link_changed = false;
+
+    update_power_mode();
+
+    switch(supervisor.state){
+    case WIFI_STATE_JOINING:
+        if(status == CYW43_LINK_UP){
+            supervisor.state = WIFI_STATE_CONNECTED;
+            supervisor.backoff_ms = WIFI_BACKOFF_MIN_MS;
+            supervisor.manual = false;
+
+            // Keep BSSID and channel of the access point for next time
+            if(!supervisor.joining.bssid_valid && cyw43_wifi_get_bssid(&cyw43_state, supervisor.joining.bssid) == 0){
+                supervisor.joining.bssid_valid = true;
+            }
+            kv_set(WIFI_LAST_NETWORK_KEY, &supervisor.joining, sizeof(wifi_last_network));
+
+            TRACE_END(TRACE_WIFI_JOIN, 0);
+            TRACE_INSTANT(TRACE_WIFI_LINK, 1);
+
+            printf("WiFi connected\n");
+            return WIFI_EVENT_CONNECTED;
+        }
+
+        if(status == CYW43_LINK_FAIL || status == CYW43_LINK_NONET || status == CYW43_LINK_BADAUTH ||
+           get_absolute_time() > supervisor.deadline){
+            printf("Joining %.*s failed: %d\n", supervisor.joining.ssid_len, supervisor.joining.ssid, status);
+            TRACE_END(TRACE_WIFI_JOIN, 0);
+
+            bool manual = supervisor.manual;
+            supervisor.manual = false;
+
+            if(!join_next_candidate()){
+                // All candidates failed, wait before the next round
+                start_backoff();
+            }
+
+            if(manual){
+                return WIFI_EVENT_JOIN_FAILED;
+            }
+        }
+        break;
+
+    case WIFI_STATE_CONNECTED:
+        if(status != CYW43_LINK_UP || link_lost){
+            printf("WiFi link lost: %d\n", status);
+            TRACE_INSTANT(TRACE_WIFI_LINK, 0);
+
+            // Rejoin right away, the access point is most likely still there
+            start_join_round();
+            return WIFI_EVENT_DISCONNECTED;
+        }
+        break;
+
+    case WIFI_STATE_BACKOFF:
+        if(get_absolute_time() > supervisor.deadline){
+            start_join_round();
+        }
+        break;
+
+    case WIFI_STATE_IDLE:
+        break;
+    }
+
+    return WIFI_EVENT_NONE;
+}
@@ -1,22 +1,136 @@
 #ifndef WIFI_H
 #define WIFI_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/time.h"
+
 int init_wifi();
 
 /**
- * @brief Get number of available networks
+ * @brief Get number of available networks. Can be called while a scan is running
  */
 uint8_t get_network_buffer_size();
 
-char* get_network_ssid(uint8_t network);
+// Size of an SSID buffer, including the terminator
+#define WIFI_SSID_SIZE 33
+
+/**
+ * @brief Copy the SSID of network to ssid, which holds WIFI_SSID_SIZE bytes.
+ * Networks are sorted by descending signal strength, so the same index may
+ * name another network once more results arrive
+ *
+ * @return 0 on success, -1 if there is no such network
+ */
+int get_network_ssid(uint8_t network, char *ssid);
+
+// Max number of saved network credentials
+#define WIFI_MAX_CREDENTIALS 4
 
-int connect_to_network(uint8_t network);
+/**
+ * @brief Start joining the network with this SSID from the scan results.
+ * Returns right away,
+ * the join is followed by @ref wifi_poll() like any other. If it fails the
+ * saved networks are joined again.
+ *
+ * @return 0 if the join was started, -1 if the network is not in the scan
+ * results, needs credentials that are not saved or the join could not be started
+ */
+int connect_to_network(const char *ssid);
+
+/**
+ * @brief Save credentials for a network in flash. Credentials for a
+ * network that is already saved are replaced.
+ * 
+ * @return 0 on success, -1 if the credentials are too long or all slots are used
+ */
+int wifi_save_credential(const char* ssid, const char* password, uint32_t auth_mode);
 
 /**
- * @brief Scan for wifi networks and updates network buffer
+ * @brief Scan for wifi networks and updates network buffer. Blocks until the scan is complete
  */
 void scan_for_networks();
 
+/**
+ * @brief Clear network buffer and start a scan. Results are added to the network
+ * buffer as they arrive.
+ * 
+ * @return 0 if the scan was started
+ */
+int wifi_scan_start();
+
+bool wifi_scan_active();
+
+/**
+ * @brief Counter that changes whenever the network buffer changes. 
+ * Used to redraw the network list while a scan is running
+ */
+uint32_t wifi_scan_generation();
+
+enum wifi_event{
+    WIFI_EVENT_NONE,
+    WIFI_EVENT_CONNECTED,
+    WIFI_EVENT_DISCONNECTED,
+    WIFI_EVENT_JOIN_FAILED
+};
+
+/**
+ * @brief Start joining known networks without scanning. The last joined 
+ * network is tried first using its saved BSSID and channel, followed by 
+ * the saved credentials. The link is then supervised by @ref wifi_poll()
+ */
+void wifi_start_auto_connect();
+
+/**
+ * @brief Advance the join and reconnect state machine. Never blocks.
+ * Should be called from the main loop.
+ * 
+ * @return Returns WIFI_EVENT_CONNECTED when the link comes up with an IP address
+ * and WIFI_EVENT_DISCONNECTED when it is lost. WIFI_EVENT_JOIN_FAILED when
+ * a join started by @ref connect_to_network() fails
+ */
+enum wifi_event wifi_poll();
+
+/**
+ * @brief Returns true if the link is up and has an IP address
+ */
+bool wifi_is_connected();
+
+enum wifi_power_mode{
+    WIFI_POWER_SAVE,
+    WIFI_POWER_PERFORMANCE,
+    WIFI_POWER_MODES
+};
+
+struct WifiPowerStats{
+    // Time spent in each power mode since init
+    uint64_t time_us[WIFI_POWER_MODES];
+    uint32_t switches;
+};
+
+/**
+ * @brief Tell the power governor that a request was just sent and when
+ * the next one is. The radio is kept in power save mode between requests
+ * and switched to performance mode shortly before the request until the
+ * responses have arrived. Scans and joins always use performance mode.
+ * The mode is updated by @ref wifi_poll()
+ */
+void wifi_power_schedule_request(absolute_time_t request_at);
+
+/**
+ * @brief Keep performance mode while requests are in flight or retries
+ * are waiting, see @ref server_requests_pending()
+ */
+void wifi_power_set_requests_pending(bool pending);
+
+/**
+ * @brief Time spent in each power mode. Used to estimate energy per reading
+ */
+struct WifiPowerStats wifi_power_stats();
+
+void wifi_power_print_stats();
+
 
 
 #endif //WIFI_H
\ No newline at end of file